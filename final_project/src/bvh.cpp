@@ -1,4 +1,797 @@
 #include "bvh.h"
+#include "draw.h"
+#include "extra.h"
+#include "interpolate.h"
+#include "intersect.h"
+#include "render.h"
+#include "scene.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <framework/opengl_includes.h>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <typeinfo>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Helper method to fill in hitInfo object. This can be safely ignored (or extended).
+// Note: many of the functions in this helper tie in to standard/extra features you will have
+// to implement separately, see interpolate.h/.cpp for these parts of the project
+void updateHitInfo(RenderState& state, const BVHInterface::Primitive& primitive, const Ray& ray, HitInfo& hitInfo)
+{
+    const auto& [v0, v1, v2] = std::tie(primitive.v0, primitive.v1, primitive.v2);
+    const auto& mesh = state.scene.meshes[primitive.meshID];
+    const auto n = glm::normalize(glm::cross(v1.position - v0.position, v2.position - v0.position));
+    const auto p = ray.origin + ray.t * ray.direction;
+
+    // First, fill in default data, unrelated to separate features
+    hitInfo.material = mesh.material;
+    hitInfo.normal = n;
+    hitInfo.barycentricCoord = computeBarycentricCoord(v0.position, v1.position, v2.position, p);
+
+    // Next, if `features.enableNormalInterp` is true, generate smoothly interpolated vertex normals
+    if (state.features.enableNormalInterp) {
+        hitInfo.normal = interpolateNormal(v0.normal, v1.normal, v2.normal, hitInfo.barycentricCoord);
+    }
+
+    // Next, if `features.enableTextureMapping` is true, generate smoothly interpolated vertex uvs
+    if (state.features.enableTextureMapping) {
+        hitInfo.texCoord = interpolateTexCoord(v0.texCoord, v1.texCoord, v2.texCoord, hitInfo.barycentricCoord);
+    }
+
+    // Finally, catch flipped normals
+    if (glm::dot(ray.direction, n) > 0.0f) {
+        hitInfo.normal = -hitInfo.normal;
+    }
+}
+
+// Temporary data recorded by `BVH::splitRecursive()` or `BVH::splitLinearRecursive()`, and consumed by `BVH::buildRecursive()`.
+// Every node covers a range [begin, end) of `m_primitives`. As both children of a split are non-empty,
+// the root and all right children have unique `begin` positions, and all left children have unique
+// `end` positions; these form a unique key per node, s.t. concurrent tasks never write the same element.
+struct BVH::BuildRanges {
+    std::vector<AxisAlignedBox> boxes; // Bounding box of each node
+    std::vector<uint32_t> splits; // Split position inside each node's range, or 0 if it is a leaf
+
+    BuildRanges(size_t numPrimitives)
+        : boxes(2 * numPrimitives)
+        , splits(2 * numPrimitives)
+    {
+    }
+
+    // Keys of the root, and of a node's left/right child, given the absolute position of the node's split
+    static constexpr size_t rootKey = 0;
+    size_t leftKey(size_t split) const { return boxes.size() / 2 + split - 1; }
+    static size_t rightKey(size_t split) { return split; }
+};
+
+// BVH constructor; can be safely ignored. You should not have to touch this
+// NOTE: this constructor is tested, so do not change the function signature.
+BVH::BVH(const Scene& scene, const Features& features)
+{
+#ifndef NDEBUG
+    // Store start of bvh build for timing
+    using clock = std::chrono::high_resolution_clock;
+    const auto start = clock::now();
+#endif
+
+    // Count the total nr. of triangles in the scene
+    size_t numTriangles = 0;
+    for (const auto& mesh : scene.meshes)
+        numTriangles += mesh.triangles.size();
+
+    // Given the input scene, gather all triangles over which to build the BVH as a list of Primitives;
+    // these are partitioned in place during construction, s.t. each leaf refers to a contiguous range.
+    // For the compact store, the meshID instead records the triangle's global index, see `buildCompactPrimitives()`
+    const bool isCompact = features.extra.enableBvhCompactPrimitives;
+    m_primitives.reserve(numTriangles);
+    for (uint32_t meshID = 0; meshID < scene.meshes.size(); meshID++) {
+        const auto& mesh = scene.meshes[meshID];
+        for (const auto& triangle : mesh.triangles) {
+            m_primitives.push_back(Primitive {
+                .meshID = isCompact ? static_cast<uint32_t>(m_primitives.size()) : meshID,
+                .v0 = mesh.vertices[triangle.x],
+                .v1 = mesh.vertices[triangle.y],
+                .v2 = mesh.vertices[triangle.z] });
+        }
+    }
+
+    // Tell underlying vectors how large they should approximately be
+    m_nodes.reserve(numTriangles + 1);
+
+    // Recursively build BVH structure; this is where your implementation comes in
+    m_nodes.emplace_back(); // Create root node
+    m_nodes.emplace_back(); // Create dummy node s.t. children are allocated on the same cache line
+    if (m_primitives.empty()) {
+        // Scenes without meshes (e.g. spheres only) still get a valid, empty root
+        m_nodes[RootIndex] = buildLeafData(scene, features, AxisAlignedBox {}, m_primitives);
+    } else {
+        // First split the primitives, building large subtrees concurrently; then emit the nodes. The linear build
+        // instead sorts the primitives along a Morton curve, and splits them where their codes differ
+        BuildRanges ranges(m_primitives.size());
+        const auto codes = features.extra.enableBvhLinearBuild ? sortPrimitivesByMortonCode(m_primitives) : std::vector<uint64_t> {};
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel
+#pragma omp single
+#endif
+        {
+            if (features.extra.enableBvhLinearBuild) {
+                splitLinearRecursive(m_primitives, codes, BuildRanges::rootKey, ranges);
+            } else {
+                splitRecursive(features, m_primitives, BuildRanges::rootKey, ranges);
+            }
+        }
+        buildRecursive(scene, features, m_primitives, RootIndex, BuildRanges::rootKey, ranges);
+    }
+
+    // Optionally recover some of the tree's quality, mostly useful after a linear build
+    if (features.extra.enableBvhTreeletOptimization && !m_nodes[RootIndex].isLeaf()) {
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel
+#pragma omp single
+#endif
+        optimizeTreelets(RootIndex, std::clamp(features.extra.bvhTreeletSize, 3u, MaxTreeletSize), 0);
+    }
+
+    // Optionally swap the primitives for the compact store
+    if (isCompact) {
+        m_triangleTest = features.extra.bvhTriangleTest;
+        buildCompactPrimitives(scene);
+    }
+
+    // Optionally collapse the hierarchy into a wide one, which is then used for traversal
+    if (features.extra.bvhWidth == 4 && !m_nodes[RootIndex].isLeaf()) {
+        buildWideRecursive(m_wideNodes4, RootIndex);
+    } else if (features.extra.bvhWidth == 8 && !m_nodes[RootIndex].isLeaf()) {
+        buildWideRecursive(m_wideNodes8, RootIndex);
+    }
+
+    // Fill in boilerplate data
+    buildNumLevels();
+    buildNumLeaves();
+    buildSahCost(features);
+
+#ifndef NDEBUG
+    // Output end of bvh build for timing
+    const auto end = clock::now();
+    std::cout << "BVH construction time: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+    std::cout << "BVH SAH cost: " << m_sahCost << (features.extra.enableBvhLinearBuild ? " (linear)" : features.extra.enableBvhSahBinning ? " (binned SAH)" : " (median)") << std::endl;
+#endif
+}
+
+// BVH helper method; allocates a new node and returns its index
+// You should not have to touch this
+uint32_t BVH::nextNodeIdx()
+{
+    const auto idx = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    return idx;
+}
+
+// Given a BVH triangle, compute an axis-aligned bounding box around the primitive
+// - primitive; a single triangle to be stored in the BVH
+// - return;    an axis-aligned bounding box around the triangle
+// This method is unit-tested, so do not change the function signature.
+AxisAlignedBox computePrimitiveAABB(const BVHInterface::Primitive primitive)
+{
+    glm::vec3 p0 = primitive.v0.position;
+    glm::vec3 p1 = primitive.v1.position;
+    glm::vec3 p2 = primitive.v2.position;
+
+    AxisAlignedBox aabb = {
+        .lower = glm::min(p0, glm::min(p1, p2)),
+        .upper = glm::max(p0, glm::max(p1, p2))
+    };
+    return aabb;
+}
+
+// Given a range of BVH triangles, compute an axis-aligned bounding box around the range.
+// - primitives; a contiguous range of triangles to be stored in the BVH
+// - return;    a single axis-aligned bounding box around the entire set of triangles
+// This method is unit-tested, so do not change the function signature.
+AxisAlignedBox computeSpanAABB(std::span<const BVHInterface::Primitive> primitives)
+{
+    AxisAlignedBox aabb = computePrimitiveAABB(primitives[0]);
+    for (size_t i = 1; i < primitives.size(); i++) {
+        const auto& p = primitives[i];
+        aabb.lower = glm::min(aabb.lower, glm::min(p.v0.position, glm::min(p.v1.position, p.v2.position)));
+        aabb.upper = glm::max(aabb.upper, glm::max(p.v0.position, glm::max(p.v1.position, p.v2.position)));
+    }
+    return aabb;
+}
+
+// Given a large range of BVH triangles, compute an axis-aligned bounding box over the range
+// by reducing the bounding boxes of fixed-size chunks concurrently.
+// - primitives; a contiguous range of triangles to be stored in the BVH
+// - f;          computes the bounding box of a single chunk, e.g. `computeSpanAABB()`
+// - return;    a single axis-aligned bounding box around the boxes of all chunks
+template <typename F>
+static AxisAlignedBox reduceSpanAABBParallel(std::span<const BVHInterface::Primitive> primitives, F&& f)
+{
+    constexpr size_t chunkSize = BVH::ParallelBuildSize;
+    const size_t numChunks = (primitives.size() + chunkSize - 1) / chunkSize;
+
+    std::vector<AxisAlignedBox> chunks(numChunks);
+#pragma omp taskloop shared(chunks, primitives, f)
+    for (size_t i = 0; i < numChunks; i++) {
+        chunks[i] = f(primitives.subspan(i * chunkSize, std::min(chunkSize, primitives.size() - i * chunkSize)));
+    }
+
+    AxisAlignedBox aabb = chunks[0];
+    for (const auto& chunk : chunks) {
+        aabb.lower = glm::min(aabb.lower, chunk.lower);
+        aabb.upper = glm::max(aabb.upper, chunk.upper);
+    }
+    return aabb;
+}
+
+// Given a BVH triangle, compute the geometric centroid of the triangle
+// - primitive; a single triangle to be stored in the BVH
+// - return;    the geometric centroid of the triangle's vertices
+// This method is unit-tested, so do not change the function signature.
+glm::vec3 computePrimitiveCentroid(const BVHInterface::Primitive primitive)
+{
+    return (primitive.v0.position + primitive.v1.position + primitive.v2.position) / 3.0f;
+}
+
+// Given a range of BVH triangles, compute an axis-aligned bounding box around their centroids.
+// - primitives; a contiguous range of triangles to be stored in the BVH
+// - return;    a single axis-aligned bounding box around the centroids of all triangles, or an inverted box if empty
+static AxisAlignedBox computeSpanCentroidAABBSerial(std::span<const BVHInterface::Primitive> primitives)
+{
+    AxisAlignedBox aabb = { .lower = glm::vec3(std::numeric_limits<float>::max()), .upper = glm::vec3(std::numeric_limits<float>::lowest()) };
+    for (const auto& primitive : primitives) {
+        const glm::vec3 centroid = computePrimitiveCentroid(primitive);
+        aabb.lower = glm::min(aabb.lower, centroid);
+        aabb.upper = glm::max(aabb.upper, centroid);
+    }
+    return aabb;
+}
+
+// As above, but reduces fixed-size chunks concurrently for ranges of at least `ParallelBuildSize` triangles;
+// used by the binned SAH, which bins over the centroids' extent
+AxisAlignedBox computeSpanCentroidAABB(std::span<const BVHInterface::Primitive> primitives)
+{
+    if (primitives.size() >= BVH::ParallelBuildSize) {
+        return reduceSpanAABBParallel(primitives, computeSpanCentroidAABBSerial);
+    }
+    return computeSpanCentroidAABBSerial(primitives);
+}
+
+// Given an axis-aligned bounding box, compute the longest axis; x = 0, y = 1, z = 2.
+// - aabb;   the input axis-aligned bounding box
+// - return; 0 for the x-axis, 1 for the y-axis, 2 for the z-axis
+//           if several axes are equal in length, simply return the first of these
+// This method is unit-tested, so do not change the function signature.
+uint32_t computeAABBLongestAxis(const AxisAlignedBox& aabb)
+{
+    float x = std::abs(aabb.upper.x - aabb.lower.x);
+    float y = std::abs(aabb.upper.y - aabb.lower.y);
+    float z = std::abs(aabb.upper.z - aabb.lower.z);
+
+    return x >= y ? (x >= z ? 0 : 2) : (y >= z ? 1 : 2);
+}
+
+// Given an axis-aligned bounding box, compute its surface area
+// - aabb;   the input axis-aligned bounding box
+// - return; the summed area of the box's six faces
+float computeAABBSurfaceArea(const AxisAlignedBox& aabb)
+{
+    glm::vec3 d = glm::max(aabb.upper - aabb.lower, glm::vec3(0.0f));
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// Given a range of BVH triangles, sort these along a specified axis based on their geometric centroid.
+// Then, find and return the split index in the range, such that the subrange containing the first element
+// of the list is at least as big as the other, and both differ at most by one element in size.
+// - aabb;       the axis-aligned bounding box around the given triangle range
+// - axis;       0, 1, or 2, determining on which axis (x, y, or z) the split must happen
+// - primitives; the modifiable range of triangles that requires sorting/splitting along an axis
+// - return;     the split position of the modified range of triangles
+// This method is unit-tested, so do not change the function signature.
+size_t splitPrimitivesByMedian(const AxisAlignedBox& aabb, uint32_t axis, std::span<BVHInterface::Primitive> primitives)
+{
+    using Primitive = BVHInterface::Primitive;
+
+    std::sort(primitives.begin(), primitives.end(),
+        [&](const Primitive& a, const Primitive& b) {
+            return computePrimitiveCentroid(a)[axis] < computePrimitiveCentroid(b)[axis];
+        });
+
+    size_t n = primitives.size();
+    return (n + 1) / 2;
+}
+
+// Leaf construction routine
+// Given an axis-aligned bounding box, and a range of triangles, generate a valid leaf object.
+// - scene;      the active scene
+// - features;   the user-specified features object
+// - aabb;       the axis-aligned bounding box around the primitives beneath this leaf
+// - primitives; the range of triangles inside `m_primitives` to be stored for this leaf
+BVH::Node BVH::buildLeafData(const Scene& scene, const Features& features, const AxisAlignedBox& aabb, std::span<Primitive> primitives)
+{
+    // The primitives were partitioned in place inside `m_primitives`, so the leaf simply refers to its range
+    Node node;
+    node.aabb = aabb;
+    node.data[0] = Node::LeafBit | static_cast<uint32_t>(primitives.data() - m_primitives.data());
+    node.data[1] = static_cast<uint32_t>(primitives.size());
+    return node;
+}
+
+// Node construction routine
+// Given an axis-aligned bounding box, and left/right child indices, generate a valid node object.
+// - scene;           the active scene
+// - features;        the user-specified features object
+// - aabb;            the axis-aligned bounding box around the primitives beneath this node
+// - leftChildIndex;  the index of the node's left child in `m_nodes`
+// - rightChildIndex; the index of the node's right child in `m_nodes`
+BVH::Node BVH::buildNodeData(const Scene& scene, const Features& features, const AxisAlignedBox& aabb, uint32_t leftChildIndex, uint32_t rightChildIndex)
+{
+    Node node;
+    node.aabb = aabb;
+    node.data[0] = ~Node::LeafBit & leftChildIndex;
+    node.data[1] = rightChildIndex;
+    return node;
+}
+
+// Hierarchy split routine; called by the BVH's constructor
+// Splits the range of triangles by median along the longest axis, or by the binned SAH
+// when `features.extra.enableBvhSahBinning` is set, until a range fits in a leaf, or until the SAH
+// finds no split that is cheaper than a leaf. Ranges of at least `ParallelBuildSize` triangles split
+// their two halves as concurrent tasks.
+// - features;   the user-specified features object
+// - primitives; a range of triangles inside `m_primitives`, partitioned in place
+// - key;        key of the current node inside `ranges`
+// - ranges;     output bounding boxes and split positions of all nodes
+void BVH::splitRecursive(const Features& features, std::span<Primitive> primitives, size_t key, BuildRanges& ranges) const
+{
+    const bool isLarge = primitives.size() >= ParallelBuildSize;
+
+    // Compute the AABB of the current node.
+    AxisAlignedBox aabb = isLarge ? reduceSpanAABBParallel(primitives, computeSpanAABB) : computeSpanAABB(primitives);
+    ranges.boxes[key] = aabb;
+
+    if (primitives.size() <= LeafSize) {
+        return;
+    }
+
+    size_t splitIdx;
+    if (features.extra.enableBvhSahBinning) {
+        splitIdx = splitPrimitivesBySAHBin(features.extra, aabb, primitives);
+        if (splitIdx == 0) {
+            return; // Cheaper as a leaf; its split position is left at 0
+        }
+    } else {
+        splitIdx = splitPrimitivesByMedian(aabb, computeAABBLongestAxis(aabb), primitives);
+    }
+    ranges.splits[key] = static_cast<uint32_t>(splitIdx);
+
+    // The two halves are disjoint, so they can be split independently
+    auto left = primitives.subspan(0, splitIdx);
+    auto right = primitives.subspan(splitIdx);
+    const size_t split = static_cast<size_t>(right.data() - m_primitives.data());
+    if (isLarge) {
+#pragma omp task shared(features, ranges)
+        splitRecursive(features, left, ranges.leftKey(split), ranges);
+        splitRecursive(features, right, BuildRanges::rightKey(split), ranges);
+#pragma omp taskwait
+    } else {
+        splitRecursive(features, left, ranges.leftKey(split), ranges);
+        splitRecursive(features, right, BuildRanges::rightKey(split), ranges);
+    }
+}
+
+// Hierarchy construction routine; called by the BVH's constructor after `splitRecursive()` or `splitLinearRecursive()`
+// Allocates nodes in depth-first order, using the recorded bounding boxes and split positions.
+// - scene;      the active scene
+// - features;   the user-specified features object
+// - primitives; a range of triangles inside `m_primitives`, already partitioned
+// - nodeIndex;  index of the node you are currently working on, this is already allocated
+// - key;        key of the current node inside `ranges`
+// - ranges;     bounding boxes and split positions of all nodes
+void BVH::buildRecursive(const Scene& scene, const Features& features, std::span<Primitive> primitives, uint32_t nodeIndex, size_t key, const BuildRanges& ranges)
+{
+    // WARNING: always use nodeIndex to index into the m_nodes array. never hold a reference/pointer,
+    // because a push/emplace (in ANY recursive calls) might grow vectors, invalidating the pointers.
+    const AxisAlignedBox& aabb = ranges.boxes[key];
+
+    // Small ranges, and ranges the SAH kept whole, have no split position
+    if (primitives.size() <= LeafSize || ranges.splits[key] == 0) {
+        m_nodes[nodeIndex] = buildLeafData(scene, features, aabb, primitives);
+        return;
+    }
+
+    size_t splitIdx = ranges.splits[key];
+    uint32_t leftChildIndex = nextNodeIdx();
+    uint32_t rightChildIndex = nextNodeIdx();
+    m_nodes[nodeIndex] = buildNodeData(scene, features, aabb, leftChildIndex, rightChildIndex);
+
+    const size_t split = static_cast<size_t>(primitives.data() - m_primitives.data()) + splitIdx;
+    buildRecursive(scene, features, primitives.subspan(0, splitIdx), leftChildIndex, ranges.leftKey(split), ranges);
+    buildRecursive(scene, features, primitives.subspan(splitIdx), rightChildIndex, BuildRanges::rightKey(split), ranges);
+}
+
+// Linear hierarchy split routine; called by the BVH's constructor instead of `splitRecursive()`
+// Given a range of triangles sorted along a Morton curve, splits the range where the highest differing
+// bit of their Morton codes flips. As this needs no sorting or bounds per level, node boxes are instead
+// fitted bottom-up from the children's boxes once both halves are split. Ranges of at least
+// `ParallelBuildSize` triangles split their two halves as concurrent tasks.
+// - primitives; a range of triangles inside `m_primitives`, sorted by Morton code
+// - codes;      the sorted Morton codes of the range of triangles
+// - key;        key of the current node inside `ranges`
+// - ranges;     output bounding boxes and split positions of all nodes
+void BVH::splitLinearRecursive(std::span<const Primitive> primitives, std::span<const uint64_t> codes, size_t key, BuildRanges& ranges) const
+{
+    if (primitives.size() <= LeafSize) {
+        ranges.boxes[key] = computeSpanAABB(primitives);
+        return;
+    }
+
+    const size_t splitIdx = splitPrimitivesByMortonCode(codes);
+    ranges.splits[key] = static_cast<uint32_t>(splitIdx);
+
+    // The two halves are disjoint, so they can be split independently
+    const size_t split = static_cast<size_t>(primitives.data() - m_primitives.data()) + splitIdx;
+    const size_t leftKey = ranges.leftKey(split), rightKey = BuildRanges::rightKey(split);
+    if (primitives.size() >= ParallelBuildSize) {
+#pragma omp task shared(ranges)
+        splitLinearRecursive(primitives.subspan(0, splitIdx), codes.subspan(0, splitIdx), leftKey, ranges);
+        splitLinearRecursive(primitives.subspan(splitIdx), codes.subspan(splitIdx), rightKey, ranges);
+#pragma omp taskwait
+    } else {
+        splitLinearRecursive(primitives.subspan(0, splitIdx), codes.subspan(0, splitIdx), leftKey, ranges);
+        splitLinearRecursive(primitives.subspan(splitIdx), codes.subspan(splitIdx), rightKey, ranges);
+    }
+
+    const AxisAlignedBox& left = ranges.boxes[leftKey];
+    const AxisAlignedBox& right = ranges.boxes[rightKey];
+    ranges.boxes[key] = { .lower = glm::min(left.lower, right.lower), .upper = glm::max(left.upper, right.upper) };
+}
+
+// Treelet optimization routine; called by the BVH's constructor after construction
+// Visits the hierarchy bottom-up. At each node, a treelet is formed by repeatedly expanding its largest
+// inner descendant, until it has `treeletSize` leaves (which may be subtrees). The treelet is then rebuilt
+// by agglomerative clustering, greedily merging the pair of leaves with the smallest bounding box,
+// and the result is kept if its inner nodes have a lower total surface area, and thus a lower SAH cost.
+// The treelet's inner nodes are reused, so the node count and the root's parent link stay the same.
+// Disjoint subtrees near the root are processed concurrently; they never share any nodes.
+// - nodeIndex;   index of the treelet's root
+// - treeletSize; maximum nr. of leaves of a treelet
+// - depth;       depth of the current node in the hierarchy
+void BVH::optimizeTreelets(uint32_t nodeIndex, uint32_t treeletSize, uint32_t depth)
+{
+    constexpr uint32_t taskDepth = 8; // Subtrees above this depth are optimized concurrently
+
+    if (m_nodes[nodeIndex].isLeaf()) {
+        return;
+    }
+    if (depth < taskDepth) {
+#pragma omp task
+        optimizeTreelets(m_nodes[nodeIndex].leftChild(), treeletSize, depth + 1);
+        optimizeTreelets(m_nodes[nodeIndex].rightChild(), treeletSize, depth + 1);
+#pragma omp taskwait
+    } else {
+        optimizeTreelets(m_nodes[nodeIndex].leftChild(), treeletSize, depth + 1);
+        optimizeTreelets(m_nodes[nodeIndex].rightChild(), treeletSize, depth + 1);
+    }
+
+    // Form the treelet, expanding the inner leaf with the largest surface area first
+    std::array<uint32_t, MaxTreeletSize> leaves = { m_nodes[nodeIndex].leftChild(), m_nodes[nodeIndex].rightChild() };
+    std::array<uint32_t, MaxTreeletSize> inner;
+    uint32_t numLeaves = 2, numInner = 0;
+    float oldArea = 0.0f;
+    while (numLeaves < treeletSize) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < numLeaves; i++) {
+            float area = computeAABBSurfaceArea(m_nodes[leaves[i]].aabb);
+            if (!m_nodes[leaves[i]].isLeaf() && area > largestArea) {
+                largest = static_cast<int>(i);
+                largestArea = area;
+            }
+        }
+        if (largest < 0) {
+            break;
+        }
+
+        const Node& node = m_nodes[leaves[largest]];
+        inner[numInner++] = leaves[largest];
+        oldArea += largestArea;
+        leaves[largest] = node.leftChild();
+        leaves[numLeaves++] = node.rightChild();
+    }
+    if (numInner == 0) {
+        return;
+    }
+
+    // Rebuild the treelet by agglomerative clustering, recording the merges
+    struct Cluster {
+        uint32_t nodeIndex;
+        AxisAlignedBox aabb;
+    };
+    std::array<Cluster, MaxTreeletSize> clusters;
+    for (uint32_t i = 0; i < numLeaves; i++) {
+        clusters[i] = { leaves[i], m_nodes[leaves[i]].aabb };
+    }
+    std::array<Node, MaxTreeletSize> merged;
+    uint32_t numClusters = numLeaves;
+    float newArea = 0.0f;
+    for (uint32_t m = 0; m < numInner; m++) {
+        uint32_t bestI = 0, bestJ = 1;
+        AxisAlignedBox bestAABB;
+        float bestArea = std::numeric_limits<float>::max();
+        for (uint32_t i = 0; i < numClusters; i++) {
+            for (uint32_t j = i + 1; j < numClusters; j++) {
+                AxisAlignedBox aabb = {
+                    .lower = glm::min(clusters[i].aabb.lower, clusters[j].aabb.lower),
+                    .upper = glm::max(clusters[i].aabb.upper, clusters[j].aabb.upper)
+                };
+                float area = computeAABBSurfaceArea(aabb);
+                if (area < bestArea) {
+                    bestI = i;
+                    bestJ = j;
+                    bestAABB = aabb;
+                    bestArea = area;
+                }
+            }
+        }
+
+        merged[m] = Node { .aabb = bestAABB, .data = { clusters[bestI].nodeIndex, clusters[bestJ].nodeIndex } };
+        newArea += bestArea;
+        clusters[bestI] = { inner[m], bestAABB };
+        clusters[bestJ] = clusters[--numClusters];
+    }
+
+    // Keep the new treelet only if it is cheaper; the last two clusters become the root's children
+    if (newArea < oldArea) {
+        for (uint32_t m = 0; m < numInner; m++) {
+            m_nodes[inner[m]] = merged[m];
+        }
+        m_nodes[nodeIndex].data = { clusters[0].nodeIndex, clusters[1].nodeIndex };
+    }
+}
+
+// Scale applied to a box's exit distance, s.t. rounding errors in the slab test never cull a box that the
+// ray grazes; otherwise, rays through a shared edge or vertex may slip past both triangles (Ize, 2013)
+static constexpr float BoxExitScale = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+// Return the reciprocal of the ray's direction for the slab tests. Zero components map to the largest finite
+// value instead of infinity, s.t. a ray lying exactly in a box's face yields 0 rather than 0 * inf = NaN,
+// which the scalar and SIMD min/max operations would otherwise resolve differently.
+static glm::vec3 computeInverseDirection(const glm::vec3& direction)
+{
+    glm::vec3 invDirection = 1.0f / direction;
+    for (int axis = 0; axis < 3; axis++) {
+        if (direction[axis] == 0.0f)
+            invDirection[axis] = std::copysign(std::numeric_limits<float>::max(), direction[axis]);
+    }
+    return invDirection;
+}
+
+// Helper method for intersecting a ray with a BVH's AABB; unlike `intersectRayWithShape`, this
+// does not modify the ray, and misses boxes that lie beyond the current closest hit
+// - aabb;         the box to test
+// - ray;          the ray, with `t` set to the current closest hit
+// - invDirection; the reciprocal of the ray's direction
+// - return;       the entry distance of the ray into the box, clamped to zero, or infinity on a miss
+static float intersectRayWithAABB(const AxisAlignedBox& aabb, const Ray& ray, const glm::vec3& invDirection)
+{
+    glm::vec3 t0 = (aabb.lower - ray.origin) * invDirection;
+    glm::vec3 t1 = (aabb.upper - ray.origin) * invDirection;
+
+    glm::vec3 tin = glm::min(t0, t1);
+    glm::vec3 tout = glm::max(t0, t1);
+
+    float tmin = std::max(0.0f, std::max(tin.x, std::max(tin.y, tin.z)));
+    float tmax = std::min(ray.t, BoxExitScale * std::min(tout.x, std::min(tout.y, tout.z)));
+
+    return tmin <= tmax ? tmin : std::numeric_limits<float>::infinity();
+}
+
+// Fixed-capacity stack used during traversal, which lives on the call stack s.t. tracing a ray performs
+// no heap allocations. Mirrors the parts of the `std::vector` interface used by the traversal routines;
+// callers must size it from a depth they can trust, see `withTraversalStack()`.
+template <typename T, size_t Capacity>
+class TraversalStack {
+public:
+    void push_back(const T& value)
+    {
+        assert(m_size < Capacity);
+        m_data[m_size++] = value;
+    }
+    void pop_back() { m_size--; }
+    T& back() { return m_data[m_size - 1]; }
+    bool empty() const { return m_size == 0; }
+
+private:
+    std::array<T, Capacity> m_data;
+    size_t m_size = 0;
+};
+
+// Helper method for the traversal routines; calls `traverse(stack)` with a fixed-capacity stack if
+// `requiredSize` entries fit, and otherwise with a per-thread vector which only allocates while it grows.
+// - requiredSize; upper bound on the nr. of entries on the stack, derived from the hierarchy's depth
+// - traverse;     callable which performs the traversal, given an empty stack
+template <typename T, typename F>
+static void withTraversalStack(size_t requiredSize, F&& traverse)
+{
+    if (requiredSize <= BVH::TraversalStackSize) {
+        TraversalStack<T, BVH::TraversalStackSize> stack;
+        traverse(stack);
+    } else {
+        thread_local std::vector<T> stack;
+        stack.clear();
+        traverse(stack);
+    }
+}
+
+// Helper method shared by the binary hierarchy traversal routines; walks the nodes and calls
+// `intersectLeaf(offset, count)` for every leaf whose box the ray enters before its closest hit.
+// With `features.extra.enableBvhOrderedTraversal`, both children's entry distances are computed,
+// the nearer child is visited first, and nodes beyond the closest hit found so far are culled.
+// Otherwise, children are pushed in fixed order and only tested once popped.
+// Every visited node is counted in `bvhTraversalStats()`.
+// The stack holds at most one pending sibling per level, so it never exceeds `numLevels` entries.
+// - state;          the active scene, and a user-specified feature config object, encapsulated
+// - nodes;          the nodes of the binary hierarchy
+// - numLevels;      the nr. of levels of the binary hierarchy
+// - ray;            the ray intersecting the scene's geometry
+// - intersectLeaf;  callable which intersects the ray with a leaf's primitives, and updates `ray.t`
+template <typename F>
+static void traverseBVH(RenderState& state, std::span<const BVHInterface::Node> nodes, uint32_t numLevels, Ray& ray, F&& intersectLeaf)
+{
+    struct StackEntry {
+        uint32_t nodeIndex;
+        float tEntry; // Entry distance of the ray into the node's box
+    };
+
+    const glm::vec3 invDirection = computeInverseDirection(ray.direction);
+    const bool isOrdered = state.features.extra.enableBvhOrderedTraversal;
+    const auto isCulled = [&](float tEntry) { return tEntry == std::numeric_limits<float>::infinity() || tEntry > ray.t; };
+    uint64_t numNodeVisits = 0;
+
+    withTraversalStack<StackEntry>(numLevels + 1, [&](auto& stack) {
+        stack.push_back({ BVH::RootIndex, isOrdered ? intersectRayWithAABB(nodes[BVH::RootIndex].aabb, ray, invDirection) : 0.0f });
+        while (!stack.empty()) {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+
+            // Cull nodes which were pushed before a closer hit was found, or which are missed entirely
+            const BVHInterface::Node& node = nodes[entry.nodeIndex];
+            if (isCulled(isOrdered ? entry.tEntry : intersectRayWithAABB(node.aabb, ray, invDirection)))
+                continue;
+            numNodeVisits++;
+
+            if (node.isLeaf()) {
+                intersectLeaf(node.primitiveOffset(), node.primitiveCount());
+            } else if (isOrdered) {
+                // Push the farther child first, s.t. the nearer child is popped first
+                float tLeft = intersectRayWithAABB(nodes[node.leftChild()].aabb, ray, invDirection);
+                float tRight = intersectRayWithAABB(nodes[node.rightChild()].aabb, ray, invDirection);
+                StackEntry near = { node.leftChild(), tLeft }, far = { node.rightChild(), tRight };
+                if (tRight < tLeft)
+                    std::swap(near, far);
+                if (!isCulled(far.tEntry))
+                    stack.push_back(far);
+                if (!isCulled(near.tEntry))
+                    stack.push_back(near);
+            } else {
+                stack.push_back({ node.leftChild(), 0.0f });
+                stack.push_back({ node.rightChild(), 0.0f });
+            }
+        }
+    });
+
+    bvhTraversalStats().numNodeVisits += numNodeVisits;
+}
+
+// Any-hit counterpart of `traverseBVH()`, for shadow rays; walks the nodes in fixed order, and returns
+// as soon as `occludedLeaf(offset, count)` reports a hit. Children are only pushed if the ray enters
+// their box before `ray.t`, which is never updated. Every visited node is counted in `bvhTraversalStats()`.
+// - nodes;         the nodes of the binary hierarchy
+// - numLevels;     the nr. of levels of the binary hierarchy
+// - ray;           the ray, with `t` set to the maximum distance of a blocking hit
+// - occludedLeaf;  callable which tests the ray against a leaf's primitives, and returns if any is hit
+// - return;        boolean, if any leaf reported a hit
+template <typename F>
+static bool traverseBVHAnyHit(std::span<const BVHInterface::Node> nodes, uint32_t numLevels, const Ray& ray, F&& occludedLeaf)
+{
+    const glm::vec3 invDirection = computeInverseDirection(ray.direction);
+    const auto isHit = [&](uint32_t nodeIndex) { return intersectRayWithAABB(nodes[nodeIndex].aabb, ray, invDirection) != std::numeric_limits<float>::infinity(); };
+    uint64_t numNodeVisits = 0;
+    bool is_hit = false;
+
+    withTraversalStack<uint32_t>(numLevels + 1, [&](auto& stack) {
+        if (isHit(BVH::RootIndex))
+            stack.push_back(BVH::RootIndex);
+        while (!stack.empty()) {
+            const BVHInterface::Node& node = nodes[stack.back()];
+            stack.pop_back();
+            numNodeVisits++;
+
+            if (node.isLeaf()) {
+                if (occludedLeaf(node.primitiveOffset(), node.primitiveCount())) {
+                    is_hit = true;
+                    return;
+                }
+            } else {
+                if (isHit(node.rightChild()))
+                    stack.push_back(node.rightChild());
+                if (isHit(node.leftChild()))
+                    stack.push_back(node.leftChild());
+            }
+        }
+    });
+
+    bvhTraversalStats().numNodeVisits += numNodeVisits;
+    return is_hit;
+}
+
+// Return the traversal statistics gathered by the calling thread, for performance measurements;
+// reset these by assigning an empty object
+BVHTraversalStats& bvhTraversalStats()
+{
+    thread_local BVHTraversalStats stats;
+    return stats;
+}
+
+// Hierarchy traversal routine; called by the BVH's intersect()
+//
+// This method returns `true` if geometry was hit, and `false` otherwise. On first/closest hit, the
+// distance `t` in the `ray` object is updated, and information is updated in the `hitInfo` object.
+//
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - bvh;      the actual bvh which should be traversed for faster intersection
+// - ray;      the ray intersecting the scene's geometry
+// - hitInfo;  the return object, with info regarding the hit geometry
+// - return;   boolean, if geometry was hit or not
+//
+// This method is unit-tested, so do not change the function signature.
+bool intersectRayWithBVH(RenderState& state, const BVHInterface& bvh, Ray& ray, HitInfo& hitInfo)
+{
+    // Relevant data in the constructed BVH
+    std::span<const BVHInterface::Node> nodes = bvh.nodes();
+    std::span<const BVHInterface::Primitive> primitives = bvh.primitives();
+
+    // Return value
+    bool is_hit = false;
+
+    if (state.features.enableAccelStructure) {
+        // Only our own BVH computes its depth; other implementations, e.g. the tests' fake BVHs, may report any
+        // nr. of levels, so the traversal stack is sized for the worst case of one entry per node instead
+        const uint32_t numLevels = typeid(bvh) == typeid(BVH) ? bvh.numLevels() : static_cast<uint32_t>(nodes.size());
+        traverseBVH(state, nodes, numLevels, ray, [&](uint32_t offset, uint32_t count) {
+            for (uint32_t i = offset; i < offset + count; i++) {
+                const auto& prim = primitives[i];
+                if (intersectRayWithTriangle(prim.v0.position, prim.v1.position, prim.v2.position, ray, hitInfo)) {
+                    updateHitInfo(state, prim, ray, hitInfo);
+                    is_hit = true;
+                }
+            }
+        });
+    } else {
+        // Naive implementation; simply iterates over all primitives
+        for (const auto& prim : primitives) {
+            const auto& [v0, v1, v2] = std::tie(prim.v0, prim.v1, prim.v2);
+            if (intersectRayWithTriangle(v0.position, v1.position, v2.position, ray, hitInfo)) {
+                updateHitInfo(state, prim, ray, hitInfo);
+                is_hit = true;
+            }
+        }
+    }
+
+    // Intersect with spheres.
+    for (const auto& sphere : state.scene.spheres)
+        is_hit |= intersectRayWithShape(sphere, ray, hitInfo);
+
+    return is_hit;
+}
 
 // This method returns `true` if geometry was hit, and `false` otherwise. On first/closest hit, the
 // distance `t` in the `ray` object is updated, and information is updated in the `hitInfo` object.
@@ -9,5 +802,901 @@
 // - return;   boolean, if geometry was hit or not
 bool BVH::intersect(RenderState& state, Ray& ray, HitInfo& hitInfo) const
 {
+    if (state.features.enableAccelStructure && !m_wideNodes8.empty()) {
+        return intersectWide(m_wideNodes8, state, ray, hitInfo);
+    }
+    if (state.features.enableAccelStructure && !m_wideNodes4.empty()) {
+        return intersectWide(m_wideNodes4, state, ray, hitInfo);
+    }
+    if (!m_compactPrimitives.meshIDs.empty()) {
+        return intersectCompact(state, ray, hitInfo);
+    }
     return intersectRayWithBVH(state, *this, ray, hitInfo);
 }
+
+// Any-hit query for shadow rays, given any BVHInterface; see `BVH::occluded()`. `BVHInterface` is frozen
+// for the tests, so the any-hit query is not one of its virtual methods; other implementations, e.g. the
+// tests' fake BVHs, are instead given a closest-hit query.
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - bvh;      the bvh which should be traversed
+// - ray;      the ray, starting at the shaded point and pointing towards the light
+// - tMax;     the distance along the ray beyond which hits are ignored, e.g. the distance to the light
+// - return;   boolean, if geometry was hit or not
+bool isRayOccludedInBVH(RenderState& state, const BVHInterface& bvh, const Ray& ray, float tMax)
+{
+    // An exact type check, rather than a dynamic_cast, as this runs for every shadow ray
+    if (typeid(bvh) == typeid(BVH)) {
+        return static_cast<const BVH&>(bvh).occluded(state, ray, tMax);
+    }
+    Ray shadowRay = ray;
+    shadowRay.t = tMax;
+    HitInfo hitInfo;
+    return bvh.intersect(state, shadowRay, hitInfo);
+}
+
+// Any-hit query for shadow rays; returns `true` if any geometry is hit before distance `tMax`.
+// Unlike intersect(), traversal stops at the first hit found rather than the closest one, and no
+// hit information is gathered; this is all a visibility test needs.
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - ray;      the ray, starting at the shaded point and pointing towards the light
+// - tMax;     the distance along the ray beyond which hits are ignored, e.g. the distance to the light
+// - return;   boolean, if geometry was hit or not
+bool BVH::occluded(RenderState& state, const Ray& ray, float tMax) const
+{
+    Ray shadowRay = ray;
+    shadowRay.t = tMax;
+    HitInfo hitInfo; // Scratch object for the primitive tests; its contents are never used
+
+    // Spheres are cheap to test, and a hit skips the traversal entirely
+    for (const auto& sphere : state.scene.spheres) {
+        if (intersectRayWithShape(sphere, shadowRay, hitInfo))
+            return true;
+    }
+
+    if (!state.features.enableAccelStructure) {
+        // Naive implementation; simply iterates over all triangles
+        const size_t numTriangles = m_compactPrimitives.meshIDs.empty() ? m_primitives.size() : m_compactPrimitives.meshIDs.size();
+        return occludedLeaf(0, static_cast<uint32_t>(numTriangles), shadowRay, hitInfo);
+    }
+    if (!m_wideNodes8.empty()) {
+        return occludedWide(m_wideNodes8, shadowRay, hitInfo);
+    }
+    if (!m_wideNodes4.empty()) {
+        return occludedWide(m_wideNodes4, shadowRay, hitInfo);
+    }
+    return traverseBVHAnyHit(m_nodes, m_numLevels, shadowRay, [&](uint32_t offset, uint32_t count) {
+        return occludedLeaf(offset, count, shadowRay, hitInfo);
+    });
+}
+
+// Möller-Trumbore ray/triangle test, given the triangle's first vertex and its two precomputed edges.
+// Solves for the barycentric coordinates and distance directly, using only cross and dot products;
+// unlike `intersectRayWithTriangle()`, no plane is built, and nothing is normalized.
+// - v0;       the triangle's first vertex
+// - edge1;    the edge v1 - v0
+// - edge2;    the edge v2 - v0
+// - ray;      the ray; on a hit closer than its current distance `t`, this is updated
+// - return;   boolean, if the triangle was hit
+static bool intersectRayWithTriangleEdges(const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2, Ray& ray)
+{
+    const glm::vec3 p = glm::cross(ray.direction, edge2);
+    const float det = glm::dot(edge1, p);
+    if (det == 0.0f) // Ray is parallel to the triangle, or the triangle is degenerate
+        return false;
+
+    const float invDet = 1.0f / det;
+    const glm::vec3 s = ray.origin - v0;
+    const float u = glm::dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    const glm::vec3 q = glm::cross(s, edge1);
+    const float v = glm::dot(ray.direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    const float t = glm::dot(edge2, q) * invDet;
+    if (t <= 0.0f || t >= ray.t)
+        return false;
+    ray.t = t;
+    return true;
+}
+
+// Per-ray data for `intersectRayWithTriangleWatertight()`; maps the ray onto the +z axis by permuting
+// the axes, s.t. z is the ray's dominant axis, and then shearing x and y
+struct WatertightRay {
+    int kx, ky, kz; // Permuted axes
+    float sx, sy, sz; // Shear and scale constants
+
+    explicit WatertightRay(const Ray& ray)
+    {
+        const glm::vec3 d = glm::abs(ray.direction);
+        kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (ray.direction[kz] < 0.0f) // Preserve the triangles' winding
+            std::swap(kx, ky);
+
+        sx = ray.direction[kx] / ray.direction[kz];
+        sy = ray.direction[ky] / ray.direction[kz];
+        sz = 1.0f / ray.direction[kz];
+    }
+};
+
+// Watertight ray/triangle test by Woop et al. (2013). The vertices are transformed into the ray's space,
+// where the test reduces to the signs of three 2D edge functions. Adjacent triangles evaluate their shared
+// edge identically, so rays never slip through, and edge hits fall back to double precision.
+// - v0, v1, v2; the triangle's vertices
+// - ray;        the ray; on a hit closer than its current distance `t`, this is updated
+// - wray;       the ray's precomputed axes and shear constants
+// - return;     boolean, if the triangle was hit
+static bool intersectRayWithTriangleWatertight(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, Ray& ray, const WatertightRay& wray)
+{
+    const glm::vec3 a = v0 - ray.origin, b = v1 - ray.origin, c = v2 - ray.origin;
+    const float ax = a[wray.kx] - wray.sx * a[wray.kz], ay = a[wray.ky] - wray.sy * a[wray.kz];
+    const float bx = b[wray.kx] - wray.sx * b[wray.kz], by = b[wray.ky] - wray.sy * b[wray.kz];
+    const float cx = c[wray.kx] - wray.sx * c[wray.kz], cy = c[wray.ky] - wray.sy * c[wray.kz];
+
+    // Scaled barycentric coordinates
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = static_cast<float>(double(cx) * double(by) - double(cy) * double(bx));
+        v = static_cast<float>(double(ax) * double(cy) - double(ay) * double(cx));
+        w = static_cast<float>(double(bx) * double(ay) - double(by) * double(ax));
+    }
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return false;
+
+    const float det = u + v + w;
+    if (det == 0.0f)
+        return false;
+
+    const float tScaled = u * wray.sz * a[wray.kz] + v * wray.sz * b[wray.kz] + w * wray.sz * c[wray.kz];
+    const float t = tScaled / det;
+    if (t <= 0.0f || t >= ray.t)
+        return false;
+    ray.t = t;
+    return true;
+}
+
+// Helper for `intersectLeaf()` and `occludedLeaf()`; tests the ray against a range of triangles in the
+// compact store with the triangle test selected at build time, and calls `onHit(i)` for every hit triangle.
+// - offset;   index of the first triangle in the range
+// - count;    nr. of triangles in the range
+// - ray;      the ray intersecting the scene's geometry
+// - hitInfo;  scratch object, which may be written to by the reference triangle test
+// - onHit;    callable receiving the index of a hit triangle; returning `true` stops the test early
+// - return;   boolean, if the test was stopped early
+template <typename F>
+bool BVH::intersectCompactLeaf(uint32_t offset, uint32_t count, Ray& ray, HitInfo& hitInfo, F&& onHit) const
+{
+    const auto& compact = m_compactPrimitives;
+    switch (m_triangleTest) {
+    case TriangleTest::PrecomputedEdges: {
+        for (uint32_t i = offset; i < offset + count; i++) {
+            if (intersectRayWithTriangleEdges(compact.v0[i], compact.edge1[i], compact.edge2[i], ray) && onHit(i))
+                return true;
+        }
+        break;
+    }
+    case TriangleTest::Watertight: {
+        const WatertightRay wray(ray);
+        for (uint32_t i = offset; i < offset + count; i++) {
+            if (intersectRayWithTriangleWatertight(compact.v0[i], compact.v1[i], compact.v2[i], ray, wray) && onHit(i))
+                return true;
+        }
+        break;
+    }
+    default: {
+        for (uint32_t i = offset; i < offset + count; i++) {
+            if (intersectRayWithTriangle(compact.v0[i], compact.v1[i], compact.v2[i], ray, hitInfo) && onHit(i))
+                return true;
+        }
+        break;
+    }
+    }
+    return false;
+}
+
+// Ray data of a packet in structure-of-arrays layout, s.t. a box is tested against four rays at once
+struct RayPacket {
+    alignas(16) std::array<float, BVH::MaxPacketSize> originX, originY, originZ;
+    alignas(16) std::array<float, BVH::MaxPacketSize> invDirX, invDirY, invDirZ;
+    alignas(16) std::array<float, BVH::MaxPacketSize> t; // Distance to each ray's closest hit so far
+};
+
+// Given a ray packet, intersect its active rays with a box at once.
+// - aabb;     the box to test
+// - packet;   the packet's ray data
+// - mask;     bitmask of the active rays in the packet
+// - return;   bitmask of the active rays which enter the box before their closest hit
+static uint32_t intersectRayPacketWithAABB(const AxisAlignedBox& aabb, const RayPacket& packet, uint32_t mask)
+{
+    uint32_t hitMask = 0;
+    for (uint32_t offset = 0; offset < BVH::MaxPacketSize; offset += 4) {
+        // Skip groups of four rays that are all inactive
+        if (((mask >> offset) & 0xFu) == 0)
+            continue;
+
+#if defined(__SSE2__) || defined(_M_X64)
+        const auto slab = [&](const std::array<float, BVH::MaxPacketSize>& origin, const std::array<float, BVH::MaxPacketSize>& invDir, float lower, float upper, __m128& tmin, __m128& tmax) {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lower), _mm_load_ps(&origin[offset])), _mm_load_ps(&invDir[offset]));
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(upper), _mm_load_ps(&origin[offset])), _mm_load_ps(&invDir[offset]));
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+            tmax = _mm_min_ps(tmax, _mm_mul_ps(_mm_max_ps(t0, t1), _mm_set1_ps(BoxExitScale)));
+        };
+
+        __m128 tmin = _mm_setzero_ps();
+        __m128 tmax = _mm_load_ps(&packet.t[offset]);
+        slab(packet.originX, packet.invDirX, aabb.lower.x, aabb.upper.x, tmin, tmax);
+        slab(packet.originY, packet.invDirY, aabb.lower.y, aabb.upper.y, tmin, tmax);
+        slab(packet.originZ, packet.invDirZ, aabb.lower.z, aabb.upper.z, tmin, tmax);
+        hitMask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tmin, tmax))) << offset;
+#else
+        // Scalar fallback for other architectures
+        for (uint32_t i = offset; i < offset + 4; i++) {
+            Ray ray = { .origin = { packet.originX[i], packet.originY[i], packet.originZ[i] }, .t = packet.t[i] };
+            glm::vec3 invDirection = { packet.invDirX[i], packet.invDirY[i], packet.invDirZ[i] };
+            hitMask |= static_cast<uint32_t>(intersectRayWithAABB(aabb, ray, invDirection) != std::numeric_limits<float>::infinity()) << i;
+        }
+#endif
+    }
+    return hitMask & mask;
+}
+
+// Helper for packet intersection; intersects each ray of the packet on its own, and returns the packet's hit mask
+static uint32_t intersectRaysSeparately(RenderState& state, const BVHInterface& bvh, std::span<Ray> rays, std::span<HitInfo> hitInfos)
+{
+    uint32_t hitMask = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        hitMask |= static_cast<uint32_t>(bvh.intersect(state, rays[i], hitInfos[i])) << i;
+    }
+    return hitMask;
+}
+
+// Packet intersection of coherent rays, given any BVHInterface; see `BVH::intersectPacket()`. As for
+// `isRayOccludedInBVH()`, other implementations of the frozen interface intersect each ray separately.
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - bvh;      the bvh which should be traversed
+// - rays;     the rays of the packet, at most `BVH::MaxPacketSize`
+// - hitInfos; the return objects, with info regarding each ray's hit geometry
+// - return;   bitmask of the rays that hit geometry
+uint32_t intersectRayPacketWithBVH(RenderState& state, const BVHInterface& bvh, std::span<Ray> rays, std::span<HitInfo> hitInfos)
+{
+    if (typeid(bvh) == typeid(BVH)) {
+        return static_cast<const BVH&>(bvh).intersectPacket(state, rays, hitInfos);
+    }
+    return intersectRaysSeparately(state, bvh, rays, hitInfos);
+}
+
+// Packet traversal routine for coherent rays, e.g. camera rays; traverses the binary hierarchy once for all
+// rays, instead of once per ray. Each stack entry carries a bitmask of the rays still active in its subtree,
+// and at each node, the box is tested against all active rays at once. Rays that miss the box, or whose
+// closest hit lies before it, are dropped from the subtree. Children are visited in the order of the first
+// active ray. As in `intersect()`, the hitInfo objects are only filled in once traversal is done.
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - rays;     the rays of the packet, at most `MaxPacketSize`
+// - hitInfos; the return objects, with info regarding each ray's hit geometry
+// - return;   bitmask of the rays that hit geometry
+uint32_t BVH::intersectPacket(RenderState& state, std::span<Ray> rays, std::span<HitInfo> hitInfos) const
+{
+    // Without a hierarchy, there are no shared node tests; fall back to single rays
+    if (!state.features.enableAccelStructure || rays.size() > MaxPacketSize) {
+        return intersectRaysSeparately(state, *this, rays, hitInfos);
+    }
+
+    const auto numRays = static_cast<uint32_t>(rays.size());
+    RayPacket packet = {};
+    for (uint32_t i = 0; i < numRays; i++) {
+        const glm::vec3 invDirection = computeInverseDirection(rays[i].direction);
+        packet.originX[i] = rays[i].origin.x;
+        packet.originY[i] = rays[i].origin.y;
+        packet.originZ[i] = rays[i].origin.z;
+        packet.invDirX[i] = invDirection.x;
+        packet.invDirY[i] = invDirection.y;
+        packet.invDirZ[i] = invDirection.z;
+        packet.t[i] = rays[i].t;
+    }
+
+    struct StackEntry {
+        uint32_t nodeIndex;
+        uint32_t mask; // Bitmask of the rays which entered the parent node
+    };
+
+    std::array<uint32_t, MaxPacketSize> closest;
+    closest.fill(InvalidIndex);
+    const uint32_t allRays = numRays == MaxPacketSize ? ~0u : (1u << numRays) - 1u;
+    uint64_t numNodeVisits = 0;
+
+    withTraversalStack<StackEntry>(m_numLevels + 1, [&](auto& stack) {
+        stack.push_back({ RootIndex, allRays });
+        while (!stack.empty()) {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+
+            const Node& node = m_nodes[entry.nodeIndex];
+            uint32_t mask = intersectRayPacketWithAABB(node.aabb, packet, entry.mask);
+            if (mask == 0)
+                continue;
+            numNodeVisits++;
+
+            if (node.isLeaf()) {
+                for (; mask; mask &= mask - 1) {
+                    uint32_t i = static_cast<uint32_t>(std::countr_zero(mask));
+                    intersectLeaf(node.primitiveOffset(), node.primitiveCount(), rays[i], hitInfos[i], closest[i]);
+                    packet.t[i] = rays[i].t;
+                }
+            } else {
+                // Push the farther child first, s.t. the nearer child is popped first
+                const Ray& ray = rays[std::countr_zero(mask)];
+                const AxisAlignedBox &left = m_nodes[node.leftChild()].aabb, &right = m_nodes[node.rightChild()].aabb;
+                bool isLeftNear = glm::dot(right.lower + right.upper - left.lower - left.upper, ray.direction) > 0.0f;
+                stack.push_back({ isLeftNear ? node.rightChild() : node.leftChild(), mask });
+                stack.push_back({ isLeftNear ? node.leftChild() : node.rightChild(), mask });
+            }
+        }
+    });
+    bvhTraversalStats().numNodeVisits += numNodeVisits;
+
+    uint32_t hitMask = 0;
+    for (uint32_t i = 0; i < numRays; i++) {
+        if (closest[i] != InvalidIndex) {
+            updateClosestHitInfo(state, closest[i], rays[i], hitInfos[i]);
+            hitMask |= 1u << i;
+        }
+
+        // Intersect with spheres.
+        for (const auto& sphere : state.scene.spheres) {
+            if (intersectRayWithShape(sphere, rays[i], hitInfos[i]))
+                hitMask |= 1u << i;
+        }
+    }
+    return hitMask;
+}
+
+// Helper method for the BVH's own traversal routines; intersects the ray with a range of triangles
+// in either primitive layout, and records the index of the closest hit triangle.
+// - offset;   index of the first triangle in the range
+// - count;    nr. of triangles in the range
+// - ray;      the ray intersecting the scene's geometry
+// - hitInfo;  the return object, which may be written to by the triangle test
+// - closest;  index of the closest hit triangle so far, updated on a closer hit
+void BVH::intersectLeaf(uint32_t offset, uint32_t count, Ray& ray, HitInfo& hitInfo, uint32_t& closest) const
+{
+    if (m_compactPrimitives.meshIDs.empty()) {
+        for (uint32_t i = offset; i < offset + count; i++) {
+            const auto& prim = m_primitives[i];
+            if (intersectRayWithTriangle(prim.v0.position, prim.v1.position, prim.v2.position, ray, hitInfo))
+                closest = i;
+        }
+    } else {
+        intersectCompactLeaf(offset, count, ray, hitInfo, [&](uint32_t i) {
+            closest = i;
+            return false;
+        });
+    }
+}
+
+// Any-hit counterpart of `intersectLeaf()`; returns as soon as any triangle in the range is hit
+// - offset;   index of the first triangle in the range
+// - count;    nr. of triangles in the range
+// - ray;      the ray, with `t` set to the maximum distance of a blocking hit
+// - hitInfo;  scratch object, which may be written to by the triangle test
+// - return;   boolean, if any triangle was hit
+bool BVH::occludedLeaf(uint32_t offset, uint32_t count, Ray& ray, HitInfo& hitInfo) const
+{
+    if (m_compactPrimitives.meshIDs.empty()) {
+        for (uint32_t i = offset; i < offset + count; i++) {
+            const auto& prim = m_primitives[i];
+            if (intersectRayWithTriangle(prim.v0.position, prim.v1.position, prim.v2.position, ray, hitInfo))
+                return true;
+        }
+    } else {
+        return intersectCompactLeaf(offset, count, ray, hitInfo, [](uint32_t) { return true; });
+    }
+    return false;
+}
+
+// Helper method for the BVH's own traversal routines; fills in the hitInfo object for the closest
+// hit triangle. For the compact store, the triangle's full vertices are fetched from the scene.
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - closest;  index of the closest hit triangle
+// - ray;      the ray, with its distance `t` set to the closest hit
+// - hitInfo;  the return object, with info regarding the hit geometry
+void BVH::updateClosestHitInfo(RenderState& state, uint32_t closest, const Ray& ray, HitInfo& hitInfo) const
+{
+    if (m_compactPrimitives.meshIDs.empty()) {
+        updateHitInfo(state, m_primitives[closest], ray, hitInfo);
+        return;
+    }
+
+    const auto& mesh = state.scene.meshes[m_compactPrimitives.meshIDs[closest]];
+    const auto& triangle = mesh.triangles[m_compactPrimitives.triangleIDs[closest]];
+    Primitive primitive = {
+        .meshID = m_compactPrimitives.meshIDs[closest],
+        .v0 = mesh.vertices[triangle.x],
+        .v1 = mesh.vertices[triangle.y],
+        .v2 = mesh.vertices[triangle.z]
+    };
+    updateHitInfo(state, primitive, ray, hitInfo);
+}
+
+// Hierarchy traversal routine over the compact store; called by the BVH's intersect()
+// Mirrors `intersectRayWithBVH()`, but leaves only read triangle positions, and the closest
+// hit's normal and texture coordinates are fetched from the scene once traversal is done.
+// - state;    the active scene, and a user-specified feature config object, encapsulated
+// - ray;      the ray intersecting the scene's geometry
+// - hitInfo;  the return object, with info regarding the hit geometry
+// - return;   boolean, if geometry was hit or not
+bool BVH::intersectCompact(RenderState& state, Ray& ray, HitInfo& hitInfo) const
+{
+    // Index of the closest hit triangle, if any
+    uint32_t closest = InvalidIndex;
+
+    if (state.features.enableAccelStructure) {
+        traverseBVH(state, m_nodes, m_numLevels, ray, [&](uint32_t offset, uint32_t count) {
+            intersectLeaf(offset, count, ray, hitInfo, closest);
+        });
+    } else {
+        // Naive implementation; simply iterates over all triangles
+        intersectLeaf(0, static_cast<uint32_t>(m_compactPrimitives.meshIDs.size()), ray, hitInfo, closest);
+    }
+
+    bool is_hit = closest != InvalidIndex;
+    if (is_hit)
+        updateClosestHitInfo(state, closest, ray, hitInfo);
+
+    // Intersect with spheres.
+    for (const auto& sphere : state.scene.spheres)
+        is_hit |= intersectRayWithShape(sphere, ray, hitInfo);
+
+    return is_hit;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// Helper for `intersectRayWithWideNode()`; tests four children starting at `offset` with SSE
+template <uint32_t N>
+static uint32_t intersectRayWithWideNode4(const BVH::WideNode<N>& node, uint32_t offset, const Ray& ray, const glm::vec3& invDirection, float* tEntry)
+{
+    const auto slab = [&](const std::array<float, N>& lower, const std::array<float, N>& upper, float origin, float invDir, __m128& tmin, __m128& tmax) {
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&lower[offset]), _mm_set1_ps(origin)), _mm_set1_ps(invDir));
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&upper[offset]), _mm_set1_ps(origin)), _mm_set1_ps(invDir));
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+        tmax = _mm_min_ps(tmax, _mm_mul_ps(_mm_max_ps(t0, t1), _mm_set1_ps(BoxExitScale)));
+    };
+
+    __m128 tmin = _mm_setzero_ps();
+    __m128 tmax = _mm_set1_ps(ray.t);
+    slab(node.lowerX, node.upperX, ray.origin.x, invDirection.x, tmin, tmax);
+    slab(node.lowerY, node.upperY, ray.origin.y, invDirection.y, tmin, tmax);
+    slab(node.lowerZ, node.upperZ, ray.origin.z, invDirection.z, tmin, tmax);
+    _mm_storeu_ps(tEntry, tmin);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tmin, tmax)));
+}
+#endif
+
+// Given a wide node, intersect the ray with the boxes of all its children at once.
+// - node;          the wide node whose children are tested
+// - ray;           the ray; children beyond its current distance `t` are missed
+// - invDirection;  the reciprocal of the ray's direction
+// - tEntry;        output entry distance of the ray into each child's box, clamped to zero
+// - return;        a bitmask of the children that are hit
+template <uint32_t N>
+static uint32_t intersectRayWithWideNode(const BVH::WideNode<N>& node, const Ray& ray, const glm::vec3& invDirection, float* tEntry)
+{
+    uint32_t mask = 0;
+#if defined(__AVX__)
+    if constexpr (N == 8) {
+        // AVX variant; tests all eight children at once
+        const auto slab = [&](const std::array<float, N>& lower, const std::array<float, N>& upper, float origin, float invDir, __m256& tmin, __m256& tmax) {
+            __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(lower.data()), _mm256_set1_ps(origin)), _mm256_set1_ps(invDir));
+            __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(upper.data()), _mm256_set1_ps(origin)), _mm256_set1_ps(invDir));
+            tmin = _mm256_max_ps(tmin, _mm256_min_ps(t0, t1));
+            tmax = _mm256_min_ps(tmax, _mm256_mul_ps(_mm256_max_ps(t0, t1), _mm256_set1_ps(BoxExitScale)));
+        };
+
+        __m256 tmin = _mm256_setzero_ps();
+        __m256 tmax = _mm256_set1_ps(ray.t);
+        slab(node.lowerX, node.upperX, ray.origin.x, invDirection.x, tmin, tmax);
+        slab(node.lowerY, node.upperY, ray.origin.y, invDirection.y, tmin, tmax);
+        slab(node.lowerZ, node.upperZ, ray.origin.z, invDirection.z, tmin, tmax);
+        _mm256_storeu_ps(tEntry, tmin);
+        mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ)));
+    } else
+#endif
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+        for (uint32_t offset = 0; offset < N; offset += 4) {
+            mask |= intersectRayWithWideNode4(node, offset, ray, invDirection, &tEntry[offset]) << offset;
+        }
+#else
+        // Scalar fallback for other architectures
+        for (uint32_t i = 0; i < N; i++) {
+            glm::vec3 t0 = (glm::vec3(node.lowerX[i], node.lowerY[i], node.lowerZ[i]) - ray.origin) * invDirection;
+            glm::vec3 t1 = (glm::vec3(node.upperX[i], node.upperY[i], node.upperZ[i]) - ray.origin) * invDirection;
+            glm::vec3 tin = glm::min(t0, t1);
+            glm::vec3 tout = glm::max(t0, t1);
+            tEntry[i] = std::max(0.0f, std::max(tin.x, std::max(tin.y, tin.z)));
+            float tExit = std::min(ray.t, BoxExitScale * std::min(tout.x, std::min(tout.y, tout.z)));
+            mask |= static_cast<uint32_t>(tEntry[i] <= tExit) << i;
+        }
+#endif
+    }
+
+    // Ignore unused child slots
+    return mask & ((1u << node.numChildren) - 1u);
+}
+
+// Hierarchy traversal routine over the wide hierarchy; called by the BVH's intersect()
+// At each wide node, all children are tested at once, and the hit children are pushed far-to-near,
+// s.t. the nearest child is visited first. Popped children that lie beyond the closest hit are skipped.
+// - wideNodes; the 4-wide or 8-wide hierarchy
+// - state;     the active scene, and a user-specified feature config object, encapsulated
+// - ray;       the ray intersecting the scene's geometry
+// - hitInfo;   the return object, with info regarding the hit geometry
+// - return;    boolean, if geometry was hit or not
+template <uint32_t N>
+bool BVH::intersectWide(const std::vector<WideNode<N>>& wideNodes, RenderState& state, Ray& ray, HitInfo& hitInfo) const
+{
+    struct StackEntry {
+        uint32_t child; // Either an index into `wideNodes`, or LeafBit | primitive offset
+        uint32_t count; // Nr. of primitives of a leaf
+        float tEntry; // Entry distance of the ray into the child's box
+    };
+
+    const glm::vec3 invDirection = computeInverseDirection(ray.direction);
+    uint32_t closest = InvalidIndex;
+    uint64_t numNodeVisits = 0;
+
+    // Every wide level adds at most N - 1 pending siblings, and has fewer levels than the binary hierarchy
+    withTraversalStack<StackEntry>((N - 1) * m_numLevels + 1, [&](auto& stack) {
+        stack.push_back({ RootIndex, 0, 0.0f });
+        while (!stack.empty()) {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+            if (entry.tEntry > ray.t)
+                continue;
+            numNodeVisits++;
+
+            if (entry.child & Node::LeafBit) {
+                intersectLeaf(entry.child & ~Node::LeafBit, entry.count, ray, hitInfo, closest);
+                continue;
+            }
+
+            const WideNode<N>& node = wideNodes[entry.child];
+            std::array<float, N> tEntry;
+            uint32_t mask = intersectRayWithWideNode(node, ray, invDirection, tEntry.data());
+
+            // Sort the hit children far-to-near by insertion sort; there are at most N of them
+            std::array<uint32_t, N> order;
+            uint32_t numHits = 0;
+            for (; mask; mask &= mask - 1) {
+                uint32_t i = static_cast<uint32_t>(std::countr_zero(mask));
+                uint32_t j = numHits++;
+                for (; j > 0 && tEntry[order[j - 1]] < tEntry[i]; j--)
+                    order[j] = order[j - 1];
+                order[j] = i;
+            }
+            for (uint32_t k = 0; k < numHits; k++) {
+                uint32_t i = order[k];
+                stack.push_back({ node.children[i], node.counts[i], tEntry[i] });
+            }
+        }
+    });
+    bvhTraversalStats().numNodeVisits += numNodeVisits;
+
+    bool is_hit = closest != InvalidIndex;
+    if (is_hit)
+        updateClosestHitInfo(state, closest, ray, hitInfo);
+
+    // Intersect with spheres.
+    for (const auto& sphere : state.scene.spheres)
+        is_hit |= intersectRayWithShape(sphere, ray, hitInfo);
+
+    return is_hit;
+}
+
+// Any-hit counterpart of `intersectWide()`, called by the BVH's occluded(); hit children are pushed
+// in slot order without sorting, and traversal returns as soon as any leaf reports a hit.
+// - wideNodes; the 4-wide or 8-wide hierarchy
+// - ray;       the ray, with `t` set to the maximum distance of a blocking hit
+// - hitInfo;   scratch object, which may be written to by the triangle test
+// - return;    boolean, if any triangle was hit
+template <uint32_t N>
+bool BVH::occludedWide(const std::vector<WideNode<N>>& wideNodes, Ray& ray, HitInfo& hitInfo) const
+{
+    struct StackEntry {
+        uint32_t child; // Either an index into `wideNodes`, or LeafBit | primitive offset
+        uint32_t count; // Nr. of primitives of a leaf
+    };
+
+    const glm::vec3 invDirection = computeInverseDirection(ray.direction);
+    uint64_t numNodeVisits = 0;
+    bool is_hit = false;
+
+    withTraversalStack<StackEntry>((N - 1) * m_numLevels + 1, [&](auto& stack) {
+        stack.push_back({ RootIndex, 0 });
+        while (!stack.empty()) {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+            numNodeVisits++;
+
+            if (entry.child & Node::LeafBit) {
+                if (occludedLeaf(entry.child & ~Node::LeafBit, entry.count, ray, hitInfo)) {
+                    is_hit = true;
+                    return;
+                }
+                continue;
+            }
+
+            const WideNode<N>& node = wideNodes[entry.child];
+            std::array<float, N> tEntry;
+            for (uint32_t mask = intersectRayWithWideNode(node, ray, invDirection, tEntry.data()); mask; mask &= mask - 1) {
+                uint32_t i = static_cast<uint32_t>(std::countr_zero(mask));
+                stack.push_back({ node.children[i], node.counts[i] });
+            }
+        }
+    });
+    bvhTraversalStats().numNodeVisits += numNodeVisits;
+
+    return is_hit;
+}
+
+// Wide hierarchy construction routine; called by the BVH's constructor after construction
+// Collapses the binary hierarchy into a 4-wide or 8-wide one. Starting from a binary node's two
+// children, the inner child with the largest surface area is repeatedly replaced by its own children,
+// until the wide node is full or only leaves remain. Leaves refer to the same primitives as before.
+// - wideNodes; the wide hierarchy being built
+// - nodeIndex; index of the binary node which is collapsed into a new wide node
+// - return;    index of the new wide node
+template <uint32_t N>
+uint32_t BVH::buildWideRecursive(std::vector<WideNode<N>>& wideNodes, uint32_t nodeIndex) const
+{
+    std::array<uint32_t, N> children;
+    uint32_t numChildren = 0;
+    if (m_nodes[nodeIndex].isLeaf()) {
+        children[numChildren++] = nodeIndex;
+    } else {
+        children[numChildren++] = m_nodes[nodeIndex].leftChild();
+        children[numChildren++] = m_nodes[nodeIndex].rightChild();
+    }
+    while (numChildren < N) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < numChildren; i++) {
+            float area = computeAABBSurfaceArea(m_nodes[children[i]].aabb);
+            if (!m_nodes[children[i]].isLeaf() && area > largestArea) {
+                largest = static_cast<int>(i);
+                largestArea = area;
+            }
+        }
+        if (largest < 0) {
+            break;
+        }
+
+        const Node& node = m_nodes[children[largest]];
+        children[largest] = node.leftChild();
+        children[numChildren++] = node.rightChild();
+    }
+
+    // WARNING: the recursive calls grow `wideNodes`, so the new node is filled in locally first
+    const auto wideIndex = static_cast<uint32_t>(wideNodes.size());
+    wideNodes.emplace_back();
+
+    WideNode<N> wide = {};
+    wide.numChildren = numChildren;
+    for (uint32_t i = 0; i < numChildren; i++) {
+        const Node& child = m_nodes[children[i]];
+        wide.lowerX[i] = child.aabb.lower.x;
+        wide.lowerY[i] = child.aabb.lower.y;
+        wide.lowerZ[i] = child.aabb.lower.z;
+        wide.upperX[i] = child.aabb.upper.x;
+        wide.upperY[i] = child.aabb.upper.y;
+        wide.upperZ[i] = child.aabb.upper.z;
+        if (child.isLeaf()) {
+            wide.children[i] = child.data[0];
+            wide.counts[i] = child.primitiveCount();
+        } else {
+            wide.children[i] = buildWideRecursive(wideNodes, children[i]);
+        }
+    }
+    wideNodes[wideIndex] = wide;
+    return wideIndex;
+}
+
+// Replace `m_primitives` by the compact, positions-only store after construction
+// For `TriangleTest::PrecomputedEdges`, two edges are stored instead of the last two vertices.
+// The triangles keep their leaf order. During construction, each primitive's meshID holds the global
+// index of its triangle, in the order in which the scene's meshes were gathered; this is mapped back
+// to a mesh and triangle index here.
+// - scene; the active scene
+void BVH::buildCompactPrimitives(const Scene& scene)
+{
+    // Global index of the first triangle of each mesh
+    std::vector<uint32_t> meshOffsets(scene.meshes.size());
+    for (size_t i = 1; i < scene.meshes.size(); i++) {
+        meshOffsets[i] = meshOffsets[i - 1] + static_cast<uint32_t>(scene.meshes[i - 1].triangles.size());
+    }
+
+    // The precomputed edges replace the remaining vertices
+    const bool isPrecomputed = m_triangleTest == TriangleTest::PrecomputedEdges;
+    const int n = static_cast<int>(m_primitives.size());
+    m_compactPrimitives.v0.resize(n);
+    (isPrecomputed ? m_compactPrimitives.edge1 : m_compactPrimitives.v1).resize(n);
+    (isPrecomputed ? m_compactPrimitives.edge2 : m_compactPrimitives.v2).resize(n);
+    m_compactPrimitives.meshIDs.resize(n);
+    m_compactPrimitives.triangleIDs.resize(n);
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n; i++) {
+        const auto& primitive = m_primitives[i];
+        auto meshID = static_cast<uint32_t>(std::distance(meshOffsets.begin(), std::upper_bound(meshOffsets.begin(), meshOffsets.end(), primitive.meshID)) - 1);
+        m_compactPrimitives.v0[i] = primitive.v0.position;
+        if (isPrecomputed) {
+            m_compactPrimitives.edge1[i] = primitive.v1.position - primitive.v0.position;
+            m_compactPrimitives.edge2[i] = primitive.v2.position - primitive.v0.position;
+        } else {
+            m_compactPrimitives.v1[i] = primitive.v1.position;
+            m_compactPrimitives.v2[i] = primitive.v2.position;
+        }
+        m_compactPrimitives.meshIDs[i] = meshID;
+        m_compactPrimitives.triangleIDs[i] = primitive.meshID - meshOffsets[meshID];
+    }
+
+    // Release the full primitives
+    std::vector<Primitive>().swap(m_primitives);
+}
+
+// Return the nr. of bytes allocated to store the BVH's triangles, in either layout
+size_t BVH::primitiveMemoryFootprint() const
+{
+    const auto& compact = m_compactPrimitives;
+    return m_primitives.capacity() * sizeof(Primitive)
+        + (compact.v0.capacity() + compact.v1.capacity() + compact.v2.capacity()) * sizeof(glm::vec3)
+        + (compact.edge1.capacity() + compact.edge2.capacity()) * sizeof(glm::vec3)
+        + (compact.meshIDs.capacity() + compact.triangleIDs.capacity()) * sizeof(uint32_t);
+}
+
+// Compute the nr. of levels in your hierarchy after construction; useful for `debugDrawLevel()`
+void BVH::buildNumLevels()
+{
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.push_back({ RootIndex, 0 });
+
+    uint32_t maxLevel = 0;
+    while (!stack.empty()) {
+        auto [idx, level] = stack.back();
+        stack.pop_back();
+        maxLevel = std::max(maxLevel, level);
+
+        const Node& node = m_nodes[idx];
+        if (!node.isLeaf()) {
+            stack.push_back({ node.leftChild(), level + 1 });
+            stack.push_back({ node.rightChild(), level + 1 });
+        }
+    }
+
+    m_numLevels = maxLevel + 1;
+}
+
+// Compute the nr. of leaves in your hierarchy after construction; useful for `debugDrawLeaf()`
+void BVH::buildNumLeaves()
+{
+    std::vector<uint32_t> stack;
+    stack.push_back(RootIndex);
+
+    uint32_t numLeaves = 0;
+    while (!stack.empty()) {
+        uint32_t idx = stack.back();
+        stack.pop_back();
+
+        const Node& node = m_nodes[idx];
+        if (node.isLeaf()) {
+            numLeaves++;
+        } else {
+            stack.push_back(node.leftChild());
+            stack.push_back(node.rightChild());
+        }
+    }
+
+    m_numLeaves = numLeaves;
+}
+
+// Compute the SAH cost of your hierarchy after construction; the expected cost of tracing a random
+// ray through the tree, with every node weighted by the probability that a ray hitting the root
+// also hits that node (the ratio of their surface areas).
+// - features; the user-specified features object, providing the node/triangle cost model
+void BVH::buildSahCost(const Features& features)
+{
+    float rootArea = computeAABBSurfaceArea(m_nodes[RootIndex].aabb);
+    if (rootArea <= 0.0f) {
+        m_sahCost = 0.0f;
+        return;
+    }
+
+    std::vector<uint32_t> stack;
+    stack.push_back(RootIndex);
+
+    float cost = 0.0f;
+    while (!stack.empty()) {
+        uint32_t idx = stack.back();
+        stack.pop_back();
+
+        const Node& node = m_nodes[idx];
+        float area = computeAABBSurfaceArea(node.aabb);
+        if (node.isLeaf()) {
+            cost += features.extra.bvhSahIntersectionCost * static_cast<float>(node.primitiveCount()) * area;
+        } else {
+            cost += features.extra.bvhSahTraversalCost * area;
+            stack.push_back(node.leftChild());
+            stack.push_back(node.rightChild());
+        }
+    }
+
+    m_sahCost = cost / rootArea;
+}
+
+// Draw the bounding boxes of the nodes at the selected level. Use this function to visualize nodes
+// for debugging.
+// - level; the selected level, with the root at level 0
+void BVH::debugDrawLevel(int level)
+{
+    std::vector<std::pair<uint32_t, int>> stack;
+    stack.push_back({ RootIndex, 0 });
+
+    while (!stack.empty()) {
+        auto [idx, nodeLevel] = stack.back();
+        stack.pop_back();
+
+        const Node& node = m_nodes[idx];
+        if (nodeLevel == level) {
+            drawAABB(node.aabb, DrawMode::Wireframe, glm::vec3(0.05f, 1.0f, 0.05f), 0.1f);
+        } else if (nodeLevel < level && !node.isLeaf()) {
+            stack.push_back({ node.leftChild(), nodeLevel + 1 });
+            stack.push_back({ node.rightChild(), nodeLevel + 1 });
+        }
+    }
+}
+
+// Draw data of the leaf at the selected index. Use this function to visualize leaf nodes
+// for debugging. We draw the AABB of the selected leaf, and then its underlying primitives.
+// - leafIndex; index of the selected leaf, counting from 1
+//              (Hint: not the index of the i-th node, but of the i-th leaf!)
+void BVH::debugDrawLeaf(int leafIndex)
+{
+    std::vector<uint32_t> stack;
+    stack.push_back(RootIndex);
+
+    int currentLeaf = 0;
+    while (!stack.empty()) {
+        uint32_t idx = stack.back();
+        stack.pop_back();
+
+        const Node& node = m_nodes[idx];
+        if (!node.isLeaf()) {
+            // Push right first, so leaves are enumerated left-to-right
+            stack.push_back(node.rightChild());
+            stack.push_back(node.leftChild());
+        } else if (++currentLeaf == leafIndex) {
+            drawAABB(node.aabb, DrawMode::Wireframe, glm::vec3(0.05f, 1.0f, 0.05f), 0.1f);
+            for (uint32_t i = node.primitiveOffset(); i < node.primitiveOffset() + node.primitiveCount(); i++) {
+                if (m_compactPrimitives.meshIDs.empty()) {
+                    const auto& prim = m_primitives[i];
+                    drawTriangle(prim.v0, prim.v1, prim.v2);
+                } else {
+                    // The compact store lacks vertex normals, so draw with the face normal
+                    const auto& compact = m_compactPrimitives;
+                    const glm::vec3 p0 = compact.v0[i];
+                    const glm::vec3 p1 = compact.edge1.empty() ? compact.v1[i] : p0 + compact.edge1[i];
+                    const glm::vec3 p2 = compact.edge2.empty() ? compact.v2[i] : p0 + compact.edge2[i];
+                    const auto n = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+                    drawTriangle({ .position = p0, .normal = n, .texCoord = {} }, { .position = p1, .normal = n, .texCoord = {} }, { .position = p2, .normal = n, .texCoord = {} });
+                }
+            }
+            return;
+        }
+    }
+}
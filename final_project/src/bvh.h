@@ -1,6 +1,11 @@
 #pragma once
 #include "bvh_interface.h"
 #include <framework/ray.h>
+#include <array>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
@@ -16,6 +21,10 @@ AxisAlignedBox computeSpanAABB(std::span<const BVHInterface::Primitive> primitiv
 // This method is unit-tested, so do not change the function signature.
 glm::vec3 computePrimitiveCentroid(const BVHInterface::Primitive primitive);
 
+// Given a range of BVH triangles, compute an axis-aligned bounding box around their centroids;
+// large ranges are reduced in fixed-size chunks concurrently, as for the node bounds during construction
+AxisAlignedBox computeSpanCentroidAABB(std::span<const BVHInterface::Primitive> primitives);
+
 // Given an axis-aligned bounding box, compute the longest axis as (x = 0, y = 1, z = 2)
 // This method is unit-tested, so do not change the function signature.
 uint32_t computeAABBLongestAxis(const AxisAlignedBox& aabb);
@@ -26,30 +35,113 @@ uint32_t computeAABBLongestAxis(const AxisAlignedBox& aabb);
 // This method is unit-tested, so do not change the function signature.
 size_t splitPrimitivesByMedian(const AxisAlignedBox& aabb, uint32_t axis, std::span<BVHInterface::Primitive> primitives);
 
+// Given an axis-aligned bounding box, compute its surface area; used to evaluate the SAH
+float computeAABBSurfaceArea(const AxisAlignedBox& aabb);
+
+// Given a primitive that was hit by the ray, fill in the hitInfo object with the surface's material,
+// (interpolated) normal, barycentric and texture coordinates; this respects the active features.
+void updateHitInfo(RenderState& state, const BVHInterface::Primitive& primitive, const Ray& ray, HitInfo& hitInfo);
+
+// Statistics gathered during bvh traversal, for performance measurements
+struct BVHTraversalStats {
+    uint64_t numNodeVisits = 0; // Nr. of nodes whose box the ray entered, and whose children or primitives were tested
+};
+
+// Return the traversal statistics gathered by the calling thread; reset these by assigning an empty object
+BVHTraversalStats& bvhTraversalStats();
+
 // Hierarchy traversal routine; called by the BVH's intersect().
 // This method is unit-tested, so do not change the function signature.
 bool intersectRayWithBVH(RenderState& state, const BVHInterface& bvh, Ray& ray, HitInfo& hitInfo);
 
+// Return true if something is hit before distance 'tMax' along the ray, false otherwise; used for shadow rays.
+// Dispatches to the any-hit query `BVH::occluded()` if `bvh` is a BVH, and otherwise falls back to a closest-hit
+// query, s.t. `BVHInterface` itself stays as the tests expect it.
+bool isRayOccludedInBVH(RenderState& state, const BVHInterface& bvh, const Ray& ray, float tMax);
+
+// Intersect a packet of at most 32 rays, e.g. coherent camera rays, and return a bitmask in which bit 'i' is set
+// if 'rays[i]' hit something; for these, 't' and 'hitInfos[i]' are updated as in intersect(). Dispatches to the
+// packet traversal `BVH::intersectPacket()` if `bvh` is a BVH, and otherwise intersects each ray separately.
+uint32_t intersectRayPacketWithBVH(RenderState& state, const BVHInterface& bvh, std::span<Ray> rays, std::span<HitInfo> hitInfos);
+
 // The BVH traversal class. Please do not modify the interfaces since they are used by the tests
 struct BVH : public BVHInterface {
     // Constants used throughout the BVH
-    static constexpr uint32_t LeafSize = 4; // Maximum nr. of primitives in a leaf
+    static constexpr uint32_t LeafSize = 4; // Ranges of at most this many primitives always become a leaf
+    static constexpr uint32_t MaxSahLeafSize = 16; // Maximum nr. of primitives in a leaf made by the SAH termination criterion
     static constexpr uint32_t RootIndex = 0; // Index of root node in `m_nodes` vector
+    static constexpr uint32_t ParallelBuildSize = 4096; // Minimum nr. of primitives for which subtrees are built concurrently
+    static constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max(); // Marks a missing primitive
+    static constexpr uint32_t TraversalStackSize = 256; // Capacity of the fixed-size stack used during traversal
+    static constexpr uint32_t MaxTreeletSize = 16; // Maximum nr. of leaves of a treelet restructured by `optimizeTreelets()`
+    static constexpr uint32_t MaxPacketSize = 32; // Maximum nr. of rays traced together by `intersectPacket()`
 
     // Constructor. Receives the scene and starts the build process
     // NOTE: this constructor is used in tests, so do not change its function signature.
     BVH(const Scene& scene, const Features& features);
 
+    // Save the built hierarchy to a binary file, keyed by the geometry of the scene and by the build settings in
+    // `features`, s.t. later runs on the same scene can skip construction; returns false if the file could not be written
+    bool save(const std::filesystem::path& file, const Scene& scene, const Features& features) const;
+
+    // Load a hierarchy saved by `save()` instead of building it; returns nothing if the file is missing or corrupt,
+    // or if it was saved for different geometry or build settings
+    static std::optional<BVH> load(const std::filesystem::path& file, const Scene& scene, const Features& features);
+
+    // Return the file in `cacheDir` under which the named scene's hierarchy is saved; the name holds a hash of the
+    // build settings in `features`, s.t. hierarchies built with different settings are kept side by side
+    static std::filesystem::path cachePath(const std::filesystem::path& cacheDir, std::string_view sceneName, const Features& features);
+
     // See BVHInterface::intersect(...) for argument descriptions
     bool intersect(RenderState& state, Ray& ray, HitInfo& hitInfo) const override;
 
+    // Return true if something is hit before distance 'tMax' along the ray, false otherwise. Used for shadow rays;
+    // returns on the first hit found, and no hit information is produced. Renderer code calls `isRayOccludedInBVH()`.
+    bool occluded(RenderState& state, const Ray& ray, float tMax) const;
+
+    // See `intersectRayPacketWithBVH()` for argument descriptions; traverses the binary hierarchy once for all rays
+    uint32_t intersectPacket(RenderState& state, std::span<Ray> rays, std::span<HitInfo> hitInfos) const;
+
+    // Compact, positions-only triangle store in structure-of-arrays layout, which replaces `m_primitives`
+    // if `features.extra.enableBvhCompactPrimitives` is set. Triangles are stored in leaf order; normals
+    // and texture coordinates are fetched from the scene's meshes only for the closest hit.
+    struct CompactPrimitives {
+        std::vector<glm::vec3> v0, v1, v2; // Vertex positions of each triangle
+        std::vector<glm::vec3> edge1, edge2; // Edges v1 - v0 and v2 - v0, which replace v1 and v2 for `TriangleTest::PrecomputedEdges`
+        std::vector<uint32_t> meshIDs; // Index of the scene mesh from which each triangle is sourced
+        std::vector<uint32_t> triangleIDs; // Index of each triangle inside its mesh's triangle list
+    };
+
+    // Node of a 4-wide or 8-wide hierarchy, collapsed from the binary one if `features.extra.bvhWidth` is set.
+    // Child boxes are stored in structure-of-arrays layout, s.t. all children are tested at once with SIMD.
+    template <uint32_t N>
+    struct alignas(32) WideNode {
+        std::array<float, N> lowerX, lowerY, lowerZ; // Lower corners of the children's boxes
+        std::array<float, N> upperX, upperY, upperZ; // Upper corners of the children's boxes
+        std::array<uint32_t, N> children; // Index of a wide node, or LeafBit | primitive offset for a leaf
+        std::array<uint32_t, N> counts; // Nr. of primitives of each leaf child
+        uint32_t numChildren; // Nr. of used child slots
+    };
+
 private: // Private members
     uint32_t m_numLevels;
     uint32_t m_numLeaves;
+    float m_sahCost;
     std::vector<Node> m_nodes;
     std::vector<Primitive> m_primitives;
+    CompactPrimitives m_compactPrimitives;
+    std::vector<WideNode<4>> m_wideNodes4;
+    std::vector<WideNode<8>> m_wideNodes8;
+    TriangleTest m_triangleTest = TriangleTest::Reference;
 
 private: // Private methods
+    // Empty hierarchy, filled in by `load()`
+    BVH() = default;
+
+    // Apply `f` to each of the arrays that make up the hierarchy, in a fixed order; used by `save()` and `load()`
+    template <typename Self, typename F>
+    static void forEachArray(Self& bvh, F&& f);
+
     // Helper method; simply allocates a new node, and returns its index
     uint32_t nextNodeIdx();
 
@@ -57,8 +149,53 @@ private: // Private methods
     Node buildLeafData(const Scene& scene, const Features& features, const AxisAlignedBox& aabb, std::span<Primitive> primitives);
     Node buildNodeData(const Scene& scene, const Features& features, const AxisAlignedBox& aabb, uint32_t leftChildIndex, uint32_t rightChildIndex);
 
-    // Hierarchy construction routine; called by the BVH's constructor.
-    void buildRecursive(const Scene& scene, const Features& features, std::span<Primitive> primitives, uint32_t nodeIndex);
+    // Temporary split data recorded during construction; defined in bvh.cpp
+    struct BuildRanges;
+
+    // Hierarchy split routine; called by the BVH's constructor. Recursively partitions `m_primitives` in place,
+    // and records each node's bounding box and split position. Large subtrees are split concurrently.
+    void splitRecursive(const Features& features, std::span<Primitive> primitives, size_t key, BuildRanges& ranges) const;
+
+    // Hierarchy construction routine; called by the BVH's constructor after `splitRecursive()`.
+    // Emits the nodes in depth-first order, so the tree's layout does not depend on thread scheduling.
+    void buildRecursive(const Scene& scene, const Features& features, std::span<Primitive> primitives, uint32_t nodeIndex, size_t key, const BuildRanges& ranges);
+
+    // Linear hierarchy split routine; called by the BVH's constructor instead of `splitRecursive()`, after sorting
+    // `m_primitives` by Morton code. Splits at the highest differing bit, and fits boxes bottom-up. Large subtrees
+    // are split concurrently; `buildRecursive()` then emits the nodes.
+    void splitLinearRecursive(std::span<const Primitive> primitives, std::span<const uint64_t> codes, size_t key, BuildRanges& ranges) const;
+
+    // Optional post-process; restructures small treelets bottom-up by agglomerative clustering, if this lowers the SAH.
+    void optimizeTreelets(uint32_t nodeIndex, uint32_t treeletSize, uint32_t depth);
+
+    // Replaces `m_primitives` by the compact store after construction; during construction, each primitive's
+    // `meshID` temporarily holds the global index of its triangle in the scene.
+    void buildCompactPrimitives(const Scene& scene);
+
+    // Collapses the binary hierarchy below `nodeIndex` into a wide one, and returns the index of the new wide node
+    template <uint32_t N>
+    uint32_t buildWideRecursive(std::vector<WideNode<N>>& wideNodes, uint32_t nodeIndex) const;
+
+    // Hierarchy traversal routine over the compact store; called by intersect() instead of `intersectRayWithBVH()`
+    bool intersectCompact(RenderState& state, Ray& ray, HitInfo& hitInfo) const;
+
+    // Hierarchy traversal routine over a wide hierarchy; called by intersect() instead of `intersectRayWithBVH()`
+    template <uint32_t N>
+    bool intersectWide(const std::vector<WideNode<N>>& wideNodes, RenderState& state, Ray& ray, HitInfo& hitInfo) const;
+
+    // Helpers for the above traversal routines; test a range of triangles in either layout and record the closest
+    // hit triangle, and fill in the hitInfo object for the closest hit triangle once traversal is done
+    void intersectLeaf(uint32_t offset, uint32_t count, Ray& ray, HitInfo& hitInfo, uint32_t& closest) const;
+    void updateClosestHitInfo(RenderState& state, uint32_t closest, const Ray& ray, HitInfo& hitInfo) const;
+
+    // Any-hit counterparts of the above routines for occluded(); these return as soon as any triangle is hit
+    template <uint32_t N>
+    bool occludedWide(const std::vector<WideNode<N>>& wideNodes, Ray& ray, HitInfo& hitInfo) const;
+    bool occludedLeaf(uint32_t offset, uint32_t count, Ray& ray, HitInfo& hitInfo) const;
+
+    // Shared by the above leaf routines; tests a range of the compact store with `m_triangleTest`
+    template <typename F>
+    bool intersectCompactLeaf(uint32_t offset, uint32_t count, Ray& ray, HitInfo& hitInfo, F&& onHit) const;
 
 private: // Visual debug helpers
     // Compute the nr. of levels in your hierarchy after construction; useful for debugDrawLevel()
@@ -67,6 +204,9 @@ private: // Visual debug helpers
     // Compute the nr. of leaves in your hierarchy after construction; useful for debugDrawLeaf()
     void buildNumLeaves();
 
+    // Compute the SAH cost of your hierarchy after construction; useful to compare split strategies
+    void buildSahCost(const Features& features);
+
 public: // Visual debug
     // Draw the bounding boxes of the nodes at the selected level.
     // For a description of the method's arguments, refer to 'bounding_volume_hierarchy.cpp'
@@ -83,7 +223,16 @@ public: // Public getters
     std::span<const Primitive> primitives() const override { return m_primitives; }
     std::span<Primitive> primitives() override { return m_primitives; }
 
+    // Accessor to the compact triangle store; empty unless `features.extra.enableBvhCompactPrimitives` is set
+    const CompactPrimitives& compactPrimitives() const { return m_compactPrimitives; }
+
+    // Return the nr. of bytes allocated to store the BVH's triangles, in either layout
+    size_t primitiveMemoryFootprint() const;
+
     // Return how many levels/leaves there are in the tree
     uint32_t numLevels() const override { return m_numLevels; }
     uint32_t numLeaves() const override { return m_numLeaves; }
+
+    // Return the surface area heuristic cost of the tree, relative to the root's surface area
+    float sahCost() const { return m_sahCost; }
 };
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "bvh.h"
+#include "scene.h"
+#include <framework/mapped_file.h>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Layout of a saved hierarchy; the header is followed by the hierarchy's arrays, each of which starts at a multiple
+// of 64 bytes, s.t. a memory mapped file can be read array by array without any parsing:
+//   BvhFileHeader
+//   nodes, primitives, compact v0, v1, v2, edge1, edge2, meshIDs, triangleIDs, 4-wide nodes, 8-wide nodes
+// Arrays that the saved build settings do not use are empty.
+static constexpr std::array<char, 8> BvhFileMagic { 'C', 'G', 'B', 'V', 'H', '\0', '\0', '\0' };
+static constexpr uint32_t BvhFileVersion = 2; // Increment on changes to the layout, or to the way hierarchies are built
+static constexpr uint32_t BvhFileByteOrder = 0x01020304;
+static constexpr size_t BvhFileAlignment = 64;
+static constexpr size_t NumBvhFileArrays = 11;
+
+// The features that change the built hierarchy; settings that only affect traversal are not part of the key
+struct BvhBuildSettings {
+    uint32_t flags; // Bit mask of the enabled build features, see `encodeBuildSettings()`
+    uint32_t numSahBins;
+    float sahTraversalCost;
+    float sahIntersectionCost;
+    uint32_t treeletSize;
+    uint32_t triangleTest;
+    uint32_t width;
+
+    [[nodiscard]] constexpr bool operator==(const BvhBuildSettings&) const noexcept = default;
+};
+
+struct BvhFileHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t byteOrder; // Files are stored in native byte order; this detects foreign ones
+    uint64_t sceneHash; // Hash of the geometry of the scene's meshes
+    BvhBuildSettings settings;
+    uint32_t numLevels;
+    uint32_t numLeaves;
+    float sahCost;
+    std::array<uint64_t, NumBvhFileArrays> arraySizes; // Nr. of elements of each array, in file order
+};
+static_assert(std::is_trivially_copyable_v<BvhFileHeader> && sizeof(BvhFileHeader) == 152);
+
+static BvhBuildSettings encodeBuildSettings(const Features& features)
+{
+    const auto& extra = features.extra;
+    return BvhBuildSettings {
+        .flags = (extra.enableBvhSahBinning ? 1u : 0u) | (extra.enableBvhLinearBuild ? 2u : 0u)
+            | (extra.enableBvhTreeletOptimization ? 4u : 0u) | (extra.enableBvhCompactPrimitives ? 8u : 0u),
+        .numSahBins = extra.numBvhSahBins,
+        .sahTraversalCost = extra.bvhSahTraversalCost,
+        .sahIntersectionCost = extra.bvhSahIntersectionCost,
+        .treeletSize = extra.bvhTreeletSize,
+        .triangleTest = static_cast<uint32_t>(extra.bvhTriangleTest),
+        .width = extra.bvhWidth
+    };
+}
+
+static size_t alignedSize(size_t size)
+{
+    return (size + BvhFileAlignment - 1) & ~(BvhFileAlignment - 1);
+}
+
+// 64-bit FNV-1a hash, applied to 8-byte words instead of single bytes for speed;
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+static uint64_t hashBytes(std::span<const std::byte> bytes, uint64_t hash)
+{
+    constexpr uint64_t prime = 0x100000001b3;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < bytes.size(); i++) {
+        hash = (hash ^ static_cast<uint64_t>(bytes[i])) * prime;
+    }
+    return hash;
+}
+
+// Hash everything of the scene that ends up in the hierarchy; materials and lights are looked up in the scene
+// during traversal, so these may change without invalidating a saved hierarchy
+static uint64_t hashSceneGeometry(const Scene& scene)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const auto& mesh : scene.meshes) {
+        const std::array<uint64_t, 2> sizes { mesh.vertices.size(), mesh.triangles.size() };
+        hash = hashBytes(std::as_bytes(std::span(sizes)), hash);
+        hash = hashBytes(std::as_bytes(std::span(mesh.vertices)), hash);
+        hash = hashBytes(std::as_bytes(std::span(mesh.triangles)), hash);
+    }
+    return hash;
+}
+
+// Apply `f` to each of the arrays that make up the hierarchy, in file order
+template <typename Self, typename F>
+void BVH::forEachArray(Self& bvh, F&& f)
+{
+    auto& compact = bvh.m_compactPrimitives;
+    f(bvh.m_nodes);
+    f(bvh.m_primitives);
+    f(compact.v0);
+    f(compact.v1);
+    f(compact.v2);
+    f(compact.edge1);
+    f(compact.edge2);
+    f(compact.meshIDs);
+    f(compact.triangleIDs);
+    f(bvh.m_wideNodes4);
+    f(bvh.m_wideNodes8);
+}
+
+// Save the hierarchy to a file; it is written to a temporary file first, s.t. concurrent loads never see a partially
+// written file. The temporary file's name is unique to this save, s.t. concurrent saves of the same file, e.g. by two
+// processes rendering the same scene, do not write into each other's files. Returns false on failure.
+bool BVH::save(const std::filesystem::path& file, const Scene& scene, const Features& features) const
+{
+    BvhFileHeader header {
+        .magic = BvhFileMagic,
+        .version = BvhFileVersion,
+        .byteOrder = BvhFileByteOrder,
+        .sceneHash = hashSceneGeometry(scene),
+        .settings = encodeBuildSettings(features),
+        .numLevels = m_numLevels,
+        .numLeaves = m_numLeaves,
+        .sahCost = m_sahCost,
+        .arraySizes = {}
+    };
+    size_t arrayIndex = 0;
+    forEachArray(*this, [&](const auto& array) { header.arraySizes[arrayIndex++] = array.size(); });
+
+    std::error_code error;
+    if (file.has_parent_path()) {
+        std::filesystem::create_directories(file.parent_path(), error);
+    }
+    auto temporaryFile = file;
+    temporaryFile += ".tmp" + std::to_string(std::random_device()() ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream stream { temporaryFile, std::ios::binary | std::ios::trunc };
+        if (!stream) {
+            return false;
+        }
+        const auto writePadded = [&](const void* data, size_t size) {
+            static constexpr std::array<char, BvhFileAlignment> padding {};
+            stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            stream.write(padding.data(), static_cast<std::streamsize>(alignedSize(size) - size));
+        };
+        writePadded(&header, sizeof(header));
+        forEachArray(*this, [&](const auto& array) {
+            using T = typename std::remove_cvref_t<decltype(array)>::value_type;
+            static_assert(std::is_trivially_copyable_v<T>);
+            writePadded(array.data(), array.size() * sizeof(T));
+        });
+        if (!stream.flush()) {
+            stream.close();
+            std::filesystem::remove(temporaryFile, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryFile, file, error);
+    if (error) {
+        std::filesystem::remove(temporaryFile, error);
+        return false;
+    }
+    return true;
+}
+
+// Given a cache directory, a scene name, and the build settings, returns "<cacheDir>/<sceneName>-<settings hash>.bvhcache"
+std::filesystem::path BVH::cachePath(const std::filesystem::path& cacheDir, std::string_view sceneName, const Features& features)
+{
+    const BvhBuildSettings settings = encodeBuildSettings(features);
+    const uint64_t settingsHash = hashBytes(std::as_bytes(std::span(&settings, 1)), 0xcbf29ce484222325);
+    std::array<char, 17> settingsHashString;
+    std::snprintf(settingsHashString.data(), settingsHashString.size(), "%016llx", static_cast<unsigned long long>(settingsHash));
+    return cacheDir / (std::string(sceneName) + "-" + settingsHashString.data() + ".bvhcache");
+}
+
+// Check that every node of a loaded binary hierarchy is reached exactly once from the root, s.t. traversal terminates,
+// and that every leaf's range lies within the `numPrimitives` stored triangles
+static bool isValidHierarchy(std::span<const BVH::Node> nodes, uint64_t numPrimitives)
+{
+    std::vector<bool> isVisited(nodes.size(), false);
+    std::vector<uint32_t> stack { BVH::RootIndex };
+    while (!stack.empty()) {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        if (index >= nodes.size() || isVisited[index]) {
+            return false;
+        }
+        isVisited[index] = true;
+
+        const BVH::Node& node = nodes[index];
+        if (node.isLeaf()) {
+            if (uint64_t(node.primitiveOffset()) + node.primitiveCount() > numPrimitives) {
+                return false;
+            }
+        } else {
+            stack.push_back(node.leftChild());
+            stack.push_back(node.rightChild());
+        }
+    }
+    return true;
+}
+
+// Check that every child of a loaded wide hierarchy lies after its parent and within the hierarchy, that every leaf's
+// range lies within the `numPrimitives` stored triangles, and that the hierarchy has at most `maxLevels` levels; the
+// wide traversal stacks are sized by the nr. of levels of the binary hierarchy
+template <uint32_t N>
+static bool isValidWideHierarchy(std::span<const BVH::WideNode<N>> nodes, uint64_t numPrimitives, uint32_t maxLevels)
+{
+    // Children lie after their parents, so each node's level is final before its children are visited
+    std::vector<uint32_t> levels(nodes.size(), 1);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const auto& node = nodes[i];
+        if (node.numChildren > N || levels[i] > maxLevels) {
+            return false;
+        }
+        for (uint32_t c = 0; c < node.numChildren; c++) {
+            const uint32_t child = node.children[c];
+            if (child & BVH::Node::LeafBit) {
+                if (uint64_t(child & ~BVH::Node::LeafBit) + node.counts[c] > numPrimitives) {
+                    return false;
+                }
+            } else if (child <= i || child >= nodes.size()) {
+                return false;
+            } else {
+                levels[child] = std::max(levels[child], levels[i] + 1);
+            }
+        }
+    }
+    return true;
+}
+
+// Check that the loaded triangles match the layout selected by the build settings, and refer to existing meshes and
+// triangles of the scene; returns the nr. of triangles, or nothing if the arrays are inconsistent
+static std::optional<uint64_t> validPrimitiveCount(std::span<const BVH::Primitive> primitives, const BVH::CompactPrimitives& compact,
+    const Scene& scene, const Features& features)
+{
+    if (!features.extra.enableBvhCompactPrimitives) {
+        const bool isEmpty = compact.v0.empty() && compact.v1.empty() && compact.v2.empty() && compact.edge1.empty()
+            && compact.edge2.empty() && compact.meshIDs.empty() && compact.triangleIDs.empty();
+        const bool isInScene = std::all_of(std::begin(primitives), std::end(primitives),
+            [&](const BVH::Primitive& primitive) { return primitive.meshID < scene.meshes.size(); });
+        if (!isEmpty || !isInScene) {
+            return {};
+        }
+        return primitives.size();
+    }
+
+    const size_t n = compact.v0.size();
+    const bool isPrecomputed = features.extra.bvhTriangleTest == TriangleTest::PrecomputedEdges;
+    const size_t numVertices = isPrecomputed ? 0 : n, numEdges = isPrecomputed ? n : 0;
+    if (!primitives.empty() || compact.v1.size() != numVertices || compact.v2.size() != numVertices || compact.edge1.size() != numEdges
+        || compact.edge2.size() != numEdges || compact.meshIDs.size() != n || compact.triangleIDs.size() != n) {
+        return {};
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (compact.meshIDs[i] >= scene.meshes.size() || compact.triangleIDs[i] >= scene.meshes[compact.meshIDs[i]].triangles.size()) {
+            return {};
+        }
+    }
+    return n;
+}
+
+// Load a hierarchy saved by `save()`. The file is memory mapped, and each array is copied out in one piece, s.t. the
+// loaded hierarchy owns its data just like a built one; pages of the file are read by the OS as they are copied.
+std::optional<BVH> BVH::load(const std::filesystem::path& file, const Scene& scene, const Features& features)
+{
+    const MappedFile mappedFile { file };
+    if (!mappedFile.isOpen()) {
+        return {};
+    }
+    const auto data = mappedFile.data();
+    BvhFileHeader header;
+    if (data.size() < sizeof(header)) {
+        return {};
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != BvhFileMagic || header.version != BvhFileVersion || header.byteOrder != BvhFileByteOrder
+        || header.settings != encodeBuildSettings(features) || header.sceneHash != hashSceneGeometry(scene)) {
+        return {};
+    }
+
+    BVH bvh;
+    bvh.m_sahCost = header.sahCost;
+    bvh.m_triangleTest = features.extra.enableBvhCompactPrimitives ? features.extra.bvhTriangleTest : TriangleTest::Reference;
+
+    // The arrays must fill the file exactly; a truncated file is rejected as a whole
+    size_t offset = alignedSize(sizeof(header)), arrayIndex = 0;
+    bool isComplete = true;
+    forEachArray(bvh, [&](auto& array) {
+        using T = typename std::remove_cvref_t<decltype(array)>::value_type;
+        const uint64_t count = header.arraySizes[arrayIndex++];
+        if (!isComplete || offset > data.size() || count > (data.size() - offset) / sizeof(T)) {
+            isComplete = false;
+            return;
+        }
+        array.resize(count);
+        if (count > 0) {
+            std::memcpy(array.data(), data.data() + offset, count * sizeof(T));
+        }
+        offset += alignedSize(count * sizeof(T));
+    });
+    if (!isComplete || offset != data.size() || bvh.m_nodes.empty()) {
+        return {};
+    }
+
+    // A file with a matching key may still be corrupt or hand-edited; its indices are checked before they are used,
+    // and the nr. of levels, which sizes the traversal stacks, is recomputed rather than read from the header
+    const auto numPrimitives = validPrimitiveCount(bvh.m_primitives, bvh.m_compactPrimitives, scene, features);
+    if (!numPrimitives || !isValidHierarchy(bvh.m_nodes, *numPrimitives)) {
+        return {};
+    }
+    bvh.buildNumLevels();
+    bvh.buildNumLeaves();
+    if (!isValidWideHierarchy<4>(bvh.m_wideNodes4, *numPrimitives, bvh.m_numLevels)
+        || !isValidWideHierarchy<8>(bvh.m_wideNodes8, *numPrimitives, bvh.m_numLevels)) {
+        return {};
+    }
+    return bvh;
+}
@@ -0,0 +1,64 @@
+#include "camera.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/trackball.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+CameraFrame::CameraFrame(const Trackball& camera)
+    : m_origin(camera.position())
+    , m_forward(camera.forward())
+{
+    // The trackball does not expose its image plane; recover its extents from the projection, which
+    // scales x and y by the inverse of the half width and half height at unit distance
+    const glm::mat4 projection = camera.projectionMatrix();
+    const float halfScreenSpaceWidth = 1.0f / projection[0][0];
+    const float halfScreenSpaceHeight = 1.0f / projection[1][1];
+
+    // NOTE: the trackball's left() points towards screen-space -x, as its camera looks down +z.
+    m_right = -halfScreenSpaceWidth * camera.left();
+    m_up = halfScreenSpaceHeight * camera.up();
+}
+
+CameraFrame::CameraFrame(const glm::vec3& lookAt, const glm::vec3& rotation, float distanceFromLookAt, float fovy, float aspectRatio)
+{
+    // Mirrors the trackball's `position()`, `forward()`, `left()` and `up()`, and the extents of its image plane
+    const glm::quat orientation(rotation);
+    const float halfScreenSpaceHeight = std::tan(fovy / 2.0f);
+    const float halfScreenSpaceWidth = aspectRatio * halfScreenSpaceHeight;
+    m_origin = lookAt + orientation * glm::vec3(0.0f, 0.0f, -distanceFromLookAt);
+    m_forward = orientation * glm::vec3(0.0f, 0.0f, 1.0f);
+    m_right = -halfScreenSpaceWidth * (orientation * glm::vec3(1.0f, 0.0f, 0.0f));
+    m_up = halfScreenSpaceHeight * (orientation * glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+Ray CameraFrame::generateRay(const glm::vec2& position) const
+{
+    Ray ray;
+    ray.origin = m_origin;
+    ray.direction = glm::normalize(position.x * m_right + position.y * m_up + m_forward);
+    ray.t = std::numeric_limits<float>::max();
+    return ray;
+}
+
+void CameraFrame::generateRays(std::span<const glm::vec2> positions, std::span<Ray> rays) const
+{
+    // Plain component-wise arithmetic without early outs, s.t. the compiler can vectorize the loop
+    const size_t numRays = std::min(positions.size(), rays.size());
+    for (size_t i = 0; i < numRays; i++) {
+        const glm::vec3 direction = positions[i].x * m_right + positions[i].y * m_up + m_forward;
+        rays[i].origin = m_origin;
+        rays[i].direction = direction * (1.0f / std::sqrt(glm::dot(direction, direction)));
+        rays[i].t = std::numeric_limits<float>::max();
+    }
+}
+
+glm::vec3 CameraFrame::position() const
+{
+    return m_origin;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "fwd.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/ray.h>
+#include <span>
+
+// Snapshot of a camera's position and orientation, from which camera rays are generated. `Trackball::generateRay()`
+// rebuilds the camera's rotation from its Euler angles for every ray; the frame instead stores the rotated axes,
+// pre-scaled by the extents of the image plane, and is rebuilt only when the camera changes (e.g. once per frame).
+// Unlike the trackball, the frame needs no window, s.t. images can be rendered without any display or OpenGL context.
+class CameraFrame {
+public:
+    CameraFrame() = default;
+    explicit CameraFrame(const Trackball& camera);
+    // Frame of a trackball with the given parameters, which is looking at `lookAt` from `distanceFromLookAt` away,
+    // rotated by Euler angles `rotation` (in radians), with vertical field of view `fovy` (in radians), and a
+    // screen of the given aspect ratio (width over height); see `Trackball::setCamera()`
+    CameraFrame(const glm::vec3& lookAt, const glm::vec3& rotation, float distanceFromLookAt, float fovy, float aspectRatio);
+
+    // Generate a ray from the camera's position through the given position on the image plane, where
+    // (-1, -1) lies at the bottom left of the screen, and (+1, +1) at the top right; see `Trackball::generateRay()`
+    [[nodiscard]] Ray generateRay(const glm::vec2& position) const;
+
+    // Batched version of the above, which writes one ray per image plane position
+    void generateRays(std::span<const glm::vec2> positions, std::span<Ray> rays) const;
+
+    [[nodiscard]] glm::vec3 position() const;
+
+private:
+    glm::vec3 m_origin { 0.0f };
+    glm::vec3 m_right { 1.0f, 0.0f, 0.0f }; // Towards screen-space +x, scaled by half the image plane's width
+    glm::vec3 m_up { 0.0f, 1.0f, 0.0f }; // Towards screen-space +y, scaled by half the image plane's height
+    glm::vec3 m_forward { 0.0f, 0.0f, 1.0f }; // Towards the image plane's center, at unit distance
+};
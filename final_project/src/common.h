@@ -20,6 +20,29 @@ enum class ShadingModel {
     LinearGradientComparison = 4,
 };
 
+enum class TileOrder {
+    Scanline = 0, // Row by row
+    Morton = 1, // Along a Morton curve, s.t. consecutive tiles are close together
+    Spiral = 2, // Outward from the screen's center
+};
+
+enum class TriangleTest {
+    Reference = 0, // The scene's `intersectRayWithTriangle()`
+    PrecomputedEdges = 1, // Moller-Trumbore, with edges precomputed at build time
+    Watertight = 2, // Woop et al.'s watertight test, which never misses between adjacent triangles
+};
+
+enum class SampleSequence {
+    Random = 0, // Independent uniform samples from the pcg hash
+    Sobol = 1, // Owen-scrambled Sobol points, padded per dimension
+};
+
+enum class AreaLightSampling {
+    Uniform = 0, // Independent samples, uniform over the light
+    Stratified = 1, // One jittered sample per stratum of the light
+    SolidAngle = 2, // Stratified samples, distributed proportional to the solid angle the light subtends
+};
+
 struct HitInfo {
     glm::vec3 normal;
     glm::vec3 barycentricCoord;
@@ -46,11 +69,15 @@ struct Sphere {
 struct PointLight {
     glm::vec3 position;
     glm::vec3 color;
+
+    bool operator==(const PointLight&) const = default;
 };
 
 struct SegmentLight {
     glm::vec3 endpoint0, endpoint1; // Positions of endpoints
     glm::vec3 color0, color1; // Color of endpoints
+
+    bool operator==(const SegmentLight&) const = default;
 };
 
 struct ParallelogramLight {
@@ -58,20 +85,68 @@ struct ParallelogramLight {
     glm::vec3 v0; // v0
     glm::vec3 edge01, edge02; // edges from v0 to v1, and from v0 to v2
     glm::vec3 color0, color1, color2, color3;
+
+    bool operator==(const ParallelogramLight&) const = default;
 };
 
 struct ExtraFeatures {
     bool enableBvhSahBinning = false;
+    bool enableBvhLinearBuild = false;
+    bool enableBvhTreeletOptimization = false;
+    bool enableBvhCompactPrimitives = false;
+    bool enableBvhOrderedTraversal = true;
     bool enableBloomEffect = false;
     bool enableDepthOfField = false;
     bool enableEnvironmentMap = false;
     bool enableGlossyReflection = false;
     bool enableMipmapTextureFiltering = false;
     bool enableMotionBlur = false;
+    bool enableAdaptiveSampling = false;
+    bool enableRayPackets = false;
+    bool enableRenderTiles = false;
+    bool enableWavefrontRendering = false;
+    bool enableLightBvh = false;
+    bool enablePackedLights = false;
 
     // Parameters for glossy reflection
     uint32_t numGlossySamples = 1;
 
+    // Parameters for the binned SAH bvh construction
+    uint32_t numBvhSahBins = 16;
+    float bvhSahTraversalCost = 1.0f; // Relative cost of a single ray/node test
+    float bvhSahIntersectionCost = 1.0f; // Relative cost of a single ray/triangle test
+
+    // Parameters for the treelet optimization pass
+    uint32_t bvhTreeletSize = 7; // Nr. of leaves per restructured treelet
+
+    // Branching factor of the traversed bvh; 4 or 8 collapse the binary bvh into a wide one
+    uint32_t bvhWidth = 2;
+
+    // Ray/triangle test used in the leaves of the compact primitive store
+    TriangleTest bvhTriangleTest = TriangleTest::Reference;
+
+    // Nr. of coherent camera rays traced together as a packet; 4, 8, or 16, covering 2x2, 4x2, or 4x4 pixels
+    uint32_t rayPacketSize = 16;
+
+    // Parameters for the tile-based render scheduler
+    uint32_t renderTileSize = 16; // Width and height of a tile in pixels
+    TileOrder renderTileOrder = TileOrder::Morton;
+
+    // Parameters for adaptive pixel sampling
+    float adaptiveSamplingThreshold = 0.02f; // Relative standard error of a pixel's mean luminance at which sampling stops
+    uint32_t adaptiveSamplingMaxSamples = 64; // Nr. of samples a single pixel may take at most
+    bool showAdaptiveSampleMap = false; // Output each pixel's sample count as a heat map, instead of its color
+
+    // Nr. of lights drawn from the light bvh per shading point, instead of evaluating every light
+    uint32_t numLightBvhSamples = 1;
+
+    // Sequence the per-pixel samplers draw from; low-discrepancy sequences converge faster than random samples
+    SampleSequence sampleSequence = SampleSequence::Random;
+
+    // Distribution of the `numShadowSamples` samples taken over segment and parallelogram lights
+    AreaLightSampling areaLightSampling = AreaLightSampling::Uniform;
+
+    bool operator==(const ExtraFeatures&) const = default;
 };
 
 struct Features {
@@ -94,4 +169,6 @@ struct Features {
 
     // Extras-specific settings
     ExtraFeatures extra = {};
+
+    bool operator==(const Features&) const = default;
 };
\ No newline at end of file
@@ -81,6 +81,7 @@ std::ostream& operator<<(std::ostream& os, const Config& config)
        << "  + command_line_rendering: " << config.cliRenderingEnabled << std::endl
        << "  + window_size: " << config.windowSize.x << ", " << config.windowSize.y << std::endl
        << "  + data_path: " << config.dataPath << std::endl
+       << "  + cache_dir: " << config.cacheDir << std::endl
        << "  + scene: ";
 
     if (std::holds_alternative<SceneType>(config.scene)) {
@@ -115,6 +116,31 @@ std::ostream& operator<<(std::ostream& os, const Config& config)
 
 
     os << "    - enable_bvh_sah_binning: " << config.features.extra.enableBvhSahBinning << std::endl;
+    os << "    - bvh_sah_bins: " << config.features.extra.numBvhSahBins << std::endl;
+    os << "    - bvh_sah_traversal_cost: " << config.features.extra.bvhSahTraversalCost << std::endl;
+    os << "    - bvh_sah_intersection_cost: " << config.features.extra.bvhSahIntersectionCost << std::endl;
+    os << "    - enable_bvh_linear_build: " << config.features.extra.enableBvhLinearBuild << std::endl;
+    os << "    - enable_bvh_treelet_optimization: " << config.features.extra.enableBvhTreeletOptimization << std::endl;
+    os << "    - bvh_treelet_size: " << config.features.extra.bvhTreeletSize << std::endl;
+    os << "    - enable_bvh_compact_primitives: " << config.features.extra.enableBvhCompactPrimitives << std::endl;
+    os << "    - enable_bvh_ordered_traversal: " << config.features.extra.enableBvhOrderedTraversal << std::endl;
+    os << "    - bvh_width: " << config.features.extra.bvhWidth << std::endl;
+    os << "    - bvh_triangle_test: " << static_cast<uint32_t>(config.features.extra.bvhTriangleTest) << std::endl;
+    os << "    - enable_ray_packets: " << config.features.extra.enableRayPackets << std::endl;
+    os << "    - ray_packet_size: " << config.features.extra.rayPacketSize << std::endl;
+    os << "    - enable_render_tiles: " << config.features.extra.enableRenderTiles << std::endl;
+    os << "    - render_tile_size: " << config.features.extra.renderTileSize << std::endl;
+    os << "    - render_tile_order: " << static_cast<uint32_t>(config.features.extra.renderTileOrder) << std::endl;
+    os << "    - enable_wavefront_rendering: " << config.features.extra.enableWavefrontRendering << std::endl;
+    os << "    - enable_light_bvh: " << config.features.extra.enableLightBvh << std::endl;
+    os << "    - light_bvh_samples: " << config.features.extra.numLightBvhSamples << std::endl;
+    os << "    - enable_packed_lights: " << config.features.extra.enablePackedLights << std::endl;
+    os << "    - enable_adaptive_sampling: " << config.features.extra.enableAdaptiveSampling << std::endl;
+    os << "    - adaptive_sampling_threshold: " << config.features.extra.adaptiveSamplingThreshold << std::endl;
+    os << "    - adaptive_sampling_max_samples: " << config.features.extra.adaptiveSamplingMaxSamples << std::endl;
+    os << "    - show_adaptive_sample_map: " << config.features.extra.showAdaptiveSampleMap << std::endl;
+    os << "    - sample_sequence: " << static_cast<uint32_t>(config.features.extra.sampleSequence) << std::endl;
+    os << "    - area_light_sampling: " << static_cast<uint32_t>(config.features.extra.areaLightSampling) << std::endl;
     os << "    - enable_bilinear_texture_filtering: " << config.features.enableBilinearTextureFiltering << std::endl;
     os << "    - enable_mipmap_texture_filtering: " << config.features.extra.enableMipmapTextureFiltering << std::endl;
 
@@ -218,6 +244,12 @@ Config readConfigFile(const std::filesystem::path& config_path)
     }
     config.dataPath = data_path;
 
+    std::string cache_dir = table["cache_dir"].value<std::string>().value_or(CACHE_DIR);
+    if (std::strcmp(cache_dir.c_str(), "default") == 0) {
+        cache_dir = CACHE_DIR;
+    }
+    config.cacheDir = cache_dir;
+
     auto scene = table["scene"];
     if (scene.is_number()) {
         auto scene_type = static_cast<SceneType>(scene.as_integer()->get());
@@ -324,6 +356,136 @@ Config readConfigFile(const std::filesystem::path& config_path)
                                                            .as_boolean()
                                                            ->value_or(false);
     }
+    if (table["features"]["extra"]["enable_bvh_sah_binning"]) {
+        config.features.extra.enableBvhSahBinning = table["features"]["extra"]["enable_bvh_sah_binning"]
+                                                        .as_boolean()
+                                                        ->value_or(false);
+    }
+    if (table["features"]["extra"]["bvh_sah_bins"]) {
+        config.features.extra.numBvhSahBins = static_cast<uint32_t>(table["features"]["extra"]["bvh_sah_bins"]
+                                                                        .as_integer()
+                                                                        ->value_or(16));
+    }
+    if (table["features"]["extra"]["bvh_sah_traversal_cost"]) {
+        config.features.extra.bvhSahTraversalCost = table["features"]["extra"]["bvh_sah_traversal_cost"]
+                                                        .value<float>()
+                                                        .value_or(1.0f);
+    }
+    if (table["features"]["extra"]["bvh_sah_intersection_cost"]) {
+        config.features.extra.bvhSahIntersectionCost = table["features"]["extra"]["bvh_sah_intersection_cost"]
+                                                           .value<float>()
+                                                           .value_or(1.0f);
+    }
+    if (table["features"]["extra"]["enable_bvh_linear_build"]) {
+        config.features.extra.enableBvhLinearBuild = table["features"]["extra"]["enable_bvh_linear_build"]
+                                                         .as_boolean()
+                                                         ->value_or(false);
+    }
+    if (table["features"]["extra"]["enable_bvh_treelet_optimization"]) {
+        config.features.extra.enableBvhTreeletOptimization = table["features"]["extra"]["enable_bvh_treelet_optimization"]
+                                                                 .as_boolean()
+                                                                 ->value_or(false);
+    }
+    if (table["features"]["extra"]["bvh_treelet_size"]) {
+        config.features.extra.bvhTreeletSize = static_cast<uint32_t>(table["features"]["extra"]["bvh_treelet_size"]
+                                                                         .as_integer()
+                                                                         ->value_or(7));
+    }
+    if (table["features"]["extra"]["enable_bvh_compact_primitives"]) {
+        config.features.extra.enableBvhCompactPrimitives = table["features"]["extra"]["enable_bvh_compact_primitives"]
+                                                               .as_boolean()
+                                                               ->value_or(false);
+    }
+    if (table["features"]["extra"]["enable_bvh_ordered_traversal"]) {
+        config.features.extra.enableBvhOrderedTraversal = table["features"]["extra"]["enable_bvh_ordered_traversal"]
+                                                              .as_boolean()
+                                                              ->value_or(true);
+    }
+    if (table["features"]["extra"]["bvh_width"]) {
+        config.features.extra.bvhWidth = static_cast<uint32_t>(table["features"]["extra"]["bvh_width"]
+                                                                   .as_integer()
+                                                                   ->value_or(2));
+    }
+    if (table["features"]["extra"]["bvh_triangle_test"]) {
+        config.features.extra.bvhTriangleTest = static_cast<TriangleTest>(table["features"]["extra"]["bvh_triangle_test"]
+                                                                              .as_integer()
+                                                                              ->value_or(0));
+    }
+    if (table["features"]["extra"]["enable_ray_packets"]) {
+        config.features.extra.enableRayPackets = table["features"]["extra"]["enable_ray_packets"]
+                                                     .as_boolean()
+                                                     ->value_or(false);
+    }
+    if (table["features"]["extra"]["ray_packet_size"]) {
+        config.features.extra.rayPacketSize = static_cast<uint32_t>(table["features"]["extra"]["ray_packet_size"]
+                                                                        .as_integer()
+                                                                        ->value_or(16));
+    }
+    if (table["features"]["extra"]["enable_render_tiles"]) {
+        config.features.extra.enableRenderTiles = table["features"]["extra"]["enable_render_tiles"]
+                                                      .as_boolean()
+                                                      ->value_or(false);
+    }
+    if (table["features"]["extra"]["render_tile_size"]) {
+        config.features.extra.renderTileSize = static_cast<uint32_t>(table["features"]["extra"]["render_tile_size"]
+                                                                         .as_integer()
+                                                                         ->value_or(16));
+    }
+    if (table["features"]["extra"]["render_tile_order"]) {
+        config.features.extra.renderTileOrder = static_cast<TileOrder>(table["features"]["extra"]["render_tile_order"]
+                                                                           .as_integer()
+                                                                           ->value_or(1));
+    }
+    if (table["features"]["extra"]["enable_wavefront_rendering"]) {
+        config.features.extra.enableWavefrontRendering = table["features"]["extra"]["enable_wavefront_rendering"]
+                                                             .as_boolean()
+                                                             ->value_or(false);
+    }
+    if (table["features"]["extra"]["enable_light_bvh"]) {
+        config.features.extra.enableLightBvh = table["features"]["extra"]["enable_light_bvh"]
+                                                   .as_boolean()
+                                                   ->value_or(false);
+    }
+    if (table["features"]["extra"]["light_bvh_samples"]) {
+        config.features.extra.numLightBvhSamples = static_cast<uint32_t>(table["features"]["extra"]["light_bvh_samples"]
+                                                                             .as_integer()
+                                                                             ->value_or(1));
+    }
+    if (table["features"]["extra"]["enable_packed_lights"]) {
+        config.features.extra.enablePackedLights = table["features"]["extra"]["enable_packed_lights"]
+                                                       .as_boolean()
+                                                       ->value_or(false);
+    }
+    if (table["features"]["extra"]["enable_adaptive_sampling"]) {
+        config.features.extra.enableAdaptiveSampling = table["features"]["extra"]["enable_adaptive_sampling"]
+                                                           .as_boolean()
+                                                           ->value_or(false);
+    }
+    if (table["features"]["extra"]["adaptive_sampling_threshold"]) {
+        config.features.extra.adaptiveSamplingThreshold = table["features"]["extra"]["adaptive_sampling_threshold"]
+                                                              .value<float>()
+                                                              .value_or(0.02f);
+    }
+    if (table["features"]["extra"]["adaptive_sampling_max_samples"]) {
+        config.features.extra.adaptiveSamplingMaxSamples = static_cast<uint32_t>(table["features"]["extra"]["adaptive_sampling_max_samples"]
+                                                                                     .as_integer()
+                                                                                     ->value_or(64));
+    }
+    if (table["features"]["extra"]["show_adaptive_sample_map"]) {
+        config.features.extra.showAdaptiveSampleMap = table["features"]["extra"]["show_adaptive_sample_map"]
+                                                          .as_boolean()
+                                                          ->value_or(false);
+    }
+    if (table["features"]["extra"]["sample_sequence"]) {
+        config.features.extra.sampleSequence = static_cast<SampleSequence>(table["features"]["extra"]["sample_sequence"]
+                                                                               .as_integer()
+                                                                               ->value_or(0));
+    }
+    if (table["features"]["extra"]["area_light_sampling"]) {
+        config.features.extra.areaLightSampling = static_cast<AreaLightSampling>(table["features"]["extra"]["area_light_sampling"]
+                                                                                     .as_integer()
+                                                                                     ->value_or(0));
+    }
     if (table["features"]["extra"]["enable_mipmap_texture_filtering"]) {
         config.features.extra.enableMipmapTextureFiltering = table["features"]["extra"]["enable_mipmap_texture_filtering"]
                                                                  .as_boolean()
@@ -28,6 +28,7 @@ struct Config {
     bool cliRenderingEnabled = false;
     glm::ivec2 windowSize = { 800, 800 };
     std::filesystem::path dataPath = DATA_DIR;
+    std::filesystem::path cacheDir = CACHE_DIR; // Saved BVHs and parsed meshes; inside the build directory, not next to the data
     std::variant<SceneType, std::filesystem::path> scene = SceneType::SingleTriangle;
     std::filesystem::path outputDir = "";
     std::vector<CameraConfig> cameras;
@@ -3,7 +3,11 @@
 #include "light.h"
 #include "recursive.h"
 #include "shading.h"
-#include <framework/trackball.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
+#include <vector>
 
 // TODO; Extra feature
 // Given the same input as for `renderImage()`, instead render an image with your own implementation
@@ -11,7 +15,7 @@
 // are in play, allowing objects to be in and out of focus.
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-void renderImageWithDepthOfField(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen)
+void renderImageWithDepthOfField(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen)
 {
     if (!features.extra.enableDepthOfField) {
         return;
@@ -26,7 +30,7 @@ void renderImageWithDepthOfField(const Scene& scene, const BVHInterface& bvh, co
 // to give objects the appearance of "fast movement".
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-void renderImageWithMotionBlur(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen)
+void renderImageWithMotionBlur(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen)
 {
     if (!features.extra.enableMotionBlur) {
         return;
@@ -38,7 +42,7 @@ void renderImageWithMotionBlur(const Scene& scene, const BVHInterface& bvh, cons
 // Given a rendered image, compute and apply a bloom post-processing effect to increase bright areas.
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-void postprocessImageWithBloom(const Scene& scene, const Features& features, const Trackball& camera, Screen& image)
+void postprocessImageWithBloom(const Scene& scene, const Features& features, const CameraFrame& camera, Screen& image)
 {
     if (!features.extra.enableBloomEffect) {
         return;
@@ -83,3 +87,293 @@ glm::vec3 sampleEnvironmentMap(RenderState& state, Ray ray)
         return glm::vec3(0.f);
     }
 }
+
+
+// Helper for the binned SAH; describes the cheapest split plane found so far
+struct SAHBinSplit {
+    float cost = std::numeric_limits<float>::max();
+    uint32_t axis = 0;
+    uint32_t bin = 0; // Primitives in bins [0, bin] are placed left of the split
+    float lower = 0.0f; // Lower bound of the centroids along the axis
+    float scale = 0.0f; // Maps a centroid's offset from `lower` to its bin index
+    uint32_t numBins = 0;
+};
+
+// Helper for the binned SAH; returns the bin a centroid falls into along an axis
+static uint32_t computeSAHBinIndex(const SAHBinSplit& split, float centroid)
+{
+    auto bin = static_cast<uint32_t>((centroid - split.lower) * split.scale);
+    return std::min(bin, split.numBins - 1);
+}
+
+// Helper for the binned SAH; bins the primitives' centroids along a single axis, sweeps all
+// bin boundaries as candidate split planes, and updates `best` if a cheaper plane is found.
+// - extra;      the extra features config, providing the bin count and node/triangle cost model
+// - aabb;          the axis-aligned bounding box around the given triangle range
+// - centroidAABB;  the axis-aligned bounding box around the centroids of the given triangle range
+// - axis;          0, 1, or 2, determining on which axis (x, y, or z) to bin
+// - primitives;    the range of triangles that is being split
+// - best;          the cheapest split found so far, updated in place
+static void evaluateSAHBins(const ExtraFeatures& extra, const AxisAlignedBox& aabb, const AxisAlignedBox& centroidAABB, uint32_t axis, std::span<const BVHInterface::Primitive> primitives, SAHBinSplit& best)
+{
+    // Bin over the centroids' extent, not the triangles', so no bins are wasted
+    const float lower = centroidAABB.lower[axis], upper = centroidAABB.upper[axis];
+    if (upper <= lower) {
+        return; // All centroids coincide; no plane along this axis separates them
+    }
+
+    SAHBinSplit split = {
+        .axis = axis,
+        .lower = lower,
+        .numBins = std::max(extra.numBvhSahBins, 2u)
+    };
+    split.scale = static_cast<float>(split.numBins) / (upper - lower);
+
+    struct Bin {
+        AxisAlignedBox aabb = { .lower = glm::vec3(std::numeric_limits<float>::max()), .upper = glm::vec3(std::numeric_limits<float>::lowest()) };
+        uint32_t count = 0;
+    };
+    std::vector<Bin> bins(split.numBins);
+    for (const auto& primitive : primitives) {
+        auto& bin = bins[computeSAHBinIndex(split, computePrimitiveCentroid(primitive)[axis])];
+        auto primitiveAABB = computePrimitiveAABB(primitive);
+        bin.aabb.lower = glm::min(bin.aabb.lower, primitiveAABB.lower);
+        bin.aabb.upper = glm::max(bin.aabb.upper, primitiveAABB.upper);
+        bin.count++;
+    }
+
+    // Sweep from the right, storing the area/count of everything right of each boundary
+    std::vector<float> rightArea(split.numBins);
+    std::vector<uint32_t> rightCount(split.numBins);
+    Bin right;
+    for (uint32_t i = split.numBins - 1; i > 0; i--) {
+        right.aabb.lower = glm::min(right.aabb.lower, bins[i].aabb.lower);
+        right.aabb.upper = glm::max(right.aabb.upper, bins[i].aabb.upper);
+        right.count += bins[i].count;
+        rightArea[i] = computeAABBSurfaceArea(right.aabb);
+        rightCount[i] = right.count;
+    }
+
+    // Sweep from the left, evaluating the cost of splitting after each bin
+    float invParentArea = 1.0f / computeAABBSurfaceArea(aabb);
+    Bin left;
+    for (uint32_t i = 0; i < split.numBins - 1; i++) {
+        left.aabb.lower = glm::min(left.aabb.lower, bins[i].aabb.lower);
+        left.aabb.upper = glm::max(left.aabb.upper, bins[i].aabb.upper);
+        left.count += bins[i].count;
+        if (left.count == 0 || rightCount[i + 1] == 0) {
+            continue;
+        }
+
+        float leftCost = computeAABBSurfaceArea(left.aabb) * static_cast<float>(left.count);
+        float rightCost = rightArea[i + 1] * static_cast<float>(rightCount[i + 1]);
+        float cost = extra.bvhSahTraversalCost + extra.bvhSahIntersectionCost * (leftCost + rightCost) * invParentArea;
+        if (cost < best.cost) {
+            best = split;
+            best.cost = cost;
+            best.bin = i;
+        }
+    }
+}
+
+// Helper for the binned SAH; partitions the primitives around the given split plane
+// and returns the split position, or falls back to a median split if no plane was found
+static size_t partitionPrimitivesBySAHBin(const SAHBinSplit& split, const AxisAlignedBox& aabb, uint32_t fallbackAxis, std::span<BVHInterface::Primitive> primitives)
+{
+    if (split.numBins == 0) {
+        return splitPrimitivesByMedian(aabb, fallbackAxis, primitives);
+    }
+
+    auto middle = std::partition(primitives.begin(), primitives.end(), [&](const BVHInterface::Primitive& primitive) {
+        return computeSAHBinIndex(split, computePrimitiveCentroid(primitive)[split.axis]) <= split.bin;
+    });
+    return static_cast<size_t>(std::distance(primitives.begin(), middle));
+}
+
+// TODO: Extra feature
+// As an alternative to `splitPrimitivesByMedian`, use a SAH+binning splitting criterion. Refer to
+// the `Data Structures` lecture for details on this metric.
+// - aabb;       the axis-aligned bounding box around the given triangle range
+// - axis;       0, 1, or 2, determining on which axis (x, y, or z) the split must happen
+// - primitives; the modifiable range of triangles that requires splitting
+// - return;     the split position of the modified range of triangles
+// This method is unit-tested, so do not change the function signature.
+size_t splitPrimitivesBySAHBin(const AxisAlignedBox& aabb, uint32_t axis, std::span<BVHInterface::Primitive> primitives)
+{
+    SAHBinSplit split;
+    evaluateSAHBins(ExtraFeatures {}, aabb, computeSpanCentroidAABB(primitives), axis, primitives, split);
+    return partitionPrimitivesBySAHBin(split, aabb, axis, primitives);
+}
+
+// As above, but evaluates the binned SAH along all three axes, and picks the cheapest split plane.
+// - extra;      the extra features config, providing the bin count and node/triangle cost model
+// - aabb;       the axis-aligned bounding box around the given triangle range
+// - primitives; the modifiable range of triangles that requires splitting
+// - return;     the split position of the modified range of triangles
+size_t splitPrimitivesBySAHBin(const ExtraFeatures& extra, const AxisAlignedBox& aabb, std::span<BVHInterface::Primitive> primitives)
+{
+    // The centroid bounds are shared by all axes; for large ranges, these are reduced over chunks concurrently
+    const AxisAlignedBox centroidAABB = computeSpanCentroidAABB(primitives);
+
+    // Evaluate each axis independently, concurrently for large ranges; the candidates are then
+    // compared in axis order, s.t. the chosen plane does not depend on thread scheduling
+    std::array<SAHBinSplit, 3> candidates;
+#pragma omp taskloop if (primitives.size() >= BVH::ParallelBuildSize) shared(extra, aabb, centroidAABB, primitives, candidates)
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        evaluateSAHBins(extra, aabb, centroidAABB, axis, primitives, candidates[axis]);
+    }
+
+    SAHBinSplit split;
+    for (const auto& candidate : candidates) {
+        if (candidate.cost < split.cost) {
+            split = candidate;
+        }
+    }
+
+    // SAH termination; a leaf costs an intersection test per triangle, so keep the range whole if no split pays off
+    const float leafCost = extra.bvhSahIntersectionCost * static_cast<float>(primitives.size());
+    if (primitives.size() <= BVH::MaxSahLeafSize && leafCost <= split.cost) {
+        return 0;
+    }
+    return partitionPrimitivesBySAHBin(split, aabb, computeAABBLongestAxis(aabb), primitives);
+}
+
+// Helper for the linear BVH; spreads the lower 21 bits of a value s.t. two zero bits separate each bit
+static uint64_t expandMortonBits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffff;
+    v = (v | v << 16) & 0x1f0000ff0000ff;
+    v = (v | v << 8) & 0x100f00f00f00f00f;
+    v = (v | v << 4) & 0x10c30c30c30c30c3;
+    v = (v | v << 2) & 0x1249249249249249;
+    return v;
+}
+
+// Given a point inside the unit cube, compute its 63-bit Morton code by interleaving 21 bits per axis.
+// - p;      a point with coordinates in [0, 1]
+// - return; the point's position along the Morton (Z-order) curve
+uint64_t computeMortonCode(const glm::vec3& p)
+{
+    constexpr float scale = static_cast<float>(1u << 21);
+    const auto q = glm::clamp(glm::uvec3(glm::clamp(p, 0.0f, 1.0f) * scale), 0u, (1u << 21) - 1u);
+    return expandMortonBits(q.x) << 2 | expandMortonBits(q.y) << 1 | expandMortonBits(q.z);
+}
+
+// Helper for the linear BVH; stable least-significant-digit radix sort of Morton codes and their
+// indices, 8 bits per pass. Fixed-size blocks are counted and scattered concurrently, in block order,
+// so the result does not depend on the nr. of threads.
+static void radixSortMortonCodes(std::vector<uint64_t>& codes, std::vector<uint32_t>& indices)
+{
+    constexpr int blockSize = 1 << 16;
+    constexpr int numDigits = 256;
+    const int n = static_cast<int>(codes.size());
+    const int numBlocks = (n + blockSize - 1) / blockSize;
+
+    std::vector<uint64_t> codesTemp(codes.size());
+    std::vector<uint32_t> indicesTemp(indices.size());
+    std::vector<size_t> offsets(static_cast<size_t>(numBlocks) * numDigits);
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        // Count occurrences of each digit per block
+        std::fill(offsets.begin(), offsets.end(), 0);
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for
+#endif
+        for (int block = 0; block < numBlocks; block++) {
+            size_t* counts = &offsets[static_cast<size_t>(block) * numDigits];
+            for (int i = block * blockSize; i < std::min(n, (block + 1) * blockSize); i++) {
+                counts[(codes[i] >> shift) & 0xff]++;
+            }
+        }
+
+        // Turn counts into scatter offsets, ordered by digit first, and block second;
+        // passes in which all codes share the same digit are skipped
+        size_t sum = 0;
+        bool isSorted = false;
+        for (int digit = 0; digit < numDigits; digit++) {
+            size_t digitBegin = sum;
+            for (int block = 0; block < numBlocks; block++) {
+                size_t count = offsets[static_cast<size_t>(block) * numDigits + digit];
+                offsets[static_cast<size_t>(block) * numDigits + digit] = sum;
+                sum += count;
+            }
+            isSorted |= (sum - digitBegin) == codes.size();
+        }
+        if (isSorted) {
+            continue;
+        }
+
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for
+#endif
+        for (int block = 0; block < numBlocks; block++) {
+            size_t* next = &offsets[static_cast<size_t>(block) * numDigits];
+            for (int i = block * blockSize; i < std::min(n, (block + 1) * blockSize); i++) {
+                size_t j = next[(codes[i] >> shift) & 0xff]++;
+                codesTemp[j] = codes[i];
+                indicesTemp[j] = indices[i];
+            }
+        }
+        std::swap(codes, codesTemp);
+        std::swap(indices, indicesTemp);
+    }
+}
+
+// As an alternative to recursive splitting, sort the triangles along a Morton curve through their centroids,
+// s.t. a linear BVH can be emitted in a single pass by `splitPrimitivesByMortonCode()`.
+// - primitives; the modifiable range of triangles, sorted in place
+// - return;     the sorted Morton codes of the triangles' centroids, normalized to the centroids' bounds
+std::vector<uint64_t> sortPrimitivesByMortonCode(std::span<BVHInterface::Primitive> primitives)
+{
+    const int n = static_cast<int>(primitives.size());
+
+    // Normalize the centroids to their bounding box; flat axes map to zero
+    std::vector<glm::vec3> centroids(primitives.size());
+    AxisAlignedBox bounds = { .lower = glm::vec3(std::numeric_limits<float>::max()), .upper = glm::vec3(std::numeric_limits<float>::lowest()) };
+    for (int i = 0; i < n; i++) {
+        centroids[i] = computePrimitiveCentroid(primitives[i]);
+        bounds.lower = glm::min(bounds.lower, centroids[i]);
+        bounds.upper = glm::max(bounds.upper, centroids[i]);
+    }
+    const glm::vec3 extent = bounds.upper - bounds.lower;
+    const glm::vec3 scale = glm::mix(glm::vec3(0.0f), 1.0f / extent, glm::greaterThan(extent, glm::vec3(0.0f)));
+
+    std::vector<uint64_t> codes(primitives.size());
+    std::vector<uint32_t> indices(primitives.size());
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n; i++) {
+        codes[i] = computeMortonCode((centroids[i] - bounds.lower) * scale);
+        indices[i] = static_cast<uint32_t>(i);
+    }
+    radixSortMortonCodes(codes, indices);
+
+    // Apply the sorted order to the primitives
+    std::vector<BVHInterface::Primitive> sorted(primitives.size());
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n; i++) {
+        sorted[i] = primitives[indices[i]];
+    }
+    std::copy(sorted.begin(), sorted.end(), primitives.begin());
+    return codes;
+}
+
+// Given a range of sorted Morton codes, find the split position at which the highest differing bit
+// flips; this is where a linear BVH splits. Ranges with identical codes are split in the middle.
+// - codes;  the sorted Morton codes of the triangles in the range
+// - return; the split position of the range, such that both subranges are non-empty
+size_t splitPrimitivesByMortonCode(std::span<const uint64_t> codes)
+{
+    const uint64_t diff = codes.front() ^ codes.back();
+    if (diff == 0) {
+        return (codes.size() + 1) / 2;
+    }
+
+    // All codes share the bits above the highest differing bit, so the range is partitioned by that bit
+    const uint64_t mask = std::bit_floor(diff);
+    auto middle = std::partition_point(codes.begin(), codes.end(), [mask](uint64_t code) { return (code & mask) == 0; });
+    return static_cast<size_t>(std::distance(codes.begin(), middle));
+}
@@ -12,7 +12,7 @@
 // are in play, allowing objects to be in and out of focus.
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-void renderImageWithDepthOfField(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen);
+void renderImageWithDepthOfField(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen);
 
 // TODO; Extra feature
 // Given the same input as for `renderImage()`, instead render an image with your own implementation
@@ -20,7 +20,7 @@ void renderImageWithDepthOfField(const Scene& scene, const BVHInterface& bvh, co
 // allowing objects to move during a render, and visualize the appearance of movement.
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-void renderImageWithMotionBlur(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen);
+void renderImageWithMotionBlur(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen);
 
 // TODO; Extra feature
 // Given a rendered image, compute and apply a bloom post-processing effect to increase bright areas.
@@ -28,7 +28,7 @@ void renderImageWithMotionBlur(const Scene& scene, const BVHInterface& bvh, cons
 // not go on a hunting expedition for your implementation, so please keep it here!
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-void postprocessImageWithBloom(const Scene& scene, const Features& features, const Trackball& camera, Screen& screen);
+void postprocessImageWithBloom(const Scene& scene, const Features& features, const CameraFrame& camera, Screen& screen);
 
 // TODO; Extra feature
 // Given a camera ray (or reflected camera ray) and an intersection, evaluates the contribution of a set of
@@ -53,4 +53,17 @@ glm::vec3 sampleEnvironmentMap(RenderState& state, Ray ray);
 // the `Data Structures` lecture for details on this metric.
 // For a description of the method's arguments, refer to 'bounding_volume_hierarchy.cpp'
 // NOTE: this method is unit-tested, so do not change the function signature.
-size_t splitPrimitivesBySAHBin(const AxisAlignedBox& aabb, uint32_t axis, std::span<BVHInterface::Primitive> primitives);
\ No newline at end of file
+size_t splitPrimitivesBySAHBin(const AxisAlignedBox& aabb, uint32_t axis, std::span<BVHInterface::Primitive> primitives);
+// As above, but evaluates the binned SAH along all three axes and picks the cheapest split plane,
+// using the bin count and node/triangle cost model from the extra features configuration.
+// Falls back to `splitPrimitivesByMedian` along the longest axis if no split plane separates the range.
+// Returns 0 if the range is small enough, and cheaper to intersect as a single leaf than to split at all.
+size_t splitPrimitivesBySAHBin(const ExtraFeatures& extra, const AxisAlignedBox& aabb, std::span<BVHInterface::Primitive> primitives);
+
+// Given a point inside the unit cube, compute its 63-bit Morton code by interleaving 21 bits per axis.
+uint64_t computeMortonCode(const glm::vec3& p);
+// As an alternative to recursive splitting, sort the triangles along a Morton curve through their centroids,
+// using a parallel radix sort, and return the sorted codes. Used by the linear BVH builder.
+std::vector<uint64_t> sortPrimitivesByMortonCode(std::span<BVHInterface::Primitive> primitives);
+// Given a range of sorted Morton codes, return the split position at which the highest differing bit flips.
+size_t splitPrimitivesByMortonCode(std::span<const uint64_t> codes);
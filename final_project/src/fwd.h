@@ -2,7 +2,10 @@
 
 // Forward declarations used throughout the program
 struct BVHInterface;
+class CameraFrame;
 struct Image;
+class LightBVH;
+class PackedLights;
 struct Features;
 struct RenderState;
 struct Scene;
@@ -1,8 +1,11 @@
 #include "light.h"
+#include "bvh.h"
 #include "bvh_interface.h"
 #include "config.h"
 #include "draw.h"
 #include "intersect.h"
+#include "light_bvh.h"
+#include "packed_lights.h"
 #include "render.h"
 #include "scene.h"
 #include "shading.h"
@@ -11,6 +14,9 @@
 DISABLE_WARNINGS_PUSH()
 #include <glm/geometric.hpp>
 DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <numbers>
 
 
 // TODO: Standard feature
@@ -62,9 +68,10 @@ bool visibilityOfLightSampleBinary(RenderState& state, const glm::vec3& lightPos
         // Shadows are disabled in the renderer
         return true;
     } else {
-        // Shadows are enabled in the renderer
-        // TODO: implement this function; currently, the light simply passes through
-        return true;
+        // Shadows are enabled in the renderer; any hit along the shadow ray blocks the light, so an
+        // any-hit query suffices, and the closest hit is never searched for.
+        Ray shadowRay = generateShadowRay(lightPosition, ray, hitInfo);
+        return !isRayOccludedInBVH(state, state.bvh, shadowRay, shadowRay.t);
     }
 }
 
@@ -117,7 +124,8 @@ glm::vec3 computeContributionPointLight(RenderState& state, const PointLight& li
 // by integrating over the segment, taking `numSamples` samples from the light source.
 //
 // Hint: you can sample the light by using `sampleSegmentLight(state.sampler.next_1d(), ...);`, which
-//       you should implement first.
+//       you should implement first. To support `features.extra.areaLightSampling`, draw samples with
+//       `drawSegmentLightSample()` instead, and multiply each sample's contribution by the weight it returns.
 // Hint: you should use `visibilityOfLightSample()` to account for shadows, and if the sample is visible, use
 //       the result of `computeShading()`, whose submethods you should probably implement first in `shading.cpp`.
 //
@@ -140,9 +148,9 @@ glm::vec3 computeContributionSegmentLight(RenderState& state, const SegmentLight
     glm::vec3 p = ray.origin + ray.t * ray.direction + 0.001f * hitInfo.normal;
     for (auto i = 0; i < numSamples; ++i) {
         glm::vec3 lightPos, lightColor;
-        sampleSegmentLight(state.sampler.next_1d(), light, lightPos, lightColor);
+        float weight = drawSegmentLightSample(state, light, p, i, numSamples, lightPos, lightColor);
         glm::vec3 l = glm::normalize(lightPos - p);
-        glm::vec3 Li = computeShading(state, v, l, lightColor, hitInfo);
+        glm::vec3 Li = weight * computeShading(state, v, l, lightColor, hitInfo);
         result += visibilityOfLightSample(state, lightPos, Li, ray, hitInfo);
     }
     return result / float(numSamples);
@@ -154,7 +162,8 @@ glm::vec3 computeContributionSegmentLight(RenderState& state, const SegmentLight
 // shading.
 //
 // Hint: you can sample the light by using `sampleParallelogramLight(state.sampler.next_1d(), ...);`, which
-//       you should implement first.
+//       you should implement first. To support `features.extra.areaLightSampling`, draw samples with
+//       `drawParallelogramLightSample()` instead, and multiply each sample's contribution by the weight it returns.
 // Hint: you should use `visibilityOfLightSample()` to account for shadows, and if the sample is visible, use
 //       the result of `computeShading()`, whose submethods you should probably implement first in `shading.cpp`.
 //
@@ -168,11 +177,21 @@ glm::vec3 computeContributionSegmentLight(RenderState& state, const SegmentLight
 // This method is unit-tested, so do not change the function signature.
 glm::vec3 computeContributionParallelogramLight(RenderState& state, const ParallelogramLight& light, const Ray& ray, const HitInfo& hitInfo, uint32_t numSamples)
 {
-    // TODO: implement this function; repeat numSamples times:
-    // - sample the parallellogram light
+    // Repeat numSamples times:
+    // - sample the parallelogram light
     // - test the sample's visibility
     // - then evaluate the phong model
-    return glm::vec3(0);
+    glm::vec3 result(0);
+    glm::vec3 v = -ray.direction;
+    glm::vec3 p = ray.origin + ray.t * ray.direction + 0.001f * hitInfo.normal;
+    for (uint32_t i = 0; i < numSamples; ++i) {
+        glm::vec3 lightPos, lightColor;
+        float weight = drawParallelogramLightSample(state, light, p, i, numSamples, lightPos, lightColor);
+        glm::vec3 l = glm::normalize(lightPos - p);
+        glm::vec3 Li = weight * computeShading(state, v, l, lightColor, hitInfo);
+        result += visibilityOfLightSample(state, lightPos, Li, ray, hitInfo);
+    }
+    return result / float(numSamples);
 }
 
 // This function is provided as-is. You do not have to implement it.
@@ -202,19 +221,233 @@ glm::vec3 visibilityOfLightSample(RenderState& state, const glm::vec3& lightPosi
     }
 }
 
+// Below these, solid-angle sampling falls back to uniform sampling; such small lights look nearly the same from every
+// position on them, and the mappings onto the subtended angle lose precision
+constexpr float MinSubtendedAngle = 1e-3f; // Radians
+constexpr float MinSubtendedSolidAngle = 1e-3f; // Steradians
+
+// Given a segment light, a shading position, and a uniformly distributed 1d sample in [0, 1), writes a parameter along
+// the segment, distributed uniformly over the angle the segment subtends at the shading position. Seen from the
+// shading position, a point at `offset` from the closest point on the segment's line lies at angle atan(offset /
+// distance), so the sample's density along the segment is distance / ((distance^2 + offset^2) * subtended angle).
+// - sample;          a uniformly distributed 1d sample in [0, 1)
+// - light;           the SegmentLight object, see `common.h`
+// - shadingPosition; the position the light is sampled for
+// - parameter;       reference return value of the sampled parameter along the segment, in [0, 1]
+// - return;          the sample's weight, i.e. the uniform density over the density it was drawn with
+float sampleSegmentLightSolidAngle(const float& sample, const SegmentLight& light, const glm::vec3& shadingPosition, float& parameter)
+{
+    const glm::vec3 edge = light.endpoint1 - light.endpoint0;
+    const float length = glm::length(edge);
+    const glm::vec3 direction = edge / length;
+
+    // Closest point on the segment's line, and the angles of the endpoints relative to it
+    const float closest = glm::dot(shadingPosition - light.endpoint0, direction);
+    const float distance = glm::length(shadingPosition - (light.endpoint0 + closest * direction));
+    const float angle0 = std::atan2(-closest, distance), angle1 = std::atan2(length - closest, distance);
+    if (!(distance > 1e-6f * length) || !(angle1 - angle0 > MinSubtendedAngle)) {
+        parameter = sample;
+        return 1.0f;
+    }
+
+    const float offset = distance * std::tan(glm::mix(angle0, angle1, sample));
+    parameter = std::clamp((closest + offset) / length, 0.0f, 1.0f);
+    return (angle1 - angle0) * (distance * distance + offset * offset) / (distance * length);
+}
+
+// Spherical triangle between three unit directions, with its solid angle and its angle at vertex a
+struct SphericalTriangle {
+    glm::vec3 a, b, c;
+    float alpha;
+    float solidAngle;
+};
+
+static SphericalTriangle sphericalTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    // The angle at each vertex is the angle between the planes through its two edges
+    const glm::vec3 nab = glm::normalize(glm::cross(a, b)), nbc = glm::normalize(glm::cross(b, c)), nca = glm::normalize(glm::cross(c, a));
+    const float alpha = std::acos(std::clamp(-glm::dot(nab, nca), -1.0f, 1.0f));
+    const float beta = std::acos(std::clamp(-glm::dot(nbc, nab), -1.0f, 1.0f));
+    const float gamma = std::acos(std::clamp(-glm::dot(nca, nbc), -1.0f, 1.0f));
+    return { a, b, c, alpha, std::max(alpha + beta + gamma - std::numbers::pi_v<float>, 0.0f) };
+}
+
+// Given a uniformly distributed 2d sample in [0, 1), returns a direction distributed uniformly over the solid angle of
+// the spherical triangle; Arvo, "Stratified Sampling of Spherical Triangles", SIGGRAPH 1995
+static glm::vec3 sampleSphericalTriangle(const SphericalTriangle& triangle, const glm::vec2& sample)
+{
+    const auto& [a, b, c, alpha, solidAngle] = triangle;
+
+    // Find the vertex c' along the arc from a to c, s.t. the sub-triangle abc' has the sampled fraction of the solid angle
+    const float s = std::sin(sample.x * solidAngle - alpha), t = std::cos(sample.x * solidAngle - alpha);
+    const float u = t - std::cos(alpha), v = s + std::sin(alpha) * glm::dot(a, b);
+    const float q = std::clamp(((v * t - u * s) * std::cos(alpha) - v) / ((v * s + u * t) * std::sin(alpha)), -1.0f, 1.0f);
+    const glm::vec3 cPrime = q * a + std::sqrt(1.0f - q * q) * glm::normalize(c - glm::dot(c, a) * a);
+
+    // Then pick a point along the arc from b to c', s.t. directions are uniform over the sub-triangle's edge
+    const float z = 1.0f - sample.y * (1.0f - glm::dot(cPrime, b));
+    return z * b + std::sqrt(std::max(1.0f - z * z, 0.0f)) * glm::normalize(cPrime - glm::dot(cPrime, b) * b);
+}
+
+// Given a parallelogram light, a shading position, and a uniformly distributed 2d sample in [0, 1), writes parameters
+// along the light's edges, distributed uniformly over the solid angle the light subtends at the shading position. The
+// light is split into two triangles, one of which is picked proportional to its solid angle, and sampled by Arvo's
+// method. Over the light's area, the sample's density is then |cos theta| / (distance^2 * solid angle).
+// - sample;          a uniformly distributed 2d sample in [0, 1)
+// - light;           the ParallelogramLight object, see `common.h`
+// - shadingPosition; the position the light is sampled for
+// - parameter;       reference return value of the sampled parameters along edge01 and edge02, in [0, 1]
+// - return;          the sample's weight, i.e. the uniform density over the density it was drawn with
+float sampleParallelogramLightSolidAngle(const glm::vec2& sample, const ParallelogramLight& light, const glm::vec3& shadingPosition, glm::vec2& parameter)
+{
+    const glm::vec3 v1 = light.v0 + light.edge01, v2 = light.v0 + light.edge02, v3 = v1 + light.edge02;
+    const auto toUnit = [&](const glm::vec3& vertex) { return glm::normalize(vertex - shadingPosition); };
+    const SphericalTriangle triangle0 = sphericalTriangle(toUnit(light.v0), toUnit(v1), toUnit(v2));
+    const SphericalTriangle triangle1 = sphericalTriangle(toUnit(v3), toUnit(v2), toUnit(v1));
+    const float solidAngle = triangle0.solidAngle + triangle1.solidAngle;
+    if (!(solidAngle > MinSubtendedSolidAngle)) {
+        parameter = sample;
+        return 1.0f;
+    }
+
+    // Pick either triangle proportional to its solid angle, and rescale the sample to sample the triangle itself
+    const float fraction0 = triangle0.solidAngle / solidAngle;
+    const glm::vec3 direction = sample.x < fraction0
+        ? sampleSphericalTriangle(triangle0, { sample.x / fraction0, sample.y })
+        : sampleSphericalTriangle(triangle1, { (sample.x - fraction0) / (1.0f - fraction0), sample.y });
+
+    // Intersect the light's plane, and express the intersection along the light's edges
+    const glm::vec3 normal = glm::cross(light.edge01, light.edge02);
+    const float cosine = glm::dot(direction, normal); // Scaled by the light's area
+    const float distance = glm::dot(light.v0 - shadingPosition, normal) / cosine;
+    const glm::vec3 offset = shadingPosition + distance * direction - light.v0;
+    parameter = glm::vec2(glm::dot(glm::cross(offset, light.edge02), normal), glm::dot(glm::cross(light.edge01, offset), normal)) / glm::dot(normal, normal);
+    parameter = glm::clamp(parameter, 0.0f, 1.0f);
+    return solidAngle * distance * distance / std::abs(cosine);
+}
+
+// Jitter a 2d sample inside the stratum with the given index, out of a grid of `numSamples` strata that is as close to
+// square as the nr. of samples allows
+static glm::vec2 stratifySample(const glm::vec2& sample, uint32_t sampleIndex, uint32_t numSamples)
+{
+    auto columns = static_cast<uint32_t>(std::sqrt(static_cast<float>(numSamples)));
+    while (numSamples % columns != 0) {
+        columns--;
+    }
+    const uint32_t rows = numSamples / columns;
+    return (glm::vec2(sampleIndex % columns, sampleIndex / columns) + sample) / glm::vec2(columns, rows);
+}
+
+// Given a segment light, draws the sample with the given index out of `numSamples`, dependent on
+// `features.extra.areaLightSampling`; uniform sampling matches `sampleSegmentLight(state.sampler.next_1d(), ...)`.
+// - state;           the active scene, feature config, bvh, and a thread-safe sampler
+// - light;           the SegmentLight object, see `common.h`
+// - shadingPosition; the position the light is sampled for
+// - sampleIndex;     the index of the sample, in [0, numSamples)
+// - numSamples;      the nr. of samples taken over the light
+// - position;        reference return value of the sampled position on the light
+// - color;           reference return value of the color emitted by the light at the sampled position
+// - return;          the weight by which the sample's contribution must be multiplied
+float drawSegmentLightSample(RenderState& state, const SegmentLight& light, const glm::vec3& shadingPosition, uint32_t sampleIndex, uint32_t numSamples, glm::vec3& position, glm::vec3& color)
+{
+    float sample = state.sampler.next_1d();
+    float parameter = sample, weight = 1.0f;
+    if (state.features.extra.areaLightSampling != AreaLightSampling::Uniform) {
+        sample = (static_cast<float>(sampleIndex) + sample) / static_cast<float>(numSamples);
+        parameter = sample;
+    }
+    if (state.features.extra.areaLightSampling == AreaLightSampling::SolidAngle) {
+        weight = sampleSegmentLightSolidAngle(sample, light, shadingPosition, parameter);
+    }
+    sampleSegmentLight(parameter, light, position, color);
+    return weight;
+}
+
+// Given a parallelogram light, draws the sample with the given index out of `numSamples`, dependent on
+// `features.extra.areaLightSampling`; uniform sampling matches `sampleParallelogramLight(state.sampler.next_2d(), ...)`.
+// - state;           the active scene, feature config, bvh, and a thread-safe sampler
+// - light;           the ParallelogramLight object, see `common.h`
+// - shadingPosition; the position the light is sampled for
+// - sampleIndex;     the index of the sample, in [0, numSamples)
+// - numSamples;      the nr. of samples taken over the light
+// - position;        reference return value of the sampled position on the light
+// - color;           reference return value of the color emitted by the light at the sampled position
+// - return;          the weight by which the sample's contribution must be multiplied
+float drawParallelogramLightSample(RenderState& state, const ParallelogramLight& light, const glm::vec3& shadingPosition, uint32_t sampleIndex, uint32_t numSamples, glm::vec3& position, glm::vec3& color)
+{
+    glm::vec2 sample = state.sampler.next_2d();
+    glm::vec2 parameter = sample;
+    float weight = 1.0f;
+    if (state.features.extra.areaLightSampling != AreaLightSampling::Uniform) {
+        sample = stratifySample(sample, sampleIndex, numSamples);
+        parameter = sample;
+    }
+    if (state.features.extra.areaLightSampling == AreaLightSampling::SolidAngle) {
+        weight = sampleParallelogramLightSolidAngle(sample, light, shadingPosition, parameter);
+    }
+    sampleParallelogramLight(parameter, light, position, color);
+    return weight;
+}
+
+// Evaluates the contribution of a single light of any type, by forwarding to the matching function above
+static glm::vec3 computeContributionLight(RenderState& state, const Scene::SceneLight& light, const Ray& ray, const HitInfo& hitInfo)
+{
+    if (std::holds_alternative<PointLight>(light)) {
+        return computeContributionPointLight(state, std::get<PointLight>(light), ray, hitInfo);
+    } else if (std::holds_alternative<SegmentLight>(light)) {
+        return computeContributionSegmentLight(state, std::get<SegmentLight>(light), ray, hitInfo, state.features.numShadowSamples);
+    } else if (std::holds_alternative<ParallelogramLight>(light)) {
+        return computeContributionParallelogramLight(state, std::get<ParallelogramLight>(light), ray, hitInfo, state.features.numShadowSamples);
+    }
+    return glm::vec3(0.0f);
+}
+
 // This function is provided as-is. You do not have to implement it.
+// With the light bvh enabled, only `features.extra.numLightBvhSamples` lights are drawn from the hierarchy, and
+// each one's contribution is divided by the probability with which it was drawn; this estimates the sum over all
+// lights without bias, at a cost logarithmic in the nr. of lights. With packed lights enabled, lights are evaluated
+// by the batched kernels of `PackedLights`, instead of one by one.
 glm::vec3 computeLightContribution(RenderState& state, const Ray& ray, const HitInfo& hitInfo)
 {
-    // Iterate over all lights
+    const bool usePackedLights = state.features.extra.enablePackedLights && state.packedLights;
+    const auto computeContributionLightIndex = [&](uint32_t lightIndex) {
+        return usePackedLights ? state.packedLights->computeContribution(state, lightIndex, ray, hitInfo)
+                               : computeContributionLight(state, state.scene.lights[lightIndex], ray, hitInfo);
+    };
+
     glm::vec3 Lo { 0.0f };
-    for (const auto& light : state.scene.lights) {
-        if (std::holds_alternative<PointLight>(light)) {
-            Lo += computeContributionPointLight(state, std::get<PointLight>(light), ray, hitInfo);
-        } else if (std::holds_alternative<SegmentLight>(light)) {
-            Lo += computeContributionSegmentLight(state, std::get<SegmentLight>(light), ray, hitInfo, state.features.numShadowSamples);
-        } else if (std::holds_alternative<ParallelogramLight>(light)) {
-            Lo += computeContributionParallelogramLight(state, std::get<ParallelogramLight>(light), ray, hitInfo, state.features.numShadowSamples);
+    if (state.features.extra.enableLightBvh && state.lightBvh) {
+        // Draw a few lights, dependent on their power
+        const uint32_t numSamples = std::max(state.features.extra.numLightBvhSamples, 1u);
+        for (uint32_t i = 0; i < numSamples; i++) {
+            if (auto sample = state.lightBvh->sample(state.sampler.next_1d())) {
+                Lo += computeContributionLightIndex(sample->lightIndex) / sample->pdf;
+            }
         }
+        return Lo / static_cast<float>(numSamples);
+    }
+
+    if (usePackedLights) {
+        return state.packedLights->computeContribution(state, ray, hitInfo);
+    }
+
+    // Iterate over all lights
+    for (const auto& light : state.scene.lights) {
+        Lo += computeContributionLight(state, light, ray, hitInfo);
     }
     return Lo;
+}
+
+// Given a sampled position on some light, and an incident ray and its intersection, returns a shadow ray
+// from the intersection towards the light, offset along the normal to avoid self-intersection.
+// - lightPosition; the sampled position on some light source
+// - ray;           the incident ray to the current intersection
+// - hitInfo;       information about the current intersection
+// - return;        the shadow ray, whose distance `t` stops just short of the light
+Ray generateShadowRay(const glm::vec3& lightPosition, const Ray& ray, const HitInfo& hitInfo)
+{
+    glm::vec3 p = ray.origin + ray.t * ray.direction + 0.001f * hitInfo.normal;
+    glm::vec3 toLight = lightPosition - p;
+    float distance = glm::length(toLight);
+    return { .origin = p, .direction = toLight / distance, .t = distance - 0.001f };
 }
\ No newline at end of file
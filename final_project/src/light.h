@@ -72,9 +72,37 @@ glm::vec3 computeContributionParallelogramLight(RenderState& state, const Parall
 // This method is unit-tested, so do not change the function signature.
 glm::vec3 visibilityOfLightSample(RenderState& state, const glm::vec3& lightPosition, const glm::vec3& lightColor, const Ray& ray, const HitInfo& hitInfo);
 
+// Given a segment light, a shading position, and a uniformly distributed 1d sample in [0, 1), writes a parameter along
+// the segment in [0, 1], distributed proportional to the angle the segment subtends at the shading position; returns
+// the weight of the sample, i.e. the ratio of the uniform density over the density it was drawn with.
+// For a description of the method's arguments, refer to 'light.cpp'
+float sampleSegmentLightSolidAngle(const float& sample, const SegmentLight& segmentLight, const glm::vec3& shadingPosition, float& parameter);
+
+// Given a parallelogram light, a shading position, and a uniformly distributed 2d sample in [0, 1), writes parameters
+// along the light's edges in [0, 1], distributed proportional to the solid angle the light subtends at the shading
+// position; returns the weight of the sample, i.e. the ratio of the uniform density over the density it was drawn with.
+// For a description of the method's arguments, refer to 'light.cpp'
+float sampleParallelogramLightSolidAngle(const glm::vec2& sample, const ParallelogramLight& parallelogramLight, const glm::vec3& shadingPosition, glm::vec2& parameter);
+
+// Given a segment light, draws the sample with the given index out of `numSamples` with the strategy selected by
+// `features.extra.areaLightSampling`, and writes its position and color through `sampleSegmentLight()`; returns the
+// weight by which the sample's contribution must be multiplied.
+// For a description of the method's arguments, refer to 'light.cpp'
+float drawSegmentLightSample(RenderState& state, const SegmentLight& segmentLight, const glm::vec3& shadingPosition, uint32_t sampleIndex, uint32_t numSamples, glm::vec3& position, glm::vec3& color);
+
+// Given a parallelogram light, draws the sample with the given index out of `numSamples` with the strategy selected by
+// `features.extra.areaLightSampling`, and writes its position and color through `sampleParallelogramLight()`; returns
+// the weight by which the sample's contribution must be multiplied.
+// For a description of the method's arguments, refer to 'light.cpp'
+float drawParallelogramLightSample(RenderState& state, const ParallelogramLight& parallelogramLight, const glm::vec3& shadingPosition, uint32_t sampleIndex, uint32_t numSamples, glm::vec3& position, glm::vec3& color);
+
 // This function is provided as-is. You do not have to implement it.
 // Given an incident ray and an intersection, accumulates the contribution of all lights in the scene
 // with respect to this ray and intersection. The contributions of individual light types are computed
 // in `computeContributionPointLight()`, computeContributionSegmentLight()`, and
 // `computeContributionParallelogramLight()`, which you must implement yourself.
-glm::vec3 computeLightContribution(RenderState& state, const Ray& ray, const HitInfo& hitInfo);
\ No newline at end of file
+glm::vec3 computeLightContribution(RenderState& state, const Ray& ray, const HitInfo& hitInfo);
+
+// Given a sampled position on some light, and an incident ray and its intersection, returns the shadow ray
+// traced by `visibilityOfLightSampleBinary()`; its distance `t` is the range in which a hit occludes the light.
+Ray generateShadowRay(const glm::vec3& lightPosition, const Ray& ray, const HitInfo& hitInfo);
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "light_bvh.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <limits>
+
+struct LightBVH::BuildLight {
+    AxisAlignedBox aabb;
+    glm::vec3 centroid;
+    float power;
+    uint32_t index;
+};
+
+// Luminance of a light's mean color; the renderer averages the samples it takes over segment and parallelogram lights,
+// so their size does not scale their contribution, and only their color matters
+static float lightPower(const Scene::SceneLight& light)
+{
+    constexpr glm::vec3 luminance { 0.2126f, 0.7152f, 0.0722f };
+    if (std::holds_alternative<PointLight>(light)) {
+        return glm::dot(luminance, std::get<PointLight>(light).color);
+    } else if (std::holds_alternative<SegmentLight>(light)) {
+        const auto& segment = std::get<SegmentLight>(light);
+        return glm::dot(luminance, 0.5f * (segment.color0 + segment.color1));
+    } else {
+        const auto& parallelogram = std::get<ParallelogramLight>(light);
+        return glm::dot(luminance, 0.25f * (parallelogram.color0 + parallelogram.color1 + parallelogram.color2 + parallelogram.color3));
+    }
+}
+
+static AxisAlignedBox lightBounds(const Scene::SceneLight& light)
+{
+    if (std::holds_alternative<PointLight>(light)) {
+        const auto& point = std::get<PointLight>(light);
+        return { point.position, point.position };
+    } else if (std::holds_alternative<SegmentLight>(light)) {
+        const auto& segment = std::get<SegmentLight>(light);
+        return { glm::min(segment.endpoint0, segment.endpoint1), glm::max(segment.endpoint0, segment.endpoint1) };
+    } else {
+        const auto& parallelogram = std::get<ParallelogramLight>(light);
+        const glm::vec3 v1 = parallelogram.v0 + parallelogram.edge01, v2 = parallelogram.v0 + parallelogram.edge02;
+        const glm::vec3 v3 = v1 + parallelogram.edge02;
+        return { glm::min(glm::min(parallelogram.v0, v1), glm::min(v2, v3)), glm::max(glm::max(parallelogram.v0, v1), glm::max(v2, v3)) };
+    }
+}
+
+LightBVH::LightBVH(std::span<const Scene::SceneLight> lights)
+{
+    std::vector<BuildLight> buildLights;
+    buildLights.reserve(lights.size());
+    for (size_t i = 0; i < lights.size(); i++) {
+        const AxisAlignedBox aabb = lightBounds(lights[i]);
+        buildLights.push_back({ aabb, 0.5f * (aabb.lower + aabb.upper), std::max(lightPower(lights[i]), 0.0f), static_cast<uint32_t>(i) });
+    }
+
+    m_lightNodes.resize(lights.size());
+    if (!buildLights.empty()) {
+        m_nodes.reserve(2 * buildLights.size() - 1);
+        m_parents.reserve(2 * buildLights.size() - 1);
+        buildRecursive(buildLights, 0);
+    }
+}
+
+uint32_t LightBVH::buildRecursive(std::span<BuildLight> lights, uint32_t parentIndex)
+{
+    const auto nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_parents.push_back(parentIndex);
+
+    if (lights.size() == 1) {
+        m_nodes[nodeIndex] = { .aabb = lights[0].aabb, .power = lights[0].power, .data = Node::LeafBit | lights[0].index };
+        m_lightNodes[lights[0].index] = nodeIndex;
+        return nodeIndex;
+    }
+
+    // Split at the median centroid along the longest axis of the centroids' bounds
+    AxisAlignedBox centroidBounds { lights[0].centroid, lights[0].centroid };
+    for (const auto& light : lights) {
+        centroidBounds.lower = glm::min(centroidBounds.lower, light.centroid);
+        centroidBounds.upper = glm::max(centroidBounds.upper, light.centroid);
+    }
+    const glm::vec3 extent = centroidBounds.upper - centroidBounds.lower;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    const auto middle = lights.begin() + lights.size() / 2;
+    std::nth_element(lights.begin(), middle, lights.end(), [axis](const BuildLight& a, const BuildLight& b) { return a.centroid[axis] < b.centroid[axis]; });
+
+    const uint32_t leftIndex = buildRecursive(lights.first(lights.size() / 2), nodeIndex);
+    const uint32_t rightIndex = buildRecursive(lights.subspan(lights.size() / 2), nodeIndex);
+    const Node &left = m_nodes[leftIndex], &right = m_nodes[rightIndex];
+    m_nodes[nodeIndex] = {
+        .aabb = { glm::min(left.aabb.lower, right.aabb.lower), glm::max(left.aabb.upper, right.aabb.upper) },
+        .power = left.power + right.power,
+        .data = rightIndex
+    };
+    return nodeIndex;
+}
+
+// The node's power. The renderer applies no distance falloff to lights, and with shading disabled, neither a cosine
+// term; a light's power is thus the one estimate of its contribution that holds at every shading point.
+float LightBVH::importance(uint32_t nodeIndex) const
+{
+    return m_nodes[nodeIndex].power;
+}
+
+// Given a uniformly distributed 1d sample in [0, 1), draw a single light with a probability proportional to its power.
+// - sample; a uniformly distributed 1d sample in [0, 1), which is rescaled and reused at every level
+// - return; the index of the drawn light in the scene and its probability, or nothing if no light emits
+std::optional<LightBVH::LightSample> LightBVH::sample(float sample) const
+{
+    constexpr float OneMinusEpsilon = 1.0f - std::numeric_limits<float>::epsilon() / 2.0f;
+    if (m_nodes.empty() || m_nodes[0].power <= 0.0f)
+        return {};
+
+    uint32_t nodeIndex = 0;
+    float pdf = 1.0f;
+    while (!m_nodes[nodeIndex].isLeaf()) {
+        const uint32_t leftIndex = nodeIndex + 1, rightIndex = m_nodes[nodeIndex].rightChild();
+        const float leftImportance = importance(leftIndex), rightImportance = importance(rightIndex);
+        const float leftProbability = leftImportance / (leftImportance + rightImportance);
+        if (sample < leftProbability) {
+            sample = sample / leftProbability;
+            pdf *= leftProbability;
+            nodeIndex = leftIndex;
+        } else {
+            sample = (sample - leftProbability) / (1.0f - leftProbability);
+            pdf *= 1.0f - leftProbability;
+            nodeIndex = rightIndex;
+        }
+        sample = std::min(sample, OneMinusEpsilon);
+    }
+    return LightSample { .lightIndex = m_nodes[nodeIndex].lightIndex(), .pdf = pdf };
+}
+
+float LightBVH::pdf(uint32_t lightIndex) const
+{
+    if (lightIndex >= m_lightNodes.size() || m_nodes[0].power <= 0.0f)
+        return 0.0f;
+
+    // Walk up from the light's leaf, and multiply the probabilities of the choices that lead to it
+    float pdf = 1.0f;
+    for (uint32_t nodeIndex = m_lightNodes[lightIndex]; nodeIndex != 0;) {
+        const uint32_t parentIndex = m_parents[nodeIndex];
+        const uint32_t leftIndex = parentIndex + 1, rightIndex = m_nodes[parentIndex].rightChild();
+        const float leftImportance = importance(leftIndex), rightImportance = importance(rightIndex);
+        pdf *= (nodeIndex == leftIndex ? leftImportance : rightImportance) / (leftImportance + rightImportance);
+        nodeIndex = parentIndex;
+    }
+    return pdf;
+}
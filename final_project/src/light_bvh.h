@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+#include "scene.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Hierarchy over the scene's lights, for importance sampling many lights. Each node bounds its lights and sums
+// their power; a light is drawn by descending from the root, and picking either child with a probability
+// proportional to its power. Drawing a light, and its exact probability, thus takes O(log n) steps, instead of
+// evaluating all n lights at every hit.
+class LightBVH {
+public:
+    // Node of the hierarchy; the left child of a node directly follows it, as nodes are stored in depth-first order
+    struct Node {
+        // A flag bit used to distinguish nodes and leaves
+        static constexpr uint32_t LeafBit = 1u << 31;
+
+        AxisAlignedBox aabb; // Bounds of the node's lights
+        float power; // Summed luminance of the node's lights
+        uint32_t data; // Leaf: LeafBit | index of its light in the scene; node: index of the right child
+
+        [[nodiscard]] constexpr bool isLeaf() const { return (data & LeafBit) == LeafBit; }
+        [[nodiscard]] constexpr uint32_t lightIndex() const { return data & ~LeafBit; }
+        [[nodiscard]] constexpr uint32_t rightChild() const { return data; }
+    };
+
+    // A light drawn by `sample()`, and the probability with which it was drawn
+    struct LightSample {
+        uint32_t lightIndex; // Index of the light in the scene
+        float pdf;
+    };
+
+    LightBVH() = default;
+
+    // Build the hierarchy over the given lights, which are referred to by their index
+    explicit LightBVH(std::span<const Scene::SceneLight> lights);
+
+    // Given a uniformly distributed 1d sample in [0, 1), draw a single light with a probability proportional to
+    // its power; returns nothing if no light emits
+    [[nodiscard]] std::optional<LightSample> sample(float sample) const;
+
+    // Return the probability with which `sample()` draws the light with the given index
+    [[nodiscard]] float pdf(uint32_t lightIndex) const;
+
+    [[nodiscard]] std::span<const Node> nodes() const { return m_nodes; }
+
+private:
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_parents; // Parent of each node; the root's parent is itself
+    std::vector<uint32_t> m_lightNodes; // Leaf of each light
+
+    // Temporary per-light data used during construction
+    struct BuildLight;
+
+    // Recursively builds the subtree over the given lights in depth-first order, and returns the index of its root
+    uint32_t buildRecursive(std::span<BuildLight> lights, uint32_t parentIndex);
+
+    // Estimate of the contribution of a node's lights at any shading point
+    [[nodiscard]] float importance(uint32_t nodeIndex) const;
+};
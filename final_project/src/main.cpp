@@ -29,6 +29,7 @@ DISABLE_WARNINGS_POP()
 #include <optional>
 #include <random>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <variant>
 
@@ -41,6 +42,7 @@ enum class ViewMode {
 int debugBVHLeafId = 0;
 uint32_t debugRaySeed = 4; // Chosen by fair dice roll
 
+static BVH loadOrBuildBVH(const std::filesystem::path& cacheDir, std::string_view sceneName, const Scene& scene, const Features& features);
 static void setOpenGLMatrices(const Trackball& camera);
 static void drawLightsOpenGL(const Scene& scene, const Trackball& camera, int selectedLight);
 static void drawSceneOpenGL(const Scene& scene);
@@ -69,14 +71,16 @@ int main(int argc, char** argv)
         SceneType sceneType { SceneType::SingleTriangle };
         std::vector<Ray> debugRays;
 
-        Scene scene = loadScenePrebuilt(sceneType, config.dataPath);
-        BVH bvh(scene, config.features);
+        Scene scene = loadScenePrebuilt(sceneType, config.dataPath, config.cacheDir);
+        BVH bvh = loadOrBuildBVH(config.cacheDir, serialize(sceneType), scene, config.features);
 
         int bvhDebugLevel = 0;
         int bvhDebugLeaf = 0;
         bool debugBVHLevel { false };
         bool debugBVHLeaf { false };
         ViewMode viewMode { ViewMode::Rasterization };
+        bool progressiveRendering { false };
+        ProgressiveRenderer progressiveRenderer;
 
         window.registerKeyCallback([&](int key, int /* scancode */, int action, int /* mods */) {
             if (action == GLFW_PRESS) {
@@ -124,9 +128,10 @@ int main(int argc, char** argv)
                 };
                 if (ImGui::Combo("Scenes", reinterpret_cast<int*>(&sceneType), items.data(), int(items.size()))) {
                     debugRays.clear();
-                    scene = loadScenePrebuilt(sceneType, config.dataPath);
+                    scene = loadScenePrebuilt(sceneType, config.dataPath, config.cacheDir);
                     selectedLightIdx = scene.lights.empty() ? -1 : 0;
-                    bvh = BVH(scene, config.features);
+                    bvh = loadOrBuildBVH(config.cacheDir, serialize(sceneType), scene, config.features);
+                    progressiveRenderer.reset();
 
                     if (!debugRays.empty()) {
                         RenderState state = { .scene = scene, .features = config.features, .bvh = bvh, .sampler = { debugRaySeed } };
@@ -137,6 +142,13 @@ int main(int argc, char** argv)
             {
                 constexpr std::array items { "Rasterization", "Ray Traced" };
                 ImGui::Combo("View mode", reinterpret_cast<int*>(&viewMode), items.data(), int(items.size()));
+                if (viewMode == ViewMode::RayTracing) {
+                    ImGui::Indent();
+                    ImGui::Checkbox("Progressive", &progressiveRendering);
+                    if (progressiveRendering)
+                        ImGui::Text("Samples per pixel: %u", progressiveRenderer.numSamples());
+                    ImGui::Unindent();
+                }
             }
 
             ImGui::Separator();
@@ -161,6 +173,8 @@ int main(int argc, char** argv)
                     uint32_t minSamples = 1u, maxSamples = 64u;
                     ImGui::Indent();
                     ImGui::SliderScalar("Shadow samples", ImGuiDataType_U32, &config.features.numShadowSamples, &minSamples, &maxSamples);
+                    constexpr std::array items { "Uniform", "Stratified", "Solid angle" };
+                    ImGui::Combo("Area light sampling", reinterpret_cast<int*>(&config.features.extra.areaLightSampling), items.data(), int(items.size()));
                     ImGui::Unindent();
                 }
                 ImGui::Checkbox("Textures", &config.features.enableTextureMapping);
@@ -176,6 +190,19 @@ int main(int argc, char** argv)
                     ImGui::Checkbox("Jittered sampling", &config.features.enableJitteredSampling);
                     uint32_t minSamples = 1u, maxSamples = 64u;
                     ImGui::SliderScalar("Pixel samples", ImGuiDataType_U32, &config.features.numPixelSamples, &minSamples, &maxSamples);
+                    {
+                        constexpr std::array items { "Random", "Sobol (Owen-scrambled)" };
+                        ImGui::Combo("Sample sequence", reinterpret_cast<int*>(&config.features.extra.sampleSequence), items.data(), int(items.size()));
+                    }
+                    ImGui::Checkbox("Adaptive sampling", &config.features.extra.enableAdaptiveSampling);
+                    if (config.features.extra.enableAdaptiveSampling) {
+                        uint32_t maxAdaptiveSamples = 1024u;
+                        ImGui::Indent();
+                        ImGui::SliderFloat("Error threshold", &config.features.extra.adaptiveSamplingThreshold, 0.001f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic);
+                        ImGui::SliderScalar("Max samples", ImGuiDataType_U32, &config.features.extra.adaptiveSamplingMaxSamples, &minSamples, &maxAdaptiveSamples);
+                        ImGui::Checkbox("Show sample count", &config.features.extra.showAdaptiveSampleMap);
+                        ImGui::Unindent();
+                    }
                 }
             }
 
@@ -207,6 +234,73 @@ int main(int argc, char** argv)
                 }
                 ImGui::Checkbox("Environment maps", &config.features.extra.enableEnvironmentMap);
                 ImGui::Checkbox("Texture filtering (mipmap)", &config.features.extra.enableMipmapTextureFiltering);
+                bool rebuildBVH = ImGui::Checkbox("BVH SAH binning", &config.features.extra.enableBvhSahBinning);
+                if (config.features.extra.enableBvhSahBinning) {
+                    uint32_t minBins = 2u, maxBins = 64u;
+                    ImGui::Indent();
+                    rebuildBVH |= ImGui::SliderScalar("SAH bins", ImGuiDataType_U32, &config.features.extra.numBvhSahBins, &minBins, &maxBins);
+                    rebuildBVH |= ImGui::SliderFloat("SAH traversal cost", &config.features.extra.bvhSahTraversalCost, 0.1f, 8.0f);
+                    rebuildBVH |= ImGui::SliderFloat("SAH intersection cost", &config.features.extra.bvhSahIntersectionCost, 0.1f, 8.0f);
+                    ImGui::Unindent();
+                }
+                rebuildBVH |= ImGui::Checkbox("BVH linear build", &config.features.extra.enableBvhLinearBuild);
+                rebuildBVH |= ImGui::Checkbox("BVH treelet optimization", &config.features.extra.enableBvhTreeletOptimization);
+                if (config.features.extra.enableBvhTreeletOptimization) {
+                    uint32_t minTreeletSize = 3u, maxTreeletSize = BVH::MaxTreeletSize;
+                    ImGui::Indent();
+                    rebuildBVH |= ImGui::SliderScalar("Treelet size", ImGuiDataType_U32, &config.features.extra.bvhTreeletSize, &minTreeletSize, &maxTreeletSize);
+                    ImGui::Unindent();
+                }
+                rebuildBVH |= ImGui::Checkbox("BVH compact primitives", &config.features.extra.enableBvhCompactPrimitives);
+                if (config.features.extra.enableBvhCompactPrimitives) {
+                    constexpr std::array items { "Reference", "Precomputed edges", "Watertight" };
+                    ImGui::Indent();
+                    rebuildBVH |= ImGui::Combo("Triangle test", reinterpret_cast<int*>(&config.features.extra.bvhTriangleTest), items.data(), int(items.size()));
+                    ImGui::Unindent();
+                }
+                ImGui::Checkbox("BVH ordered traversal", &config.features.extra.enableBvhOrderedTraversal);
+                {
+                    constexpr std::array items { "2 (binary)", "4", "8" };
+                    constexpr std::array widths { 2u, 4u, 8u };
+                    int widthIdx = static_cast<int>(std::distance(widths.begin(), std::find(widths.begin(), widths.end(), config.features.extra.bvhWidth)) % widths.size());
+                    if (ImGui::Combo("BVH width", &widthIdx, items.data(), int(items.size()))) {
+                        config.features.extra.bvhWidth = widths[widthIdx];
+                        rebuildBVH = true;
+                    }
+                }
+                ImGui::Checkbox("Ray packets", &config.features.extra.enableRayPackets);
+                if (config.features.extra.enableRayPackets) {
+                    constexpr std::array items { "4 (2x2 pixels)", "8 (4x2 pixels)", "16 (4x4 pixels)" };
+                    constexpr std::array sizes { 4u, 8u, 16u };
+                    int sizeIdx = static_cast<int>(std::distance(sizes.begin(), std::find(sizes.begin(), sizes.end(), config.features.extra.rayPacketSize)) % sizes.size());
+                    ImGui::Indent();
+                    if (ImGui::Combo("Packet size", &sizeIdx, items.data(), int(items.size()))) {
+                        config.features.extra.rayPacketSize = sizes[sizeIdx];
+                    }
+                    ImGui::Unindent();
+                }
+                ImGui::Checkbox("Render tiles", &config.features.extra.enableRenderTiles);
+                if (config.features.extra.enableRenderTiles) {
+                    constexpr std::array items { "Scanline", "Morton", "Spiral" };
+                    uint32_t minTileSize = 4u, maxTileSize = 128u;
+                    ImGui::Indent();
+                    ImGui::SliderScalar("Tile size", ImGuiDataType_U32, &config.features.extra.renderTileSize, &minTileSize, &maxTileSize);
+                    ImGui::Combo("Tile order", reinterpret_cast<int*>(&config.features.extra.renderTileOrder), items.data(), int(items.size()));
+                    ImGui::Unindent();
+                }
+                ImGui::Checkbox("Wavefront rendering", &config.features.extra.enableWavefrontRendering);
+                ImGui::Checkbox("Light BVH", &config.features.extra.enableLightBvh);
+                if (config.features.extra.enableLightBvh) {
+                    uint32_t minLightSamples = 1u, maxLightSamples = 16u;
+                    ImGui::Indent();
+                    ImGui::SliderScalar("Light samples", ImGuiDataType_U32, &config.features.extra.numLightBvhSamples, &minLightSamples, &maxLightSamples);
+                    ImGui::Unindent();
+                }
+                ImGui::Checkbox("Packed lights", &config.features.extra.enablePackedLights);
+                if (rebuildBVH) {
+                    bvh = loadOrBuildBVH(config.cacheDir, serialize(sceneType), scene, config.features);
+                    progressiveRenderer.reset();
+                }
             }
 
             if (ImGui::TreeNode("Camera(read only)")) {
@@ -254,6 +348,8 @@ int main(int argc, char** argv)
                 ImGui::Checkbox("Draw BVH Leaf", &debugBVHLeaf);
                 if (debugBVHLeaf)
                     ImGui::SliderInt("BVH Leaf", &bvhDebugLeaf, 1, bvh.numLeaves());
+                ImGui::Text("BVH SAH cost: %.2f", bvh.sahCost());
+                ImGui::Text("BVH primitive memory: %.1f MiB", static_cast<float>(bvh.primitiveMemoryFootprint()) / (1024.0f * 1024.0f));
             }
 
             ImGui::Spacing();
@@ -408,6 +504,13 @@ int main(int argc, char** argv)
             } break;
             case ViewMode::RayTracing: {
                 config.features.enableDebugDraw = false;
+                if (progressiveRendering) {
+                    // Add a single sample per pixel each frame, s.t. the UI stays responsive while the image converges
+                    progressiveRenderer.renderFrame(scene, bvh, config.features, camera, screen);
+                    screen.setPixel(0, 0, glm::vec3(1.0f));
+                    screen.draw();
+                    break;
+                }
                 screen.clear(glm::vec3(0.0f));
 
                 using clock = std::chrono::high_resolution_clock;
@@ -429,27 +532,26 @@ int main(int argc, char** argv)
     } else {
         // Command-line rendering.
         std::cout << config;
-        // NOTE(Yang): Trackball is highly coupled with the window,
-        // so we need to create a dummy window here but not show it.
-        // In this case, GLEW will not be initialized, OpenGL functions
-        // will not be loaded, and the window will not be shown.
-        // All debug draw calls will be disabled.
-        Window window { "Final Project", config.windowSize, OpenGLVersion::GL2, false };
+        // No window or OpenGL context is created; cameras are built as standalone camera frames,
+        // s.t. images can be rendered on machines without a display. Debug draw is disabled.
         // Load scene.
+        // The BVH is saved to the cache directory, s.t. later runs on the same scene skip its construction.
         Scene scene;
         std::string sceneName;
         std::visit(make_visitor(
                        [&](const std::filesystem::path& path) {
-                           scene = loadSceneFromFile(path, config.lights);
+                           scene = loadSceneFromFile(path, config.lights, config.cacheDir);
                            sceneName = path.stem().string();
                        },
                        [&](const SceneType& type) {
-                           scene = loadScenePrebuilt(type, config.dataPath);
+                           scene = loadScenePrebuilt(type, config.dataPath, config.cacheDir);
                            sceneName = serialize(type);
                        }),
             config.scene);
 
-        BVH bvh(scene, config.features);
+        BVH bvh = loadOrBuildBVH(config.cacheDir, sceneName, scene, config.features);
+        fmt::print("BVH SAH cost: {:.2f}\n", bvh.sahCost());
+        fmt::print("BVH primitive memory: {:.1f} MiB\n", static_cast<float>(bvh.primitiveMemoryFootprint()) / (1024.0f * 1024.0f));
 
         using clock = std::chrono::high_resolution_clock;
         // Create output directory if it does not exist.
@@ -463,8 +565,8 @@ int main(int argc, char** argv)
             const auto& cameraConfig = config.cameras[i];
             Screen screen { config.windowSize, false };
             screen.clear(glm::vec3(0.0f));
-            Trackball camera { &window, glm::radians(cameraConfig.fieldOfView), cameraConfig.distanceFromLookAt };
-            camera.setCamera(cameraConfig.lookAt, glm::radians(cameraConfig.rotation), cameraConfig.distanceFromLookAt);
+            const float aspectRatio = static_cast<float>(config.windowSize.x) / static_cast<float>(config.windowSize.y);
+            const CameraFrame camera { cameraConfig.lookAt, glm::radians(cameraConfig.rotation), cameraConfig.distanceFromLookAt, glm::radians(cameraConfig.fieldOfView), aspectRatio };
             renderImage(scene, bvh, config.features, camera, screen);
             const auto filename_base = fmt::format("{}_{}_cam_{}", sceneName, start_time_string, i);
             const auto filepath = config.outputDir / (filename_base + ".bmp");
@@ -479,6 +581,21 @@ int main(int argc, char** argv)
     return 0;
 }
 
+// Load the scene's BVH from the cache directory if it was saved for the same geometry and build settings, and
+// otherwise build it and save it there for the next run; see `BVH::cachePath()`
+static BVH loadOrBuildBVH(const std::filesystem::path& cacheDir, std::string_view sceneName, const Scene& scene, const Features& features)
+{
+    const auto cacheFile = BVH::cachePath(cacheDir, sceneName, features);
+    if (auto cached = BVH::load(cacheFile, scene, features)) {
+        fmt::print("BVH loaded from {}\n", cacheFile.string());
+        return std::move(*cached);
+    }
+    BVH bvh(scene, features);
+    if (!bvh.save(cacheFile, scene, features))
+        fmt::print("Failed to save BVH to {}\n", cacheFile.string());
+    return bvh;
+}
+
 static void setOpenGLMatrices(const Trackball& camera)
 {
     // Load view matrix.
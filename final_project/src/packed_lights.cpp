@@ -0,0 +1,166 @@
+#include "packed_lights.h"
+#include "light.h"
+#include "render.h"
+#include "shading.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+// A batch of 3d vectors, one array per component
+struct BatchVec3 {
+    std::array<float, PackedLights::BatchSize> x, y, z;
+
+    void set(size_t i, const glm::vec3& v)
+    {
+        x[i] = v.x;
+        y[i] = v.y;
+        z[i] = v.z;
+    }
+    [[nodiscard]] glm::vec3 operator[](size_t i) const { return { x[i], y[i], z[i] }; }
+};
+
+// Normalized directions from a shading position towards a batch of positions; `count` may be less than the
+// batch size. A branch-free loop over packed floats, which the compiler vectorizes.
+static void computeDirections(const float* xs, const float* ys, const float* zs, size_t count, const glm::vec3& origin, BatchVec3& directions)
+{
+    for (size_t i = 0; i < count; i++) {
+        const float dx = xs[i] - origin.x, dy = ys[i] - origin.y, dz = zs[i] - origin.z;
+        const float invLength = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz);
+        directions.x[i] = dx * invLength;
+        directions.y[i] = dy * invLength;
+        directions.z[i] = dz * invLength;
+    }
+}
+
+void PackedLights::Vec3Array::push_back(const glm::vec3& v)
+{
+    x.push_back(v.x);
+    y.push_back(v.y);
+    z.push_back(v.z);
+}
+
+PackedLights::PackedLights(std::span<const Scene::SceneLight> lights)
+{
+    m_locations.reserve(lights.size());
+    for (const auto& light : lights) {
+        if (std::holds_alternative<PointLight>(light)) {
+            const auto& point = std::get<PointLight>(light);
+            m_locations.push_back({ Location::Type::Point, static_cast<uint32_t>(m_points.positions.x.size()) });
+            m_points.positions.push_back(point.position);
+            m_points.colors.push_back(point.color);
+        } else if (std::holds_alternative<SegmentLight>(light)) {
+            m_locations.push_back({ Location::Type::Segment, static_cast<uint32_t>(m_segments.size()) });
+            m_segments.push_back(std::get<SegmentLight>(light));
+        } else {
+            m_locations.push_back({ Location::Type::Parallelogram, static_cast<uint32_t>(m_parallelograms.size()) });
+            m_parallelograms.push_back(std::get<ParallelogramLight>(light));
+        }
+    }
+}
+
+glm::vec3 PackedLights::computeContribution(RenderState& state, const Ray& ray, const HitInfo& hitInfo) const
+{
+    glm::vec3 Lo = computeContributionPointLights(state, 0, m_points.positions.x.size(), ray, hitInfo);
+    for (size_t i = 0; i < m_segments.size(); i++) {
+        Lo += computeContributionSegmentLight(state, i, ray, hitInfo);
+    }
+    for (size_t i = 0; i < m_parallelograms.size(); i++) {
+        Lo += computeContributionParallelogramLight(state, i, ray, hitInfo);
+    }
+    return Lo;
+}
+
+glm::vec3 PackedLights::computeContribution(RenderState& state, uint32_t lightIndex, const Ray& ray, const HitInfo& hitInfo) const
+{
+    const Location location = m_locations[lightIndex];
+    switch (location.type) {
+    case Location::Type::Point:
+        return computeContributionPointLights(state, location.index, location.index + 1, ray, hitInfo);
+    case Location::Type::Segment:
+        return computeContributionSegmentLight(state, location.index, ray, hitInfo);
+    case Location::Type::Parallelogram:
+        return computeContributionParallelogramLight(state, location.index, ray, hitInfo);
+    }
+    return glm::vec3(0.0f);
+}
+
+// Batched equivalent of `computeContributionPointLight()`; the directions towards a batch of lights are computed
+// at once, and only lights whose shading is non-zero trace a shadow ray.
+glm::vec3 PackedLights::computeContributionPointLights(RenderState& state, size_t begin, size_t end, const Ray& ray, const HitInfo& hitInfo) const
+{
+    const glm::vec3 v = -ray.direction;
+    const glm::vec3 p = ray.origin + ray.t * ray.direction;
+
+    glm::vec3 Lo { 0.0f };
+    BatchVec3 directions;
+    for (size_t first = begin; first < end; first += BatchSize) {
+        const size_t count = std::min(BatchSize, end - first);
+        computeDirections(&m_points.positions.x[first], &m_points.positions.y[first], &m_points.positions.z[first], count, p, directions);
+
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3 l = directions[i];
+            const glm::vec3 color = m_points.colors[first + i];
+            const glm::vec3 shading = computeShading(state, v, l, color, hitInfo);
+            if (glm::any(glm::notEqual(shading, glm::vec3(0.0f)))
+                && visibilityOfLightSampleBinary(state, m_points.positions[first + i], color, ray, hitInfo)) {
+                Lo += shading;
+            }
+        }
+    }
+    return Lo;
+}
+
+// Batched equivalent of `computeContributionSegmentLight()` and `computeContributionParallelogramLight()`; samples are
+// drawn by `drawSample(sampleIndex, shadingPosition, position, color)` in the same order as the unpacked functions draw
+// them, after which the directions towards a batch of samples are computed at once, and only samples whose shading is
+// non-zero test their visibility.
+template <typename F>
+static glm::vec3 computeContributionAreaLight(RenderState& state, const Ray& ray, const HitInfo& hitInfo, uint32_t numSamples, F&& drawSample)
+{
+    const glm::vec3 v = -ray.direction;
+    const glm::vec3 p = ray.origin + ray.t * ray.direction + 0.001f * hitInfo.normal;
+
+    glm::vec3 Lo { 0.0f };
+    BatchVec3 positions, colors, directions;
+    std::array<float, PackedLights::BatchSize> weights;
+    for (uint32_t first = 0; first < numSamples; first += PackedLights::BatchSize) {
+        const size_t count = std::min<size_t>(PackedLights::BatchSize, numSamples - first);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 position, color;
+            weights[i] = drawSample(static_cast<uint32_t>(first + i), p, position, color);
+            positions.set(i, position);
+            colors.set(i, color);
+        }
+        computeDirections(positions.x.data(), positions.y.data(), positions.z.data(), count, p, directions);
+
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3 Li = weights[i] * computeShading(state, v, directions[i], colors[i], hitInfo);
+            if (glm::any(glm::notEqual(Li, glm::vec3(0.0f)))) {
+                Lo += visibilityOfLightSample(state, positions[i], Li, ray, hitInfo);
+            }
+        }
+    }
+    return Lo / static_cast<float>(numSamples);
+}
+
+glm::vec3 PackedLights::computeContributionSegmentLight(RenderState& state, size_t index, const Ray& ray, const HitInfo& hitInfo) const
+{
+    const uint32_t numSamples = state.features.numShadowSamples;
+    return computeContributionAreaLight(state, ray, hitInfo, numSamples, [&](uint32_t i, const glm::vec3& p, glm::vec3& position, glm::vec3& color) {
+        return drawSegmentLightSample(state, m_segments[index], p, i, numSamples, position, color);
+    });
+}
+
+glm::vec3 PackedLights::computeContributionParallelogramLight(RenderState& state, size_t index, const Ray& ray, const HitInfo& hitInfo) const
+{
+    const uint32_t numSamples = state.features.numShadowSamples;
+    return computeContributionAreaLight(state, ray, hitInfo, numSamples, [&](uint32_t i, const glm::vec3& p, glm::vec3& position, glm::vec3& color) {
+        return drawParallelogramLightSample(state, m_parallelograms[index], p, i, numSamples, position, color);
+    });
+}
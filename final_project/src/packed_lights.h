@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "fwd.h"
+#include "scene.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/ray.h>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Render-time copy of the scene's lights, grouped per light type. The variant list in `Scene::lights` stays the editable
+// representation; this is built from it once the lights are final for a frame. Instead of dispatching on the variant
+// per light at every hit, the contribution kernels loop over all lights of one type. Point lights are packed into
+// structure-of-arrays storage and evaluated a batch of lights at once; area lights are kept whole, and evaluated a
+// batch of samples at once. Either way, the directions towards a batch are computed in branch-free loops over packed
+// floats, which the compiler vectorizes, and lights or samples that reflect nothing towards the ray skip their shadow
+// rays. Area light samples are drawn by `drawSegmentLightSample()` and `drawParallelogramLightSample()`, in the same
+// order as `computeContributionSegmentLight()` and `computeContributionParallelogramLight()` draw them.
+class PackedLights {
+public:
+    // Nr. of point lights, or area light samples, evaluated per batch
+    static constexpr size_t BatchSize = 16;
+
+    PackedLights() = default;
+
+    // Pack the given lights, which are referred to by their index
+    explicit PackedLights(std::span<const Scene::SceneLight> lights);
+
+    // Given an incident ray and an intersection, accumulate the contribution of all lights; matches
+    // `computeLightContribution()` without the light bvh, up to the order in which samples are drawn
+    [[nodiscard]] glm::vec3 computeContribution(RenderState& state, const Ray& ray, const HitInfo& hitInfo) const;
+
+    // Given an incident ray and an intersection, return the contribution of the light with the given index
+    [[nodiscard]] glm::vec3 computeContribution(RenderState& state, uint32_t lightIndex, const Ray& ray, const HitInfo& hitInfo) const;
+
+    [[nodiscard]] size_t size() const { return m_locations.size(); }
+
+private:
+    // Packed array of 3d vectors, one array per component
+    struct Vec3Array {
+        std::vector<float> x, y, z;
+
+        void push_back(const glm::vec3& v);
+        [[nodiscard]] glm::vec3 operator[](size_t i) const { return { x[i], y[i], z[i] }; }
+    };
+
+    struct PointLights {
+        Vec3Array positions;
+        Vec3Array colors;
+    };
+
+    // Where a scene light ended up in the packed arrays
+    struct Location {
+        enum class Type : uint32_t { Point, Segment, Parallelogram };
+
+        Type type;
+        uint32_t index; // Index in the arrays of its type
+    };
+
+    PointLights m_points;
+    std::vector<SegmentLight> m_segments;
+    std::vector<ParallelogramLight> m_parallelograms;
+    std::vector<Location> m_locations; // Location of each scene light
+
+    // Kernels; accumulate the contribution of the point lights in [begin, end), or of all samples of a single area light
+    glm::vec3 computeContributionPointLights(RenderState& state, size_t begin, size_t end, const Ray& ray, const HitInfo& hitInfo) const;
+    glm::vec3 computeContributionSegmentLight(RenderState& state, size_t index, const Ray& ray, const HitInfo& hitInfo) const;
+    glm::vec3 computeContributionParallelogramLight(RenderState& state, size_t index, const Ray& ray, const HitInfo& hitInfo) const;
+};
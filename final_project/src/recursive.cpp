@@ -4,13 +4,19 @@
 #include "intersect.h"
 #include "extra.h"
 #include "light.h"
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
 
 // This function is provided as-is. You do not have to implement it.
-// Given a range of rays, render out all rays and average the result
+// Given a range of rays, render out all rays and average the result; each ray starts a new sample of the sampler
 glm::vec3 renderRays(RenderState& state, std::span<const Ray> rays, int rayDepth)
 {
     glm::vec3 L { 0.f };
     for (const auto& ray : rays) {
+        state.sampler.nextSample();
         L += renderRay(state, ray, rayDepth);
     }
     return L / static_cast<float>(rays.size());
@@ -24,9 +30,23 @@ glm::vec3 renderRays(RenderState& state, std::span<const Ray> rays, int rayDepth
 // - `renderRaySpecularComponent()`, `renderRayTransparentComponent()`, `renderRayGlossyComponent()`
 glm::vec3 renderRay(RenderState& state, Ray ray, int rayDepth)
 {
-    // Trace the ray into the scene. If nothing was hit, return early
+    // Trace the ray into the scene
     HitInfo hitInfo;
-    if (!state.bvh.intersect(state, ray, hitInfo)) {
+    bool isHit = state.bvh.intersect(state, ray, hitInfo);
+    return renderTracedRay(state, ray, isHit, hitInfo, rayDepth);
+}
+
+// Given a camera ray (or secondary ray) whose scene intersection was already traced, e.g. as part of a
+// ray packet, evaluates the ray's contribution exactly as `renderRay()` does.
+// - state;    the active scene, feature config, bvh, and sampler
+// - ray;      the ray, with its distance `t` set to the intersection
+// - isHit;    if the ray hit anything
+// - hitInfo;  intersection object, valid if the ray hit anything
+// - rayDepth; current recursive ray depth
+glm::vec3 renderTracedRay(RenderState& state, const Ray& ray, bool isHit, const HitInfo& hitInfo, int rayDepth)
+{
+    // If nothing was hit, return early
+    if (!isHit) {
         if (state.features.enableDebugDraw) {
             drawRay(ray, glm::vec3(1, 0, 0));
         }
@@ -42,7 +62,7 @@ glm::vec3 renderRay(RenderState& state, Ray ray, int rayDepth)
 
     // Given that recursive components are enabled, and we have not exceeded maximum depth,
     // estimate the contribution along these components
-    if (rayDepth < 6) {
+    if (rayDepth < MaxRayDepth) {
         bool isReflective = glm::any(glm::notEqual(hitInfo.material.ks, glm::vec3(0.0f)));
         bool isTransparent = hitInfo.material.transparency != 1.f;
 
@@ -65,6 +85,23 @@ glm::vec3 renderRay(RenderState& state, Ray ray, int rayDepth)
     return Lo;
 }
 
+// Given an intersection, returns the weight of the light along its mirrored ray in the intersection's hit color
+// - hitInfo; intersection object
+// - return;  the material's specular color, by which the mirrored light is scaled
+glm::vec3 specularRayWeight(const HitInfo& hitInfo)
+{
+    return hitInfo.material.ks;
+}
+
+// Given an intersection, returns the weight of the light along its passthrough ray in the intersection's hit color;
+// the hit color is alpha blended towards that light, and keeps the remaining weight
+// - hitInfo; intersection object
+// - return;  one minus the material's opacity, stored in `transparency`
+float transparentRayWeight(const HitInfo& hitInfo)
+{
+    return 1.0f - hitInfo.material.transparency;
+}
+
 // TODO: Standard feature
 // Given an incident ray and a intersection point, generate a mirrored ray
 // - Ray;     the indicent ray
@@ -105,7 +142,7 @@ void renderRaySpecularComponent(RenderState& state, Ray ray, const HitInfo& hitI
 {
     // TODO; you should first implement generateReflectionRay()
     Ray r = generateReflectionRay(ray, hitInfo);
-    // ...
+    hitColor += specularRayWeight(hitInfo) * renderRay(state, r, rayDepth + 1);
 }
 
 // TODO: standard feature
@@ -122,5 +159,5 @@ void renderRayTransparentComponent(RenderState& state, Ray ray, const HitInfo& h
 {
     // TODO; you should first implement generatePassthroughRay()
     Ray r = generatePassthroughRay(ray, hitInfo);
-    // ...
+    hitColor = glm::mix(hitColor, renderRay(state, r, rayDepth + 1), transparentRayWeight(hitInfo));
 }
\ No newline at end of file
@@ -24,6 +24,22 @@ glm::vec3 renderRays(RenderState& state, std::span<const Ray> rays, int rayDepth
 // - `renderRaySpecularComponent()`, `renderRayTransparentComponent()`, `renderRayGlossyComponent()`
 glm::vec3 renderRay(RenderState& state, Ray ray, int rayDepth = 0);
 
+// Helper for `renderRay()`; given a ray whose scene intersection was already traced, e.g. as part of
+// a ray packet, evaluates the same functions as `renderRay()`
+glm::vec3 renderTracedRay(RenderState& state, const Ray& ray, bool isHit, const HitInfo& hitInfo, int rayDepth = 0);
+
+// Secondary rays are only traced from intersections below this recursive ray depth
+constexpr int MaxRayDepth = 6;
+
+// Given an intersection, returns the weight of the light along its mirrored ray in the intersection's hit color;
+// shared by `renderRaySpecularComponent()` and the wavefront renderer
+glm::vec3 specularRayWeight(const HitInfo& hitInfo);
+
+// Given an intersection, returns the weight of the light along its passthrough ray in the intersection's hit color,
+// by which the hit color is blended towards that light; shared by `renderRayTransparentComponent()` and the
+// wavefront renderer
+float transparentRayWeight(const HitInfo& hitInfo);
+
 /* Unfinished render code; you have to implement the following methods */
 
 // TODO: Standard feature
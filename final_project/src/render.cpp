@@ -1,45 +1,376 @@
 #include "render.h"
+#include "bvh.h"
 #include "bvh_interface.h"
+#include "camera.h"
 #include "draw.h"
 #include "extra.h"
 #include "light.h"
+#include "light_bvh.h"
 #include "recursive.h"
 #include "sampler.h"
 #include "screen.h"
 #include "shading.h"
+#include "wavefront.h"
 #include <framework/trackball.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
 #ifdef NDEBUG
 #include <omp.h>
 #endif
 
+// Returns the block of pixels covered by a ray packet; 2x2, 4x2, or 4x4 pixels dependent on
+// `features.extra.rayPacketSize`, or a single pixel if packets are disabled or unsupported
+static glm::ivec2 rayPacketShape(const Features& features)
+{
+    if (!features.extra.enableRayPackets || features.numPixelSamples != 1 || features.extra.enableAdaptiveSampling)
+        return { 1, 1 };
+    return { features.extra.rayPacketSize >= 8 ? 4 : 2, features.extra.rayPacketSize >= 16 ? 4 : 2 };
+}
+
+// Maps a pixel's sample count onto a blue-green-red heat map, from a single sample to `maxSamples`
+static glm::vec3 sampleCountColor(uint32_t numSamples, uint32_t maxSamples)
+{
+    float t = glm::clamp(static_cast<float>(numSamples) / static_cast<float>(std::max(maxSamples, 1u)), 0.0f, 1.0f);
+    return { t, 1.0f - std::abs(2.0f * t - 1.0f), 1.0f - t };
+}
+
+// Renders a single pixel, exactly as the scanline loop in `renderImage()` does; the state and the buffer
+// for camera rays are reused across pixels, and only the state's sampler is reseeded. With adaptive sampling enabled, the pixel is
+// instead sampled by `renderPixelAdaptive()`, which outputs either its color or its sample count.
+static void renderPixel(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, Screen& screen, std::span<Ray> rayBuffer)
+{
+    state.sampler = Sampler(static_cast<uint32_t>(screen.resolution().y * pixel.x + pixel.y), state.features.extra.sampleSequence);
+    if (state.features.extra.enableAdaptiveSampling) {
+        auto sample = renderPixelAdaptive(state, camera, pixel, screen.resolution(), rayBuffer);
+        if (state.features.extra.showAdaptiveSampleMap) {
+            screen.setPixel(pixel.x, pixel.y, sampleCountColor(sample.numSamples, state.features.extra.adaptiveSamplingMaxSamples));
+        } else {
+            screen.setPixel(pixel.x, pixel.y, sample.radiance);
+        }
+        return;
+    }
+    auto rays = generatePixelRays(state, camera, pixel, screen.resolution(), rayBuffer);
+    auto L = renderRays(state, rays);
+    screen.setPixel(pixel.x, pixel.y, L);
+}
+
+// Renders a block of at most 4x4 pixels with a single camera ray per pixel, traced through the bvh as one
+// packet. Only the camera rays are traced as a packet, as these are coherent and share most of their node
+// tests; the pixels are then shaded, and their secondary rays traced, one by one.
+static void renderPixelPacket(RenderState& state, const CameraFrame& camera, glm::ivec2 begin, glm::ivec2 end, Screen& screen)
+{
+    constexpr size_t MaxPacketSize = 16;
+    const glm::ivec2 resolution = screen.resolution();
+
+    // Generate the camera rays at the centers of the packet's pixels, as one batch
+    std::array<glm::ivec2, MaxPacketSize> pixels;
+    std::array<glm::vec2, MaxPacketSize> positions;
+    std::array<Ray, MaxPacketSize> rays;
+    std::array<HitInfo, MaxPacketSize> hitInfos;
+    size_t numRays = 0;
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++) {
+            pixels[numRays] = { x, y };
+            positions[numRays++] = (glm::vec2(x, y) + 0.5f) / glm::vec2(resolution) * 2.f - 1.f;
+        }
+    }
+    camera.generateRays(std::span(positions.data(), numRays), rays);
+    uint32_t hitMask = intersectRayPacketWithBVH(state, state.bvh, std::span(rays.data(), numRays), std::span(hitInfos.data(), numRays));
+
+    for (size_t i = 0; i < numRays; i++) {
+        // Seed the per-pixel sampler exactly as `renderImage()` does
+        const glm::ivec2 pixel = pixels[i];
+        state.sampler = Sampler(static_cast<uint32_t>(resolution.y * pixel.x + pixel.y), state.features.extra.sampleSequence);
+        auto L = renderTracedRay(state, rays[i], (hitMask >> i) & 1u, hitInfos[i]);
+        screen.setPixel(pixel.x, pixel.y, L);
+    }
+}
+
+// Renders the pixels in [begin, end), clipped to the screen, either one by one or in ray packets
+static void renderPixels(RenderState& state, const CameraFrame& camera, glm::ivec2 begin, glm::ivec2 end, Screen& screen)
+{
+    end = glm::min(end, screen.resolution());
+    const glm::ivec2 shape = rayPacketShape(state.features);
+    if (shape == glm::ivec2(1)) {
+        std::vector<Ray> rayBuffer(numPixelRays(state.features));
+        for (int y = begin.y; y < end.y; y++) {
+            for (int x = begin.x; x < end.x; x++) {
+                renderPixel(state, camera, { x, y }, screen, rayBuffer);
+            }
+        }
+    } else {
+        for (int y = begin.y; y < end.y; y += shape.y) {
+            for (int x = begin.x; x < end.x; x += shape.x) {
+                renderPixelPacket(state, camera, { x, y }, glm::min(glm::ivec2(x, y) + shape, end), screen);
+            }
+        }
+    }
+}
+
+// Renders the image tile by tile with the work-stealing `TileScheduler`; tiles are `features.extra.renderTileSize`
+// pixels wide, and handed out in the order given by `features.extra.renderTileOrder`. Each thread keeps a
+// single render state alive across the tiles it renders.
+static void renderImageWithTiles(const Scene& scene, const BVHInterface& bvh, const LightBVH* lightBvh, const PackedLights* packedLights, const Features& features, const CameraFrame& camera, Screen& screen)
+{
+    const auto tiles = generateRenderTiles(screen.resolution(), features.extra.renderTileSize, features.extra.renderTileOrder);
+#ifdef NDEBUG // Enable multi threading in Release mode
+    TileScheduler scheduler(tiles, static_cast<uint32_t>(omp_get_max_threads()));
+#pragma omp parallel
+#else
+    TileScheduler scheduler(tiles, 1);
+#endif
+    {
+#ifdef NDEBUG
+        const auto threadIndex = static_cast<uint32_t>(omp_get_thread_num());
+#else
+        const uint32_t threadIndex = 0;
+#endif
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .lightBvh = lightBvh, .packedLights = packedLights, .sampler = { 0 } };
+        while (auto tile = scheduler.next(threadIndex)) {
+            renderPixels(state, camera, tile->begin, tile->end, screen);
+        }
+    }
+}
+
+// Renders the image in bands of scanlines as high as a ray packet, traced in packets; see `renderPixelPacket()`.
+// Without packets, the bands are single scanlines, rendered pixel by pixel; see `renderPixel()`.
+static void renderImageInBands(const Scene& scene, const BVHInterface& bvh, const LightBVH* lightBvh, const PackedLights* packedLights, const Features& features, const CameraFrame& camera, Screen& screen)
+{
+    const int bandHeight = rayPacketShape(features).y;
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for schedule(guided)
+#endif
+    for (int y = 0; y < screen.resolution().y; y += bandHeight) {
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .lightBvh = lightBvh, .packedLights = packedLights, .sampler = { 0 } };
+        renderPixels(state, camera, { 0, y }, { screen.resolution().x, y + bandHeight }, screen);
+    }
+}
+
+// Given a screen resolution, splits the screen into square tiles, and sorts these in the given order.
+// - resolution; x/y dimensions of the output image
+// - tileSize;   width and height of a tile in pixels; tiles along the screen's edges are clipped
+// - order;      the order of the returned tiles
+// - return;     a vector of tiles which together cover the screen
+std::vector<RenderTile> generateRenderTiles(glm::ivec2 resolution, uint32_t tileSize, TileOrder order)
+{
+    const int size = std::max(1, static_cast<int>(tileSize));
+    const glm::ivec2 numTiles = (resolution + size - 1) / size;
+
+    std::vector<RenderTile> tiles;
+    tiles.reserve(static_cast<size_t>(numTiles.x) * static_cast<size_t>(numTiles.y));
+    for (int y = 0; y < numTiles.y; y++) {
+        for (int x = 0; x < numTiles.x; x++) {
+            glm::ivec2 begin = glm::ivec2(x, y) * size;
+            tiles.push_back({ .begin = begin, .end = glm::min(begin + size, resolution) });
+        }
+    }
+
+    if (order == TileOrder::Morton) {
+        // Interleave the bits of the tile's x/y indices
+        const auto mortonCode = [size](const RenderTile& tile) {
+            const auto spread = [](uint32_t v) {
+                v = (v | (v << 8)) & 0x00FF00FFu;
+                v = (v | (v << 4)) & 0x0F0F0F0Fu;
+                v = (v | (v << 2)) & 0x33333333u;
+                v = (v | (v << 1)) & 0x55555555u;
+                return v;
+            };
+            glm::uvec2 index = tile.begin / size;
+            return spread(index.x) | (spread(index.y) << 1);
+        };
+        std::stable_sort(tiles.begin(), tiles.end(), [&](const RenderTile& a, const RenderTile& b) { return mortonCode(a) < mortonCode(b); });
+    } else if (order == TileOrder::Spiral) {
+        // Sort by the square ring around the screen's center, and then by angle inside each ring
+        const glm::vec2 center = glm::vec2(resolution) * 0.5f;
+        const auto ringAndAngle = [&](const RenderTile& tile) {
+            glm::vec2 offset = (glm::vec2(tile.begin + tile.end) * 0.5f - center) / static_cast<float>(size);
+            int ring = static_cast<int>(std::round(std::max(std::abs(offset.x), std::abs(offset.y))));
+            return std::pair(ring, std::atan2(offset.y, offset.x));
+        };
+        std::stable_sort(tiles.begin(), tiles.end(), [&](const RenderTile& a, const RenderTile& b) { return ringAndAngle(a) < ringAndAngle(b); });
+    }
+    return tiles;
+}
+
+// Distributes the tiles over per-thread queues in contiguous chunks, s.t. each thread starts on
+// neighbouring tiles
+TileScheduler::TileScheduler(std::span<const RenderTile> tiles, uint32_t numThreads)
+    : m_queues(std::max(numThreads, 1u))
+{
+    const size_t numQueues = m_queues.size();
+    for (size_t i = 0; i < numQueues; i++) {
+        auto first = tiles.begin() + static_cast<std::ptrdiff_t>(i * tiles.size() / numQueues);
+        auto last = tiles.begin() + static_cast<std::ptrdiff_t>((i + 1) * tiles.size() / numQueues);
+        m_queues[i].tiles.assign(first, last);
+    }
+}
+
+// Returns the next tile for the given thread; this is the front of the thread's own queue, or, once
+// that is empty, a tile stolen from the back of another thread's queue. Returns nothing once all
+// queues are empty.
+std::optional<RenderTile> TileScheduler::next(uint32_t threadIndex)
+{
+    const size_t numQueues = m_queues.size();
+    for (size_t i = 0; i < numQueues; i++) {
+        const bool isOwnQueue = i == 0;
+        TileQueue& queue = m_queues[(threadIndex + i) % numQueues];
+        std::scoped_lock lock(queue.mutex);
+        if (queue.tiles.empty())
+            continue;
+
+        RenderTile tile = isOwnQueue ? queue.tiles.front() : queue.tiles.back();
+        if (isOwnQueue)
+            queue.tiles.pop_front();
+        else
+            queue.tiles.pop_back();
+        return tile;
+    }
+    return std::nullopt;
+}
+
+// Given the same input as for `renderImage()`, traces one more camera ray per pixel, adds its radiance
+// to the accumulation buffer, and writes the running average to the screen.
+// - scene;    the active scene
+// - bvh;      the bvh generated over the current scene
+// - features; the feature config that is active
+// - camera;   the camera object, used for ray generation
+// - screen;   the output screen, which receives the averaged image
+// The first sample of each pixel is the pixel's center, traced with the sampler seeded exactly as in `renderImage()`,
+// s.t. the first frame matches a single-sample render; later samples are jittered across the pixel, and draw from
+// the pixel's sampler started at that sample, s.t. low-discrepancy sequences continue across frames. Depth of field and motion blur integrate over their own domains in one
+// go, so with these enabled, the image is rendered once by `renderImage()`, and kept until something changes.
+void ProgressiveRenderer::renderFrame(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen)
+{
+    // Restart accumulation if any of the inputs changed since the previous frame
+    const glm::ivec2 resolution = screen.resolution();
+    const size_t numPixels = static_cast<size_t>(resolution.x) * static_cast<size_t>(resolution.y);
+    const glm::mat4 viewMatrix = camera.viewMatrix(), projectionMatrix = camera.projectionMatrix();
+    if (m_accumulation.size() != numPixels || m_features != features || m_viewMatrix != viewMatrix
+        || m_projectionMatrix != projectionMatrix || m_lights != scene.lights || m_sceneType != scene.type) {
+        reset();
+        m_accumulation.resize(numPixels, glm::vec3(0.0f));
+        m_features = features;
+        m_viewMatrix = viewMatrix;
+        m_projectionMatrix = projectionMatrix;
+        m_camera = CameraFrame(camera);
+        m_lights = scene.lights;
+        m_lightBvh = features.extra.enableLightBvh ? LightBVH(scene.lights) : LightBVH();
+        m_packedLights = features.extra.enablePackedLights ? PackedLights(scene.lights) : PackedLights();
+        m_sceneType = scene.type;
+    }
+
+    if (features.extra.enableDepthOfField || features.extra.enableMotionBlur) {
+        if (m_numSamples == 0) {
+            renderImage(scene, bvh, features, m_camera, screen);
+            m_numSamples = 1;
+        }
+        return;
+    }
+
+    if (m_numSamples < MaxSamples) {
+        const uint32_t sampleIndex = m_numSamples++;
+        const float invNumSamples = 1.0f / static_cast<float>(m_numSamples);
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel for schedule(guided)
+#endif
+        for (int y = 0; y < resolution.y; y++) {
+            RenderState state = { .scene = scene, .features = features, .bvh = bvh, .lightBvh = &m_lightBvh, .packedLights = &m_packedLights, .sampler = { 0 } };
+            for (int x = 0; x != resolution.x; x++) {
+                const auto pixelSeed = static_cast<uint32_t>(resolution.y * x + y);
+                state.sampler = Sampler(pixelSeed, features.extra.sampleSequence, sampleIndex);
+                const glm::vec2 offset = sampleIndex == 0 ? glm::vec2(0.5f) : state.sampler.next_2d();
+                const glm::vec2 position = (glm::vec2(x, y) + offset) / glm::vec2(resolution) * 2.f - 1.f;
+
+                glm::vec3& accumulated = m_accumulation[static_cast<size_t>(screen.indexAt(x, y))];
+                state.sampler.nextSample();
+                accumulated += renderRay(state, m_camera.generateRay(position));
+                screen.setPixel(x, y, accumulated * invNumSamples);
+            }
+        }
+    } else {
+        // Accumulation has converged; bloom below may still have overwritten the screen, so present the average again
+        const float invNumSamples = 1.0f / static_cast<float>(m_numSamples);
+        for (int y = 0; y < resolution.y; y++) {
+            for (int x = 0; x != resolution.x; x++) {
+                screen.setPixel(x, y, m_accumulation[static_cast<size_t>(screen.indexAt(x, y))] * invNumSamples);
+            }
+        }
+    }
+
+    // Pass through to extra.h for post processing, over the averaged image
+    if (features.extra.enableBloomEffect) {
+        postprocessImageWithBloom(scene, features, m_camera, screen);
+    }
+}
+
+// Drops all accumulated samples; the next frame starts over from a single sample per pixel
+void ProgressiveRenderer::reset()
+{
+    m_accumulation.clear();
+    m_numSamples = 0;
+}
+
+uint32_t ProgressiveRenderer::numSamples() const
+{
+    return m_numSamples;
+}
+
 // This function is provided as-is. You do not have to implement it.
 // Given relevant objects (scene, bvh, camera, etc) and an output screen, multithreaded fills
 // each of the pixels using one of the below `renderPixel*()` functions, dependent on scene
 // configuration. By default, `renderPixelNaive()` is called.
 void renderImage(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen)
 {
+    renderImage(scene, bvh, features, CameraFrame(camera), screen);
+}
+
+// Given the same input as above, but with a camera frame instead of a trackball, renders the image. The camera
+// does not move during a frame, so its frame is built once by the caller, instead of per camera ray.
+void renderImage(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen)
+{
+    // Build the light hierarchy and the packed lights once per frame, as lights may be edited in between frames
+    const LightBVH lightBvh = features.extra.enableLightBvh ? LightBVH(scene.lights) : LightBVH();
+    const PackedLights packedLights = features.extra.enablePackedLights ? PackedLights(scene.lights) : PackedLights();
+
     // Either directly render the image, or pass through to extra.h methods
     if (features.extra.enableDepthOfField) {
         renderImageWithDepthOfField(scene, bvh, features, camera, screen);
     } else if (features.extra.enableMotionBlur) {
         renderImageWithMotionBlur(scene, bvh, features, camera, screen);
+    } else if (features.extra.enableWavefrontRendering) {
+        renderImageWavefront(scene, bvh, features, camera, screen, &lightBvh, &packedLights);
+    } else if (features.extra.enableRenderTiles) {
+        renderImageWithTiles(scene, bvh, &lightBvh, &packedLights, features, camera, screen);
+    } else if ((features.extra.enableRayPackets && features.numPixelSamples == 1) || features.extra.enableAdaptiveSampling) {
+        renderImageInBands(scene, bvh, &lightBvh, &packedLights, features, camera, screen);
     } else {
 #ifdef NDEBUG // Enable multi threading in Release mode
-#pragma omp parallel for schedule(guided)
+#pragma omp parallel
 #endif
-        for (int y = 0; y < screen.resolution().y; y++) {
-            for (int x = 0; x != screen.resolution().x; x++) {
-                // Assemble useful objects on a per-pixel basis; e.g. a per-thread sampler
-                // Note; we seed the sampler for consistenct behavior across frames
-                RenderState state = {
-                    .scene = scene,
-                    .features = features,
-                    .bvh = bvh,
-                    .sampler = { static_cast<uint32_t>(screen.resolution().y * x + y) }
-                };
-                auto rays = generatePixelRays(state, camera, { x, y }, screen.resolution());
-                auto L = renderRays(state, rays);
-                screen.setPixel(x, y, L);
+        {
+            // Per-thread buffer for a pixel's camera rays, s.t. no memory is allocated per pixel
+            std::vector<Ray> rayBuffer(numPixelRays(features));
+#ifdef NDEBUG
+#pragma omp for schedule(guided)
+#endif
+            for (int y = 0; y < screen.resolution().y; y++) {
+                for (int x = 0; x != screen.resolution().x; x++) {
+                    // Assemble useful objects on a per-pixel basis; e.g. a per-thread sampler
+                    // Note; we seed the sampler for consistenct behavior across frames
+                    RenderState state = {
+                        .scene = scene,
+                        .features = features,
+                        .bvh = bvh,
+                        .lightBvh = &lightBvh,
+                        .packedLights = &packedLights,
+                        .sampler = { static_cast<uint32_t>(screen.resolution().y * x + y), features.extra.sampleSequence }
+                    };
+                    auto rays = generatePixelRays(state, camera, { x, y }, screen.resolution(), rayBuffer);
+                    auto L = renderRays(state, rays);
+                    screen.setPixel(x, y, L);
+                }
             }
         }
     }
@@ -50,62 +381,186 @@ void renderImage(const Scene& scene, const BVHInterface& bvh, const Features& fe
     }
 }
 
+// Given a render state, camera, pixel position, and output resolution, renders the pixel with an adaptive number of
+// samples; this forwards to the allocation-free overload below.
+AdaptivePixelSample renderPixelAdaptive(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution)
+{
+    std::vector<Ray> rayBuffer(numPixelRays(state.features));
+    return renderPixelAdaptive(state, camera, pixel, screenResolution, rayBuffer);
+}
+
+// Draws one batch of `numPixelRays(state.features)` camera rays through random positions inside the pixel, for
+// `renderPixelAdaptive()`. With jittered sampling, each ray is placed inside its own cell of the pixel, s.t. the
+// batch stays stratified. Every position is drawn by `Sampler::nextCameraSample()`, s.t. later batches still
+// take the camera samples of the paths that the next calls to `nextSample()` start.
+static std::span<Ray> generateAdaptivePixelRays(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays)
+{
+    const uint32_t numRays = numPixelRays(state.features);
+    const uint32_t numCells = state.features.enableJitteredSampling ? static_cast<uint32_t>(std::round(std::sqrt(float(numRays)))) : 1u;
+    for (uint32_t i = 0; i < numRays; i++) {
+        glm::vec2 cell = glm::vec2(i % numCells, (i / numCells) % numCells);
+        glm::vec2 offset = (cell + state.sampler.nextCameraSample()) / static_cast<float>(numCells);
+        rays[i] = camera.generateRay((glm::vec2(pixel) + offset) / glm::vec2(screenResolution) * 2.f - 1.f);
+    }
+    return rays.first(numRays);
+}
+
+// Given a render state, camera, pixel position, and output resolution, renders the pixel with an adaptive number of
+// samples. Batches of `numPixelRays(features)` camera rays are drawn at random positions inside the pixel, s.t. e.g.
+// jittered sampling stays stratified within each batch; see `generateAdaptivePixelRays()`. A running mean and variance
+// of the samples' luminance (Welford's method) give the relative standard error of the pixel's mean; sampling stops
+// once this drops below `features.extra.adaptiveSamplingThreshold`, or once `features.extra.adaptiveSamplingMaxSamples`
+// rays were traced.
+// - state;            the active scene, feature config, bvh, and sampler
+// - camera;           the camera object, used for ray generation
+// - pixel;            x/y coordinates of the current pixel
+// - screenResolution; x/y dimensions of the output image
+// - rayBuffer;        buffer of at least `numPixelRays(state.features)` rays, which receives each batch
+// - return;           the pixel's mean radiance, its sample count, and its final error estimate
+AdaptivePixelSample renderPixelAdaptive(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rayBuffer)
+{
+    // Nr. of samples taken at least, before the error estimate is trusted; dark pixels are judged
+    // by their absolute error instead, as their relative error is meaningless
+    constexpr uint32_t MinSamples = 4;
+    constexpr float MinLuminance = 0.05f;
+    const uint32_t maxSamples = std::max(state.features.extra.adaptiveSamplingMaxSamples, 1u);
+
+    glm::vec3 radianceSum { 0.0f };
+    float mean = 0.0f, sumSquaredDeviations = 0.0f, error = 0.0f;
+    uint32_t numSamples = 0;
+    while (numSamples < maxSamples) {
+        auto rays = generateAdaptivePixelRays(state, camera, pixel, screenResolution, rayBuffer);
+        for (const Ray& ray : rays) {
+            if (numSamples == maxSamples)
+                break;
+            state.sampler.nextSample();
+            glm::vec3 L = renderRay(state, ray);
+            float luminance = glm::dot(L, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+            radianceSum += L;
+            numSamples++;
+
+            float delta = luminance - mean;
+            mean += delta / static_cast<float>(numSamples);
+            sumSquaredDeviations += delta * (luminance - mean);
+        }
+
+        if (numSamples >= MinSamples) {
+            float variance = sumSquaredDeviations / static_cast<float>(numSamples - 1);
+            error = std::sqrt(variance / static_cast<float>(numSamples)) / std::max(mean, MinLuminance);
+            if (error <= state.features.extra.adaptiveSamplingThreshold)
+                break;
+        }
+    }
+
+    return {
+        .radiance = numSamples > 0 ? radianceSum / static_cast<float>(numSamples) : glm::vec3(0.0f),
+        .numSamples = numSamples,
+        .error = error
+    };
+}
+
+// Given a feature config, returns the nr. of camera rays `generatePixelRays()` generates per pixel, i.e. the
+// size of the buffer its allocation-free overload needs.
+uint32_t numPixelRays(const Features& features)
+{
+    if (features.numPixelSamples <= 1) {
+        return 1;
+    } else if (features.enableJitteredSampling) {
+        auto numSamples = static_cast<uint32_t>(std::round(std::sqrt(float(features.numPixelSamples))));
+        return numSamples * numSamples;
+    } else {
+        return features.numPixelSamples;
+    }
+}
+
 // This function is provided as-is. You do not have to implement it.
 // Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples for this pixel.
 // This method forwards to `generatePixelRaysMultisampled` and `generatePixelRaysStratified` when necessary.
 std::vector<Ray> generatePixelRays(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution)
+{
+    std::vector<Ray> rays(numPixelRays(state.features));
+    rays.resize(generatePixelRays(state, CameraFrame(camera), pixel, screenResolution, rays).size());
+    return rays;
+}
+
+// Allocation-free overload of the above; writes the camera ray samples for this pixel into a caller-provided buffer,
+// which is typically reused across all pixels a thread renders.
+// - rays;   buffer of at least `numPixelRays(state.features)` rays
+// - return; the prefix of `rays` that holds the generated rays
+std::span<Ray> generatePixelRays(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays)
 {
     if (state.features.numPixelSamples > 1) {
         if (state.features.enableJitteredSampling) {
-            return generatePixelRaysStratified(state, camera, pixel, screenResolution);
+            return generatePixelRaysStratified(state, camera, pixel, screenResolution, rays);
         } else {
-            return generatePixelRaysUniform(state, camera, pixel, screenResolution);
+            return generatePixelRaysUniform(state, camera, pixel, screenResolution, rays);
         }
     } else {
         // Generate single camera ray placed at the pixel's center
         // Note: (-1, -1) at the bottom left of the screen,
         //       (+1, +1) at the top right of the screen.
         glm::vec2 position = (glm::vec2(pixel) + 0.5f) / glm::vec2(screenResolution) * 2.f - 1.f;
-        return { camera.generateRay(position) };
+        rays[0] = camera.generateRay(position);
+        return rays.first(1);
     }
 }
 
+// Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
+// uniformly throughout this pixel; this forwards to the allocation-free overload below.
+// - return; a vector of camera rays into the pixel
+// This method is unit-tested, so do not change the function signature.
+std::vector<Ray> generatePixelRaysUniform(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution)
+{
+    std::vector<Ray> rays(numPixelRays(state.features));
+    rays.resize(generatePixelRaysUniform(state, CameraFrame(camera), pixel, screenResolution, rays).size());
+    return rays;
+}
+
 // TODO: standard feature
 // Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
-// uniformly throughout this pixel.
+// uniformly throughout this pixel, and writes these into a caller-provided buffer.
 // - state;            the active scene, feature config, bvh, and sampler
 // - camera;           the camera object, used for ray generation
 // - pixel;            x/y coordinates of the current pixel
 // - screenResolution; x/y dimensions of the output image
-// - return;           a vector of camera rays into the pixel
-// This method is unit-tested, so do not change the function signature.
-std::vector<Ray> generatePixelRaysUniform(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution)
+// - rays;             buffer of at least `numSamples` rays
+// - return;           the prefix of `rays` that holds the camera rays into the pixel
+std::span<Ray> generatePixelRaysUniform(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays)
 {
     // Generate numSamples camera rays uniformly distributed across the pixel. Use
     // Hint; use `state.sampler.next*d()` to generate random samples in [0, 1).
     auto numSamples = state.features.numPixelSamples;
-    std::vector<Ray> rays;
     // ...
+    return rays.first(0);
+}
+
+// Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
+// using jittered sampling throughout this pixel; this forwards to the allocation-free overload below.
+// - return; a vector of camera rays into the pixel
+std::vector<Ray> generatePixelRaysStratified(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution)
+{
+    std::vector<Ray> rays(numPixelRays(state.features));
+    rays.resize(generatePixelRaysStratified(state, CameraFrame(camera), pixel, screenResolution, rays).size());
     return rays;
 }
 
 // TODO: standard feature
 // Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
-// using jittered sampling throughout this pixel. Given NxN cells across one pixel, each ray sample is randomly
-// placed somewhere within a cell.
+// using jittered sampling throughout this pixel, and writes these into a caller-provided buffer. Given NxN cells
+// across one pixel, each ray sample is randomly placed somewhere within a cell.
 // - state;            the active scene, feature config, bvh, and sampler
 // - camera;           the camera object, used for ray generation
 // - pixel;            x/y coordinates of the current pixel
 // - screenResolution; x/y dimensions of the output image
-// - return;           a vector of camera rays into the pixel
+// - rays;             buffer of at least `numSamples * numSamples` rays
+// - return;           the prefix of `rays` that holds the camera rays into the pixel
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-std::vector<Ray> generatePixelRaysStratified(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution)
+std::span<Ray> generatePixelRaysStratified(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays)
 {
     // Generate numSamples * numSamples camera rays as jittered samples across the pixel.
     // Hint; use `state.sampler.next*d()` to generate random samples in [0, 1).
     auto numSamples = static_cast<uint32_t>(std::round(std::sqrt(float(state.features.numPixelSamples))));
-    std::vector<Ray> rays;
     // ...
-    return rays;
+    return rays.first(0);
 }
\ No newline at end of file
@@ -1,14 +1,24 @@
 #pragma once
 
+#include "camera.h"
 #include "common.h"
 #include "fwd.h"
+#include "light_bvh.h"
+#include "packed_lights.h"
 #include "sampler.h"
+#include "scene.h"
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 #include <framework/ray.h>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
 
 // The configurative state inside renderer; collects
 // handles to e.g. the BVH and the scene, and holds
@@ -19,6 +29,8 @@ struct RenderState {
     const Scene& scene; // The scene being rendered
     const Features& features; // The feature config that is active
     const BVHInterface& bvh; // The bvh generated over the current scene
+    const LightBVH* lightBvh = nullptr; // Optional hierarchy over the scene's lights; without it, every light is evaluated
+    const PackedLights* packedLights = nullptr; // Optional packed copy of the scene's lights; without it, lights are evaluated one by one
 
     // Small per-thread objects kept alive throughout the renderer
     // You can add your own objects here ...
@@ -33,24 +45,121 @@ struct RenderState {
 // configuration. By default, `renderPixelNaive()` is called.
 void renderImage(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen);
 
+// Version of the above for a camera that is not bound to a window; this needs no display or OpenGL context, and
+// is used for command-line rendering
+void renderImage(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen);
+
 // This function is provided as-is. You do not have to implement it.
 // Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples for this pixel.
 // This method forwards to `generatePixelRaysMultisampled` and `generatePixelRaysStratified` when necessary.
 std::vector<Ray> generatePixelRays(RenderState &state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution);
 
+// Allocation-free overload of the above, which writes into a caller-provided buffer and returns the written prefix.
+// For a description of the method's arguments, refer to 'render.cpp'
+std::span<Ray> generatePixelRays(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays);
+
+// Given a feature config, returns the nr. of camera rays `generatePixelRays()` generates per pixel.
+uint32_t numPixelRays(const Features& features);
+
+// Result of adaptively sampling a single pixel; see `renderPixelAdaptive()`
+struct AdaptivePixelSample {
+    glm::vec3 radiance; // Mean radiance over all samples
+    uint32_t numSamples; // Nr. of camera rays traced through the pixel
+    float error; // Estimated relative standard error of the mean luminance
+};
+
+// Given a render state, camera, pixel position, and output resolution, keeps adding batches of camera rays
+// at random positions inside the pixel until its estimated error drops below a threshold, or a cap is reached.
+// For a description of the method's arguments, refer to 'render.cpp'
+AdaptivePixelSample renderPixelAdaptive(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution);
+
+// Allocation-free overload of the above; draws its batches of camera rays into a caller-provided buffer of at
+// least `numPixelRays(state.features)` rays, which is typically reused across all pixels a thread renders.
+AdaptivePixelSample renderPixelAdaptive(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rayBuffer);
+
+// A rectangle of pixels [begin, end); the unit of work handed out by the `TileScheduler`
+struct RenderTile {
+    glm::ivec2 begin;
+    glm::ivec2 end;
+};
+
+// Given a screen resolution, splits the screen into square tiles, and sorts these in the given order.
+// For a description of the method's arguments, refer to 'render.cpp'
+std::vector<RenderTile> generateRenderTiles(glm::ivec2 resolution, uint32_t tileSize, TileOrder order);
+
+// Work-stealing scheduler, which hands out tiles to render threads. Each thread owns a queue, which it
+// takes tiles from in order; once it runs dry, the thread steals from the far end of another thread's queue,
+// s.t. threads do not stall behind one expensive region of the image.
+class TileScheduler {
+public:
+    TileScheduler(std::span<const RenderTile> tiles, uint32_t numThreads);
+
+    // Return the next tile for the thread with the given index in [0, numThreads), or nothing once done
+    std::optional<RenderTile> next(uint32_t threadIndex);
+
+private:
+    struct TileQueue {
+        std::mutex mutex;
+        std::deque<RenderTile> tiles;
+    };
+
+    std::vector<TileQueue> m_queues;
+};
+
+// Progressive renderer for the interactive view; each frame traces one more camera ray per pixel, adds
+// its radiance to a float accumulation buffer, and presents the running average. Accumulation restarts
+// by itself whenever the camera, the lights, the scene, the features, or the resolution change.
+class ProgressiveRenderer {
+public:
+    // Nr. of samples per pixel after which accumulation stops, and frames only present the converged image
+    static constexpr uint32_t MaxSamples = 4096;
+
+    // Given the same input as for `renderImage()`, adds one sample per pixel, and writes the average to the screen.
+    // For a description of the method's arguments, refer to 'render.cpp'
+    void renderFrame(const Scene& scene, const BVHInterface& bvh, const Features& features, const Trackball& camera, Screen& screen);
+
+    // Drop all accumulated samples, e.g. after changes that are not detected automatically, such as a rebuilt bvh
+    void reset();
+
+    // Nr. of samples per pixel in the currently presented image
+    [[nodiscard]] uint32_t numSamples() const;
+
+private:
+    std::vector<glm::vec3> m_accumulation;
+    uint32_t m_numSamples = 0;
+
+    // Inputs of the accumulated samples, compared against each frame's inputs
+    Features m_features;
+    glm::mat4 m_viewMatrix { 1.0f };
+    glm::mat4 m_projectionMatrix { 1.0f };
+    CameraFrame m_camera;
+    std::vector<Scene::SceneLight> m_lights;
+    LightBVH m_lightBvh; // Rebuilt only when the lights change
+    PackedLights m_packedLights; // Rebuilt only when the lights change
+    SceneType m_sceneType = SceneType::SingleTriangle;
+};
+
 /* Unfinished render code; you have to implement the following method */
 
-// TODO: standard feature
 // Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
-// uniformly throughout this pixel.
-// For a description of the method's arguments, refer to 'render.cpp'
+// uniformly throughout this pixel; this forwards to the allocation-free overload below.
 // This method is unit-tested, so do not change the function signature.
 std::vector<Ray> generatePixelRaysUniform(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution);
 
 // TODO: standard feature
 // Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
-// using stratified/jittered sampling throughout this pixel.
-// For a description of the method's arguments, refer to 'extra.cpp'
+// uniformly throughout this pixel, and writes these into a caller-provided buffer.
+// For a description of the method's arguments, refer to 'render.cpp'
+std::span<Ray> generatePixelRaysUniform(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays);
+
+// Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
+// using stratified/jittered sampling throughout this pixel; this forwards to the allocation-free overload below.
+std::vector<Ray> generatePixelRaysStratified(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution);
+
+// TODO: standard feature
+// Given a render state, camera, pixel position, and output resolution, generates a set of camera ray samples placed
+// using stratified/jittered sampling throughout this pixel, and writes these into a caller-provided buffer.
+// For a description of the method's arguments, refer to 'render.cpp'
 // This method is not unit-tested, but we do expect to find it **exactly here**, and we'd rather
 // not go on a hunting expedition for your implementation, so please keep it here!
-std::vector<Ray> generatePixelRaysStratified(RenderState& state, const Trackball& camera, glm::ivec2 pixel, glm::ivec2 screenResolution);
+std::span<Ray> generatePixelRaysStratified(RenderState& state, const CameraFrame& camera, glm::ivec2 pixel, glm::ivec2 screenResolution, std::span<Ray> rays);
@@ -1,18 +1,39 @@
 #pragma once
 
+#include "common.h"
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <glm/vec2.hpp>
 DISABLE_WARNINGS_POP()
+#include <array>
 #include <random>
 #include <utility>
 
 // Simple fast 1d/2d sampler for drawing uniformly distributed samples in [0, 1),
 // based on the pcg integer hash; https://www.pcg-random.org/
 // - Not thread-safe, do not share across threads.
+//
+// Optionally, the sampler instead draws from a low-discrepancy sequence; see `SampleSequence`. A pixel's
+// samples are then points of one sequence, and each 1d/2d draw within a sample uses the next dimension.
+// Only two Sobol dimensions are used, so every dimension is a (0, 2)-sequence whose sample order is shuffled
+// and whose points are Owen-scrambled with their own seed, which decorrelates the dimensions from one
+// another; Burley, "Practical Hash-based Owen Scrambling", JCGT 2020.
+// - Until the first `nextSample()`, draws walk the first dimension from one sample to the next, s.t. the
+//   batch of camera rays `generatePixelRays()` draws up front is stratified across the pixel.
+// - `nextSample()` then starts the paths of these camera rays, one after the other, at the second dimension.
+// - `nextCameraSample()` draws the first dimension of the next camera ray explicitly, also once paths were
+//   started; e.g. to draw the camera rays of a pixel in several batches.
 class Sampler {
     uint32_t m_state;
 
+    // State of the low-discrepancy sequence, if any
+    SampleSequence m_sequence = SampleSequence::Random;
+    uint32_t m_seed = 0; // Scrambling seed, unique per pixel
+    uint32_t m_nextCameraSample = 0; // Index of the sample the next camera sample is drawn for
+    uint32_t m_nextSample = 0; // Index of the sample `nextSample()` starts
+    uint32_t m_sample = 0; // Index of the current sample
+    uint32_t m_dimension = 0; // Next dimension drawn in the current sample; 0 while drawing camera samples
+
     uint32_t pcg_hash(uint32_t& state)
     {
         state = state * 747796405u + 2891336453u;
@@ -24,6 +45,92 @@ class Sampler {
         return v;
     }
 
+    static uint32_t hash(uint32_t v)
+    {
+        v = v * 747796405u + 2891336453u;
+        v = ((v >> ((v >> 28u) + 4u)) ^ v) * 277803737u;
+        return (v >> 22u) ^ v;
+    }
+
+    static uint32_t reverseBits(uint32_t v)
+    {
+        v = ((v >> 1u) & 0x55555555u) | ((v & 0x55555555u) << 1u);
+        v = ((v >> 2u) & 0x33333333u) | ((v & 0x33333333u) << 2u);
+        v = ((v >> 4u) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4u);
+        v = ((v >> 8u) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8u);
+        return (v >> 16u) | (v << 16u);
+    }
+
+    // Burley's variant of the Laine-Karras permutation; each bit is flipped dependent on the bits below it
+    static uint32_t laineKarrasPermutation(uint32_t v, uint32_t seed)
+    {
+        v += seed;
+        v ^= v * 0x6c50b47cu;
+        v ^= v * 0xb82f1e52u;
+        v ^= v * 0xc7afe638u;
+        v ^= v * 0x8d22f6e6u;
+        return v;
+    }
+
+    // Owen scrambling of the bits of v, where each bit is flipped dependent on the bits above it
+    static uint32_t owenScramble(uint32_t v, uint32_t seed)
+    {
+        return reverseBits(laineKarrasPermutation(reverseBits(v), seed));
+    }
+
+    // Second dimension of the Sobol sequence; its generator matrix is the upper triangular Pascal matrix mod 2.
+    // Scrambled indices use all 32 bits, so the matrix is applied a byte at a time, through precomputed tables.
+    using SobolTables = std::array<std::array<uint32_t, 256>, 4>;
+    static constexpr SobolTables sobolSecondDimensionTables()
+    {
+        std::array<uint32_t, 32> directions {};
+        directions[0] = 1u << 31u;
+        for (size_t bit = 1; bit < directions.size(); bit++)
+            directions[bit] = directions[bit - 1] ^ (directions[bit - 1] >> 1u);
+
+        SobolTables tables {};
+        for (size_t byte = 0; byte < tables.size(); byte++) {
+            for (uint32_t value = 0; value < 256u; value++) {
+                for (size_t bit = 0; bit < 8; bit++) {
+                    if (value & (1u << bit))
+                        tables[byte][value] ^= directions[byte * 8 + bit];
+                }
+            }
+        }
+        return tables;
+    }
+
+    static uint32_t sobolSecondDimension(uint32_t index)
+    {
+        static constexpr SobolTables tables = sobolSecondDimensionTables();
+        return tables[0][index & 0xFFu] ^ tables[1][(index >> 8u) & 0xFFu] ^ tables[2][(index >> 16u) & 0xFFu] ^ tables[3][index >> 24u];
+    }
+
+    // Map the upper 24 bits onto [0, 1), s.t. the result never rounds up to 1
+    static float toUnitFloat(uint32_t v)
+    {
+        return static_cast<float>(v >> 8u) * 0x1p-24f;
+    }
+
+    // Draw the 2d point of the given sample in the given dimension of the scrambled sequence
+    glm::vec2 sequencePoint(uint32_t sample, uint32_t dimension) const
+    {
+        const uint32_t seed = hash(m_seed ^ hash(dimension));
+        const uint32_t index = owenScramble(sample, seed);
+        // The first Sobol dimension reverses the index's bits, which cancels against the reversal in its scramble
+        return {
+            toUnitFloat(reverseBits(laineKarrasPermutation(index, hash(seed ^ 0x68bc21ebu)))),
+            toUnitFloat(owenScramble(sobolSecondDimension(index), hash(seed ^ 0x02e5be93u)))
+        };
+    }
+
+    glm::vec2 nextSequencePoint()
+    {
+        if (m_dimension == 0)
+            return sequencePoint(m_nextCameraSample++, 0);
+        return sequencePoint(m_sample, m_dimension++);
+    }
+
 public:
     // Seeded constructor, by default draws from std::random_device
     Sampler(uint32_t seed = std::random_device()())
@@ -32,15 +139,46 @@ public:
         // ...
     }
 
+    // Seeded constructor, which draws from the given sequence, starting at the sample with the given index;
+    // e.g. to continue a pixel's sequence across progressively rendered frames
+    Sampler(uint32_t seed, SampleSequence sequence, uint32_t firstSample = 0)
+        : m_state(seed + firstSample * 0x9e3779b9u)
+        , m_sequence(sequence)
+        , m_seed(hash(seed))
+        , m_nextCameraSample(firstSample)
+        , m_nextSample(firstSample)
+    {
+    }
+
+    // Start the next sample; subsequent draws continue the path of the next camera ray. Has no effect on random samples.
+    void nextSample()
+    {
+        m_sample = m_nextSample++;
+        m_dimension = 1;
+    }
+
+    // Draw the 2d position of the next camera ray inside its pixel, in [0, 1); the ray's path is then
+    // started by a later `nextSample()`
+    glm::vec2 nextCameraSample()
+    {
+        if (m_sequence != SampleSequence::Random)
+            return sequencePoint(m_nextCameraSample++, 0);
+        return next_2d();
+    }
+
     // Draw a 1d sample in [a, b)
     float next_1d()
     {
+        if (m_sequence != SampleSequence::Random)
+            return nextSequencePoint().x;
         return static_cast<float>(pcg_hash(m_state)) / 4294967295.f;
     }
 
     // Draw a 2d sample in [a, b)
     glm::vec2 next_2d()
     {
+        if (m_sequence != SampleSequence::Random)
+            return nextSequencePoint();
         return { next_1d(), next_1d() };
     }
-};
\ No newline at end of file
+};
@@ -1,22 +1,23 @@
 #include "scene.h"
+#include <framework/mesh_cache.h>
 #include <cmath>
 #include <iostream>
 
-Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir)
+Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir, const std::filesystem::path& cacheDir)
 {
     Scene scene;
     scene.type = type;
     switch (type) {
     case SingleTriangle: {
         // Load a 3D model with a single triangle
-        auto subMeshes = loadMesh(dataDir / "triangle.obj");
+        auto subMeshes = loadMeshCached(dataDir / "triangle.obj", {}, cacheDir);
         subMeshes[0].material.kd = glm::vec3(1.0f);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
     } break;
     case Cube: {
         // Load a 3D model of a cube with 12 triangles
-        auto subMeshes = loadMesh(dataDir / "cube.obj");
+        auto subMeshes = loadMeshCached(dataDir / "cube.obj", {}, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         // scene.lights.push_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
         scene.lights.emplace_back(SegmentLight {
@@ -27,19 +28,19 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir)
         });
     } break;
     case CubeTextured: {
-        auto subMeshes = loadMesh(dataDir / "cube-textured.obj");
+        auto subMeshes = loadMeshCached(dataDir / "cube-textured.obj", {}, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1.0, 1.5, -1.0), glm::vec3(1) });
     } break;
     case CornellBox: {
         // Load a 3D model of a Cornell Box
-        auto subMeshes = loadMesh(dataDir / "CornellBox-Mirror-Rotated.obj", { .normalizeVertexPositions = true });
+        auto subMeshes = loadMeshCached(dataDir / "CornellBox-Mirror-Rotated.obj", { .normalizeVertexPositions = true }, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(0, 0.58f, 0), glm::vec3(1) }); // Light at the top of the box
     } break;
     case CornellBoxTransparency: {
         // Load a 3D model of a Cornell Box
-        auto subMeshes = loadMesh(dataDir / "CornellBox-Mirror-Rotated.obj", { .normalizeVertexPositions = true });
+        auto subMeshes = loadMeshCached(dataDir / "CornellBox-Mirror-Rotated.obj", { .normalizeVertexPositions = true }, cacheDir);
         // for (auto &mesh : subMeshes)
         //     mesh.material.transparency = 0.5f;
         subMeshes[6].material = Material {
@@ -59,7 +60,7 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir)
     } break;
     case CornellBoxParallelogramLight: {
         // Load a 3D model of a Cornell Box
-        auto subMeshes = loadMesh(dataDir / "CornellBox-Mirror-Rotated.obj", { .normalizeVertexPositions = true });
+        auto subMeshes = loadMeshCached(dataDir / "CornellBox-Mirror-Rotated.obj", { .normalizeVertexPositions = true }, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         // Light at the top of the box.
         scene.lights.emplace_back(ParallelogramLight {
@@ -74,20 +75,20 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir)
     } break;
     case Monkey: {
         // Load a 3D model of a Monkey
-        auto subMeshes = loadMesh(dataDir / "monkey.obj", { .normalizeVertexPositions = true });
+        auto subMeshes = loadMeshCached(dataDir / "monkey.obj", { .normalizeVertexPositions = true }, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
         scene.lights.emplace_back(PointLight { glm::vec3(1, -1, -1), glm::vec3(1) });
     } break;
     case Teapot: {
         // Load a 3D model of a Teapot
-        auto subMeshes = loadMesh(dataDir / "teapot.obj", { .normalizeVertexPositions = true });
+        auto subMeshes = loadMeshCached(dataDir / "teapot.obj", { .normalizeVertexPositions = true }, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
     } break;
     case Dragon: {
         // Load a 3D model of a Dragon
-        auto subMeshes = loadMesh(dataDir / "dragon.obj", { .normalizeVertexPositions = true });
+        auto subMeshes = loadMeshCached(dataDir / "dragon.obj", { .normalizeVertexPositions = true }, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
     } break;
@@ -99,7 +100,7 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir)
     } break;
     case Custom: {
         // === Replace custom.obj by your own 3D model (or call your 3D model custom.obj) ===
-        auto subMeshes = loadMesh(dataDir / "custom.obj");
+        auto subMeshes = loadMeshCached(dataDir / "custom.obj", {}, cacheDir);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         // === CHANGE THE LIGHTING IF DESIRED ===
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
@@ -111,12 +112,12 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir)
     return scene;
 }
 
-Scene loadSceneFromFile(const std::filesystem::path& path, const std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>>& lights)
+Scene loadSceneFromFile(const std::filesystem::path& path, const std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>>& lights, const std::filesystem::path& cacheDir)
 {
     Scene scene;
     scene.lights = lights;
 
-    auto subMeshes = loadMesh(path);
+    auto subMeshes = loadMeshCached(path, {}, cacheDir);
     std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
 
     return scene;
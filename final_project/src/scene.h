@@ -38,8 +38,8 @@ struct Scene {
     // ...
 };
 
-// Load a prebuilt scene.
-Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir);
+// Load a prebuilt scene; parsed meshes are cached in `cacheDir`.
+Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir, const std::filesystem::path& cacheDir);
 
-// Load a scene from a file.
-Scene loadSceneFromFile(const std::filesystem::path& path, const std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>>& lights);
+// Load a scene from a file; parsed meshes are cached in `cacheDir`.
+Scene loadSceneFromFile(const std::filesystem::path& path, const std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>>& lights, const std::filesystem::path& cacheDir);
@@ -0,0 +1,362 @@
+#include "wavefront.h"
+#include "bvh.h"
+#include "bvh_interface.h"
+#include "camera.h"
+#include "extra.h"
+#include "light.h"
+#include "light_bvh.h"
+#include "packed_lights.h"
+#include "recursive.h"
+#include "render.h"
+#include "sampler.h"
+#include "scene.h"
+#include "screen.h"
+#include "shading.h"
+#include <algorithm>
+#include <array>
+#include <span>
+#include <utility>
+#include <variant>
+#ifdef NDEBUG
+#include <omp.h>
+#endif
+
+// Width and height of a chunk of pixels traced together; a chunk's queues hold a few thousand rays per stage
+constexpr uint32_t ChunkSize = 64;
+
+// Nr. of rays intersected together by `intersectRayPacketWithBVH()` in the extend stage
+constexpr size_t ExtendPacketSize = 32;
+
+void WavefrontRayQueue::push(const Ray& ray, const glm::vec3& weight, uint32_t pixel, uint32_t depth)
+{
+    origins.push_back(ray.origin);
+    directions.push_back(ray.direction);
+    distances.push_back(ray.t);
+    weights.push_back(weight);
+    pixels.push_back(pixel);
+    depths.push_back(depth);
+}
+
+void WavefrontRayQueue::clear()
+{
+    origins.clear();
+    directions.clear();
+    distances.clear();
+    weights.clear();
+    pixels.clear();
+    depths.clear();
+    hitInfos.clear();
+    isHit.clear();
+}
+
+size_t WavefrontRayQueue::size() const
+{
+    return pixels.size();
+}
+
+Ray WavefrontRayQueue::ray(size_t i) const
+{
+    return { .origin = origins[i], .direction = directions[i], .t = distances[i] };
+}
+
+void WavefrontShadowQueue::push(const Ray& ray, const glm::vec3& contribution, uint32_t pixel)
+{
+    origins.push_back(ray.origin);
+    directions.push_back(ray.direction);
+    distances.push_back(ray.t);
+    contributions.push_back(contribution);
+    pixels.push_back(pixel);
+}
+
+void WavefrontShadowQueue::clear()
+{
+    origins.clear();
+    directions.clear();
+    distances.clear();
+    contributions.clear();
+    pixels.clear();
+}
+
+size_t WavefrontShadowQueue::size() const
+{
+    return pixels.size();
+}
+
+// Per-thread state of the wavefront renderer; its vectors keep their capacity across chunks
+struct WavefrontChunk {
+    // Per-pixel state of the current chunk
+    std::vector<glm::ivec2> pixelCoords;
+    std::vector<Sampler> samplers;
+    std::vector<glm::vec3> radiance;
+    std::vector<Ray> rayBuffer; // A single pixel's camera rays, before these are queued
+
+    // Rays of the current ray depth, those spawned for the next depth, and pending shadow rays
+    WavefrontRayQueue rays;
+    WavefrontRayQueue secondaryRays;
+    WavefrontShadowQueue shadowRays;
+};
+
+// Generate stage; seeds each pixel's sampler exactly as `renderImage()` does, and queues the pixel's camera
+// rays, each weighted s.t. the pixel receives their average, as in `renderRays()`
+static void generateStage(RenderState& state, const CameraFrame& camera, glm::ivec2 resolution, const RenderTile& tile, WavefrontChunk& chunk)
+{
+    chunk.pixelCoords.clear();
+    chunk.samplers.clear();
+    chunk.radiance.clear();
+    chunk.rays.clear();
+    chunk.secondaryRays.clear();
+    chunk.shadowRays.clear();
+
+    chunk.rayBuffer.resize(numPixelRays(state.features));
+    for (int y = tile.begin.y; y < tile.end.y; y++) {
+        for (int x = tile.begin.x; x < tile.end.x; x++) {
+            const auto pixel = static_cast<uint32_t>(chunk.pixelCoords.size());
+            state.sampler = Sampler(static_cast<uint32_t>(resolution.y * x + y), state.features.extra.sampleSequence);
+            auto rays = generatePixelRays(state, camera, { x, y }, resolution, chunk.rayBuffer);
+            // The pixel's camera rays are traced stage by stage, interleaved, so they all draw from a single sample
+            state.sampler.nextSample();
+
+            chunk.pixelCoords.push_back({ x, y });
+            chunk.samplers.push_back(state.sampler);
+            chunk.radiance.push_back(glm::vec3(0.0f));
+            const glm::vec3 weight { 1.0f / static_cast<float>(std::max<size_t>(rays.size(), 1)) };
+            for (const Ray& ray : rays) {
+                chunk.rays.push(ray, weight, pixel, 0);
+            }
+        }
+    }
+}
+
+// Extend stage; finds the closest hit of every queued ray. Camera rays are coherent, and are traced through the bvh
+// in packets; secondary rays scatter in all directions, and are traced one by one, as `renderRay()` does.
+static void extendStage(RenderState& state, WavefrontRayQueue& queue, bool isCoherent)
+{
+    const size_t numRays = queue.size();
+    queue.hitInfos.resize(numRays);
+    queue.isHit.resize(numRays);
+
+    if (!isCoherent) {
+        for (size_t i = 0; i < numRays; i++) {
+            Ray ray = queue.ray(i);
+            queue.isHit[i] = static_cast<uint8_t>(state.bvh.intersect(state, ray, queue.hitInfos[i]));
+            queue.distances[i] = ray.t;
+        }
+        return;
+    }
+
+    std::array<Ray, ExtendPacketSize> packet;
+    for (size_t first = 0; first < numRays; first += ExtendPacketSize) {
+        const size_t count = std::min(ExtendPacketSize, numRays - first);
+        for (size_t i = 0; i < count; i++) {
+            packet[i] = queue.ray(first + i);
+        }
+        uint32_t hitMask = intersectRayPacketWithBVH(state, state.bvh, std::span(packet.data(), count), std::span(queue.hitInfos).subspan(first, count));
+        for (size_t i = 0; i < count; i++) {
+            queue.distances[first + i] = packet[i].t;
+            queue.isHit[first + i] = static_cast<uint8_t>((hitMask >> i) & 1u);
+        }
+    }
+}
+
+// Evaluates the direct light at a hit, as `computeLightContribution()` does. Point lights behind binary shadows are
+// split in two; their shading is evaluated here, and their visibility is deferred to the shadow connect stage by
+// queueing a shadow ray. This requires `computeContributionPointLight()` to return the light's shading times its
+// `visibilityOfLightSampleBinary()`, which tests the same shadow ray. Area lights, and point lights behind transparent
+// shadows, are evaluated in place, by the same functions `computeLightContribution()` calls. With the light bvh
+// enabled, only the lights drawn from it are evaluated, each scaled by its inverse probability.
+// - return; the direct light that is not deferred to the shadow connect stage
+static glm::vec3 shadeDirectLight(RenderState& state, const Ray& ray, const HitInfo& hitInfo, const glm::vec3& weight, uint32_t pixel, WavefrontShadowQueue& shadowRays)
+{
+    const bool deferShadows = state.features.enableShadows && !state.features.enableTransparency;
+    const glm::vec3 p = ray.origin + ray.t * ray.direction;
+
+    const bool usePackedLights = state.features.extra.enablePackedLights && state.packedLights;
+    const auto shadeLight = [&](uint32_t lightIndex, float lightWeight) -> glm::vec3 {
+        const Scene::SceneLight& light = state.scene.lights[lightIndex];
+        if (std::holds_alternative<PointLight>(light)) {
+            const auto& pointLight = std::get<PointLight>(light);
+            if (!state.features.enableShadows || deferShadows) {
+                glm::vec3 l = glm::normalize(pointLight.position - p);
+                glm::vec3 shading = lightWeight * computeShading(state, -ray.direction, l, pointLight.color, hitInfo);
+                if (deferShadows) {
+                    shadowRays.push(generateShadowRay(pointLight.position, ray, hitInfo), weight * shading, pixel);
+                    return glm::vec3(0.0f);
+                }
+                return shading;
+            }
+            return lightWeight * computeContributionPointLight(state, pointLight, ray, hitInfo);
+        } else if (usePackedLights) {
+            return lightWeight * state.packedLights->computeContribution(state, lightIndex, ray, hitInfo);
+        } else if (std::holds_alternative<SegmentLight>(light)) {
+            return lightWeight * computeContributionSegmentLight(state, std::get<SegmentLight>(light), ray, hitInfo, state.features.numShadowSamples);
+        } else if (std::holds_alternative<ParallelogramLight>(light)) {
+            return lightWeight * computeContributionParallelogramLight(state, std::get<ParallelogramLight>(light), ray, hitInfo, state.features.numShadowSamples);
+        }
+        return glm::vec3(0.0f);
+    };
+
+    glm::vec3 Lo { 0.0f };
+    if (state.features.extra.enableLightBvh && state.lightBvh) {
+        const uint32_t numSamples = std::max(state.features.extra.numLightBvhSamples, 1u);
+        for (uint32_t i = 0; i < numSamples; i++) {
+            if (auto sample = state.lightBvh->sample(state.sampler.next_1d())) {
+                Lo += shadeLight(sample->lightIndex, 1.0f / (sample->pdf * static_cast<float>(numSamples)));
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < state.scene.lights.size(); i++) {
+            Lo += shadeLight(i, 1.0f);
+        }
+    }
+    return Lo;
+}
+
+// Secondary rays of a hit, selected as in `renderTracedRay()`
+struct SecondaryRays {
+    bool isSpecular = false; // Spawns a mirrored ray
+    bool isGlossy = false; // Left to `renderTracedRay()`, as glossy reflections are not queued
+    bool isTransparent = false; // Spawns a passthrough ray, and blends the hit towards its light
+};
+
+static SecondaryRays secondaryRays(const Features& features, const HitInfo& hitInfo, uint32_t depth)
+{
+    if (depth >= static_cast<uint32_t>(MaxRayDepth)) {
+        return {};
+    }
+    const bool isReflective = glm::any(glm::notEqual(hitInfo.material.ks, glm::vec3(0.0f)));
+    const bool isTransparent = hitInfo.material.transparency != 1.f;
+    return {
+        .isSpecular = features.enableReflections && !features.extra.enableGlossyReflection && isReflective,
+        .isGlossy = features.enableReflections && features.extra.enableGlossyReflection && isReflective,
+        .isTransparent = features.enableTransparency && isTransparent
+    };
+}
+
+// Weight of a hit's own light, i.e. its direct light and specular reflection, in its pixel; a transparent hit keeps
+// only the part of its ray's weight that is not passed through, as in `renderRayTransparentComponent()`
+static glm::vec3 hitColorWeight(const SecondaryRays& secondary, const HitInfo& hitInfo, const glm::vec3& weight)
+{
+    return secondary.isTransparent ? weight * (1.0f - transparentRayWeight(hitInfo)) : weight;
+}
+
+// Shade stage; evaluates the direct light at every queued ray's hit, as `renderTracedRay()` does, and queues shadow
+// rays for the shadow connect stage. Hits with glossy reflections are left to `renderTracedRay()`, which recurses
+// depth-first into `renderRayGlossyComponent()`.
+static void shadeStage(RenderState& state, WavefrontChunk& chunk)
+{
+    const WavefrontRayQueue& queue = chunk.rays;
+    for (size_t i = 0; i < queue.size(); i++) {
+        const uint32_t pixel = queue.pixels[i];
+        const Ray ray = queue.ray(i);
+        const glm::vec3& weight = queue.weights[i];
+        state.sampler = chunk.samplers[pixel];
+
+        if (!queue.isHit[i]) {
+            chunk.radiance[pixel] += weight * sampleEnvironmentMap(state, ray);
+        } else {
+            const HitInfo& hitInfo = queue.hitInfos[i];
+            const SecondaryRays secondary = secondaryRays(state.features, hitInfo, queue.depths[i]);
+            if (secondary.isGlossy) {
+                chunk.radiance[pixel] += weight * renderTracedRay(state, ray, true, hitInfo, static_cast<int>(queue.depths[i]));
+            } else {
+                const glm::vec3 hitWeight = hitColorWeight(secondary, hitInfo, weight);
+                chunk.radiance[pixel] += hitWeight * shadeDirectLight(state, ray, hitInfo, hitWeight, pixel, chunk.shadowRays);
+            }
+        }
+        chunk.samplers[pixel] = state.sampler;
+    }
+}
+
+// Spawn stage; queues the mirrored and passthrough rays of every queued ray's hit for the next ray depth, weighted
+// by `specularRayWeight()` and `transparentRayWeight()`, the same helpers the recursive components use.
+static void spawnStage(RenderState& state, WavefrontChunk& chunk)
+{
+    const WavefrontRayQueue& queue = chunk.rays;
+    chunk.secondaryRays.clear();
+    for (size_t i = 0; i < queue.size(); i++) {
+        if (!queue.isHit[i]) {
+            continue;
+        }
+
+        const HitInfo& hitInfo = queue.hitInfos[i];
+        const SecondaryRays secondary = secondaryRays(state.features, hitInfo, queue.depths[i]);
+        if (secondary.isGlossy) {
+            continue;
+        }
+
+        const Ray ray = queue.ray(i);
+        const glm::vec3& weight = queue.weights[i];
+        if (secondary.isSpecular) {
+            const glm::vec3 hitWeight = hitColorWeight(secondary, hitInfo, weight);
+            chunk.secondaryRays.push(generateReflectionRay(ray, hitInfo), hitWeight * specularRayWeight(hitInfo), queue.pixels[i], queue.depths[i] + 1);
+        }
+        if (secondary.isTransparent) {
+            chunk.secondaryRays.push(generatePassthroughRay(ray, hitInfo), weight * transparentRayWeight(hitInfo), queue.pixels[i], queue.depths[i] + 1);
+        }
+    }
+}
+
+// Shadow connect stage; adds the contribution of every queued shadow ray that reaches its light unoccluded
+static void shadowConnectStage(RenderState& state, WavefrontChunk& chunk)
+{
+    const WavefrontShadowQueue& queue = chunk.shadowRays;
+    for (size_t i = 0; i < queue.size(); i++) {
+        const Ray shadowRay = { .origin = queue.origins[i], .direction = queue.directions[i], .t = queue.distances[i] };
+        if (!isRayOccludedInBVH(state, state.bvh, shadowRay, shadowRay.t)) {
+            chunk.radiance[queue.pixels[i]] += queue.contributions[i];
+        }
+    }
+}
+
+// Renders a single chunk of pixels; extend, shade, and spawn run over all of the chunk's rays of one ray depth at
+// a time, until no more secondary rays are spawned
+static void renderChunk(RenderState& state, const CameraFrame& camera, const RenderTile& tile, WavefrontChunk& chunk, Screen& screen)
+{
+    generateStage(state, camera, screen.resolution(), tile, chunk);
+    extendStage(state, chunk.rays, true);
+    while (true) {
+        shadeStage(state, chunk);
+        spawnStage(state, chunk);
+        if (chunk.secondaryRays.size() == 0) {
+            break;
+        }
+        std::swap(chunk.rays, chunk.secondaryRays);
+        extendStage(state, chunk.rays, false);
+    }
+    shadowConnectStage(state, chunk);
+
+    for (size_t pixel = 0; pixel < chunk.pixelCoords.size(); pixel++) {
+        screen.setPixel(chunk.pixelCoords[pixel].x, chunk.pixelCoords[pixel].y, chunk.radiance[pixel]);
+    }
+}
+
+// Given the same input as for `renderImage()`, renders the image with a wavefront renderer. The screen is split
+// into square chunks of pixels, which threads render independently. Inside a chunk, all rays of a ray depth pass
+// through each stage together, s.t. every stage is a tight loop over structure-of-arrays queues.
+// - scene;    the active scene
+// - bvh;      the bvh generated over the current scene
+// - features; the feature config that is active
+// - camera;   the camera object, used for ray generation
+// - screen;   the output screen
+// - lightBvh; optional hierarchy over the scene's lights, used if `features.extra.enableLightBvh` is set
+// - packedLights; optional packed copy of the scene's lights, used if `features.extra.enablePackedLights` is set
+// Each pixel's sampler is seeded as in `renderImage()`; images are equal to those of `renderImage()` up to float
+// rounding, except that stochastic effects may draw their random numbers in a different order, as a pixel's camera
+// and secondary rays are processed stage by stage and depth by depth, instead of one after the other.
+void renderImageWavefront(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen, const LightBVH* lightBvh, const PackedLights* packedLights)
+{
+    const auto chunks = generateRenderTiles(screen.resolution(), ChunkSize, TileOrder::Scanline);
+#ifdef NDEBUG // Enable multi threading in Release mode
+#pragma omp parallel
+#endif
+    {
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .lightBvh = lightBvh, .packedLights = packedLights, .sampler = { 0 } };
+        WavefrontChunk chunk;
+#ifdef NDEBUG
+#pragma omp for schedule(dynamic)
+#endif
+        for (int i = 0; i < static_cast<int>(chunks.size()); i++) {
+            renderChunk(state, camera, chunks[i], chunk, screen);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+#include "fwd.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/ray.h>
+#include <cstdint>
+#include <vector>
+
+// Structure-of-arrays queue of camera or secondary rays in flight through the wavefront renderer. Each ray carries
+// the weight with which its radiance contributes to its pixel, s.t. stages add radiance to pixels directly.
+struct WavefrontRayQueue {
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+    std::vector<float> distances; // Distance to the closest hit after the extend stage
+    std::vector<glm::vec3> weights; // Weight of the ray's radiance in its pixel
+    std::vector<uint32_t> pixels; // Index of the pixel in the current chunk
+    std::vector<uint32_t> depths; // Recursive ray depth, as in `renderRay()`; zero for camera rays
+
+    // Filled in by the extend stage
+    std::vector<HitInfo> hitInfos;
+    std::vector<uint8_t> isHit;
+
+    void push(const Ray& ray, const glm::vec3& weight, uint32_t pixel, uint32_t depth);
+    void clear();
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] Ray ray(size_t i) const;
+};
+
+// Structure-of-arrays queue of shadow rays; each one adds its unoccluded contribution to its pixel
+// when nothing blocks it in the shadow connect stage.
+struct WavefrontShadowQueue {
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+    std::vector<float> distances; // Range in which a hit occludes the light
+    std::vector<glm::vec3> contributions; // Weighted radiance added to the pixel if the light is visible
+    std::vector<uint32_t> pixels; // Index of the pixel in the current chunk
+
+    void push(const Ray& ray, const glm::vec3& contribution, uint32_t pixel);
+    void clear();
+    [[nodiscard]] size_t size() const;
+};
+
+// Given the same input as for `renderImage()`, renders the image with a wavefront (stream) renderer instead of
+// the depth-first `renderRay()`. The screen is split into chunks of pixels, whose rays flow through separate,
+// batched stages; generate, extend, shade, spawn, and shadow connect. Specular reflections and passthrough rays are
+// queued by the spawn stage, and run through extend, shade, and spawn again, one ray depth at a time. Glossy
+// reflections are shaded depth-first by `renderTracedRay()`.
+// For a description of the method's arguments, refer to 'wavefront.cpp'
+void renderImageWavefront(const Scene& scene, const BVHInterface& bvh, const Features& features, const CameraFrame& camera, Screen& screen, const LightBVH* lightBvh = nullptr, const PackedLights* packedLights = nullptr);
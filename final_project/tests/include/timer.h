@@ -1,9 +1,14 @@
 #pragma once
 
 #include <utility>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 
+// Nr. of heap allocations made by the test executable so far; counted by its replacement of `operator new`
+extern std::atomic<uint64_t> num_allocations;
+
 namespace test::detail
 {
 // Rather simple std::chrono-based timer for microbenchmarking
@@ -46,13 +51,13 @@ auto benchmark_region(uint32_t n_samples, std::function<void()> capture) {
   return std::chrono::duration_cast<Du>(avg);
 }
 
-auto benchmark_region_ms(uint32_t n_samples, std::function<void()> capture) {
+inline auto benchmark_region_ms(uint32_t n_samples, std::function<void()> capture) {
   return benchmark_region<std::chrono::milliseconds>(n_samples, capture); 
 }
-auto benchmark_region_us(uint32_t n_samples, std::function<void()> capture) {
+inline auto benchmark_region_us(uint32_t n_samples, std::function<void()> capture) {
   return benchmark_region<std::chrono::microseconds>(n_samples, capture); 
 }
-auto benchmark_region_ns(uint32_t n_samples, std::function<void()> capture) {
+inline auto benchmark_region_ns(uint32_t n_samples, std::function<void()> capture) {
   return benchmark_region<std::chrono::nanoseconds>(n_samples, capture); 
 }
 } // namespace test::detail
\ No newline at end of file
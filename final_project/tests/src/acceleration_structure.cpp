@@ -0,0 +1,650 @@
+#include "tests.h"
+#include "bvh.h" // Include the student's code
+#include "extra.h"
+#include "render.h"
+#include "timer.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <thread>
+#include <utility>
+
+// Count heap allocations throughout the test executable, s.t. traversal can be shown to be allocation-free;
+// other benchmarks read this counter through "timer.h"
+std::atomic<uint64_t> num_allocations = 0;
+void* operator new(std::size_t size)
+{
+    num_allocations++;
+    if (void* p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace test {
+
+// Test settings
+constexpr uint32_t num_triangles = 4096; // Nr. of random triangles in the test scene
+constexpr uint32_t num_rays = 1024; // Nr. of random rays traced against the test scene
+constexpr uint32_t num_benchmark_triangles = 262144; // Nr. of random triangles in the benchmark scene
+constexpr uint32_t num_benchmark_rays = 65536; // Nr. of random rays traced against the benchmark scene
+constexpr uint32_t num_benchmark_samples = 8; // Nr. of timed repetitions of each benchmark
+
+namespace detail {
+    // Generate a scene of small, randomly placed triangles, stretched along the x-axis and with
+    // a dense cluster around the origin, s.t. median and SAH splits produce different trees
+    inline Scene randomTriangleScene(ref::Sampler& sampler, uint32_t n)
+    {
+        Scene scene = { .type = Custom };
+        Mesh mesh;
+        for (uint32_t i = 0; i < n; ++i) {
+            glm::vec3 center = (sampler.next_3d() * 2.f - 1.f) * glm::vec3(6.f, 2.f, 2.f);
+            if (i % 7 == 0)
+                center *= 0.1f;
+            for (uint32_t j = 0; j < 3; ++j) {
+                mesh.vertices.push_back({ .position = center + (sampler.next_3d() - 0.5f) * 0.1f, .normal = {}, .texCoord = {} });
+            }
+            mesh.triangles.push_back(glm::uvec3(3 * i, 3 * i + 1, 3 * i + 2));
+        }
+        scene.meshes.push_back(mesh);
+        return scene;
+    }
+
+    // Generate a random ray through the scene's bounds
+    inline Ray randomRay(ref::Sampler& sampler)
+    {
+        return Ray {
+            .origin = (sampler.next_3d() * 2.f - 1.f) * 8.f,
+            .direction = pointOnSphere(sampler),
+            .t = std::numeric_limits<float>::max()
+        };
+    }
+
+    // Confirm every node's box contains its children's boxes or its primitives, and that
+    // every primitive is referenced by exactly one leaf
+    inline bool isValidHierarchy(const BVHInterface& bvh)
+    {
+        auto nodes = bvh.nodes();
+        auto primitives = bvh.primitives();
+        const auto contains = [](const AxisAlignedBox& outer, const AxisAlignedBox& inner) {
+            return glm::all(glm::lessThanEqual(outer.lower, inner.lower + 1e-5f))
+                && glm::all(glm::greaterThanEqual(outer.upper, inner.upper - 1e-5f));
+        };
+
+        std::vector<uint32_t> references(primitives.size(), 0);
+        std::vector<uint32_t> stack = { BVH::RootIndex };
+        while (!stack.empty()) {
+            const auto& node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.isLeaf()) {
+                for (uint32_t i = node.primitiveOffset(); i < node.primitiveOffset() + node.primitiveCount(); ++i) {
+                    references[i]++;
+                    if (!contains(node.aabb, computePrimitiveAABB(primitives[i])))
+                        return false;
+                }
+            } else {
+                if (!contains(node.aabb, nodes[node.leftChild()].aabb) || !contains(node.aabb, nodes[node.rightChild()].aabb))
+                    return false;
+                stack.push_back(node.leftChild());
+                stack.push_back(node.rightChild());
+            }
+        }
+        return rng::all_of(references, [](uint32_t r) { return r == 1; });
+    }
+
+    // Generate a closed, bumpy grid of n x n quads, each split into two triangles, and rays aimed
+    // exactly at its interior vertices and at points on its shared edges
+    inline std::pair<Scene, std::vector<Ray>> edgeGridScene(uint32_t n)
+    {
+        Scene scene = { .type = Custom };
+        Mesh mesh;
+        const auto index = [n](uint32_t x, uint32_t y) { return y * (n + 1) + x; };
+        for (uint32_t y = 0; y <= n; ++y) {
+            for (uint32_t x = 0; x <= n; ++x) {
+                glm::vec2 uv = glm::vec2(x, y) / static_cast<float>(n);
+                glm::vec3 position = { 1.37f * uv.x, 0.91f * uv.y, 0.3f * std::sin(40.f * uv.x) * std::cos(20.f * uv.y) };
+                mesh.vertices.push_back({ .position = position, .normal = {}, .texCoord = {} });
+            }
+        }
+        for (uint32_t y = 0; y < n; ++y) {
+            for (uint32_t x = 0; x < n; ++x) {
+                mesh.triangles.push_back(glm::uvec3(index(x, y), index(x + 1, y), index(x + 1, y + 1)));
+                mesh.triangles.push_back(glm::uvec3(index(x, y), index(x + 1, y + 1), index(x, y + 1)));
+            }
+        }
+
+        std::vector<Ray> rays;
+        for (uint32_t y = 1; y < n; ++y) {
+            for (uint32_t x = 1; x < n; ++x) {
+                const auto& p0 = mesh.vertices[index(x, y)].position;
+                const auto& p1 = mesh.vertices[index(x + 1, y + 1)].position;
+                const auto& p2 = mesh.vertices[index(x + 1, y)].position;
+                glm::vec3 origin = glm::vec3(0.3f + 0.013f * x, 0.2f + 0.007f * y, 5.f);
+                for (glm::vec3 target : { p0, glm::mix(p0, p1, 0.37f), glm::mix(p0, p2, 0.61f) }) {
+                    rays.push_back({ .origin = origin, .direction = glm::normalize(target - origin), .t = std::numeric_limits<float>::max() });
+                }
+            }
+        }
+        scene.meshes.push_back(mesh);
+        return { scene, rays };
+    }
+
+    // A degenerate hierarchy of the given depth over the primitives of another, in which every inner node's left
+    // child is an empty leaf and its right child the next inner node, s.t. unordered traversal leaves one pending
+    // entry per level; like other `BVHInterface` implementations may, it reports no levels at all
+    struct DeepBVH : public BVHInterface {
+        std::vector<Node> m_nodes;
+        std::vector<Primitive> m_primitives;
+
+        DeepBVH(const BVHInterface& bvh, uint32_t depth)
+            : m_primitives(bvh.primitives().begin(), bvh.primitives().end())
+        {
+            const AxisAlignedBox aabb = computeSpanAABB(m_primitives);
+            for (uint32_t i = 0; i + 1 < depth; ++i) {
+                m_nodes.push_back({ .aabb = aabb, .data = { 2 * i + 1, 2 * i + 2 } });
+                m_nodes.push_back({ .aabb = aabb, .data = { Node::LeafBit, 0 } });
+            }
+            m_nodes.push_back({ .aabb = aabb, .data = { Node::LeafBit, static_cast<uint32_t>(m_primitives.size()) } });
+        }
+
+        bool intersect(RenderState& state, Ray& ray, HitInfo& hitInfo) const override { return intersectRayWithBVH(state, *this, ray, hitInfo); }
+        std::span<const Node> nodes() const override { return m_nodes; }
+        std::span<Node> nodes() override { return m_nodes; }
+        std::span<const Primitive> primitives() const override { return m_primitives; }
+        std::span<Primitive> primitives() override { return m_primitives; }
+        uint32_t numLevels() const override { return 0; }
+        uint32_t numLeaves() const override { return static_cast<uint32_t>(m_nodes.size() / 2 + 1); }
+    };
+} // namespace detail
+
+TEST_CASE("Acceleration structure")
+{
+    // Instantiate reference objects
+    ref::Sampler sampler(4);
+    Scene scene = detail::randomTriangleScene(sampler, num_triangles);
+    std::vector<Ray> rays(num_rays);
+    rng::generate(rays, [&]() { return detail::randomRay(sampler); });
+
+    // Naive intersection over all primitives serves as the reference
+    Features features_naive = { .enableAccelStructure = false };
+    Features features_median = { .enableAccelStructure = true };
+    Features features_sah = { .enableAccelStructure = true, .extra = { .enableBvhSahBinning = true } };
+    Features features_linear = { .enableAccelStructure = true, .extra = { .enableBvhLinearBuild = true } };
+    Features features_treelet = { .enableAccelStructure = true, .extra = { .enableBvhLinearBuild = true, .enableBvhTreeletOptimization = true } };
+    BVH bvh_naive(scene, features_naive);
+    const auto trace = [&](const BVHInterface& bvh, const Features& features) {
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        return rays | vws::transform([&](Ray ray) {
+            HitInfo hitInfo;
+            return bvh.intersect(state, ray, hitInfo) ? ray.t : std::numeric_limits<float>::max();
+        }) | rng::to<std::vector>();
+    };
+    auto t_naive = trace(bvh_naive, features_naive);
+
+    SECTION("splitPrimitivesBySAHBin [Split partitions the range along the axis]")
+    {
+        auto primitives = bvh_naive.primitives() | rng::to<std::vector>();
+        auto aabb = computeSpanAABB(primitives);
+        size_t split = splitPrimitivesBySAHBin(aabb, 0, primitives);
+        CHECK((split > 0 && split < primitives.size()));
+
+        auto centroids = primitives | vws::transform([](const auto& p) { return computePrimitiveCentroid(p).x; }) | rng::to<std::vector>();
+        float left_max = rng::max(centroids | vws::take(split));
+        float right_min = rng::min(centroids | vws::drop(split));
+        CHECK(left_max <= right_min);
+    }
+
+    SECTION("sortPrimitivesByMortonCode [Codes are sorted, and splits separate the highest differing bit]")
+    {
+        auto primitives = bvh_naive.primitives() | rng::to<std::vector>();
+        auto codes = sortPrimitivesByMortonCode(primitives);
+        CHECK(rng::is_sorted(codes));
+        CHECK(computeMortonCode(glm::vec3(0.f)) == 0);
+        CHECK(computeMortonCode(glm::vec3(1.f, 0.f, 0.f)) > computeMortonCode(glm::vec3(0.f, 1.f, 1.f)));
+
+        size_t split = splitPrimitivesByMortonCode(codes);
+        CHECK((split > 0 && split < codes.size()));
+        uint64_t mask = std::bit_floor(codes.front() ^ codes.back());
+        CHECK(rng::none_of(codes | vws::take(split), [mask](uint64_t c) { return c & mask; }));
+        CHECK(rng::all_of(codes | vws::drop(split), [mask](uint64_t c) { return c & mask; }));
+    }
+
+    SECTION("BVH [Median, SAH, and linear hierarchies are valid]")
+    {
+        CHECK(detail::isValidHierarchy(BVH(scene, features_median)));
+        CHECK(detail::isValidHierarchy(BVH(scene, features_sah)));
+        CHECK(detail::isValidHierarchy(BVH(scene, features_linear)));
+        CHECK(detail::isValidHierarchy(BVH(scene, features_treelet)));
+    }
+
+    SECTION("BVH [Construction is deterministic]")
+    {
+        for (const auto& features : { features_median, features_sah, features_linear, features_treelet }) {
+            BVH a(scene, features), b(scene, features);
+            CHECK(rng::equal(a.nodes(), b.nodes(), [](const auto& x, const auto& y) {
+                return x.aabb.lower == y.aabb.lower && x.aabb.upper == y.aabb.upper && x.data == y.data;
+            }));
+            CHECK(rng::equal(a.primitives(), b.primitives(), [](const auto& x, const auto& y) {
+                return x.meshID == y.meshID && x.v0.position == y.v0.position;
+            }));
+        }
+    }
+
+    SECTION("BVH [SAH hierarchy is cheaper than median hierarchy]")
+    {
+        BVH bvh_median(scene, features_median), bvh_sah(scene, features_sah);
+        CAPTURE(bvh_median.sahCost(), bvh_sah.sahCost());
+        CHECK(bvh_sah.sahCost() < bvh_median.sahCost());
+    }
+
+    SECTION("BVH [SAH costs decide where the hierarchy stops splitting]")
+    {
+        const auto max_leaf_size = [](const BVH& bvh) {
+            uint32_t size = 0;
+            for (const auto& node : bvh.nodes())
+                if (node.isLeaf())
+                    size = std::max(size, node.primitiveCount());
+            return size;
+        };
+        Features features_cheap = features_sah, features_costly = features_sah;
+        features_cheap.extra.bvhSahTraversalCost = 0.1f;
+        features_costly.extra.bvhSahTraversalCost = 8.f;
+        BVH bvh_cheap(scene, features_cheap), bvh_costly(scene, features_costly);
+        CAPTURE(bvh_cheap.nodes().size(), bvh_costly.nodes().size());
+
+        // Expensive node tests make larger leaves pay off, but never larger than the SAH leaf limit
+        CHECK(bvh_costly.nodes().size() < bvh_cheap.nodes().size());
+        CHECK(max_leaf_size(bvh_cheap) <= BVH::MaxSahLeafSize);
+        CHECK(max_leaf_size(bvh_costly) > BVH::LeafSize);
+        CHECK(max_leaf_size(bvh_costly) <= BVH::MaxSahLeafSize);
+        CHECK(detail::isValidHierarchy(bvh_costly));
+        CHECK(trace(bvh_cheap, features_cheap) == t_naive);
+        CHECK(trace(bvh_costly, features_costly) == t_naive);
+    }
+
+    SECTION("BVH [Treelet optimization does not increase the SAH cost]")
+    {
+        BVH bvh_linear(scene, features_linear), bvh_treelet(scene, features_treelet);
+        CAPTURE(bvh_linear.sahCost(), bvh_treelet.sahCost());
+        CHECK(bvh_treelet.sahCost() <= bvh_linear.sahCost());
+        CHECK(bvh_treelet.nodes().size() == bvh_linear.nodes().size());
+    }
+
+    SECTION("BVH [Compact primitive store replaces the full primitives]")
+    {
+        Features features_compact = features_sah;
+        features_compact.extra.enableBvhCompactPrimitives = true;
+        BVH bvh_sah(scene, features_sah), bvh_compact(scene, features_compact);
+        CAPTURE(bvh_sah.primitiveMemoryFootprint(), bvh_compact.primitiveMemoryFootprint());
+        CHECK(bvh_compact.primitives().empty());
+        CHECK(bvh_compact.compactPrimitives().meshIDs.size() == num_triangles);
+        CHECK(bvh_compact.primitiveMemoryFootprint() < bvh_sah.primitiveMemoryFootprint() / 2);
+        CHECK(trace(bvh_compact, features_compact) == t_naive);
+    }
+
+    SECTION("intersectRayWithBVH [Ordered traversal matches naive intersection, and visits fewer nodes]")
+    {
+        Features features_unordered = features_sah;
+        features_unordered.extra.enableBvhOrderedTraversal = false;
+        BVH bvh_sah(scene, features_sah);
+
+        bvhTraversalStats() = {};
+        CHECK(trace(bvh_sah, features_unordered) == t_naive);
+        uint64_t visits_unordered = bvhTraversalStats().numNodeVisits;
+
+        bvhTraversalStats() = {};
+        CHECK(trace(bvh_sah, features_sah) == t_naive);
+        uint64_t visits_ordered = bvhTraversalStats().numNodeVisits;
+
+        CAPTURE(visits_unordered, visits_ordered);
+        CHECK(visits_ordered < visits_unordered);
+    }
+
+    SECTION("BVH [Traversal performs no heap allocations]")
+    {
+        for (uint32_t width : { 2u, 4u, 8u }) {
+            Features features_wide = features_sah;
+            features_wide.extra.bvhWidth = width;
+            BVH bvh(scene, features_wide);
+            RenderState state = { .scene = scene, .features = features_wide, .bvh = bvh, .sampler = { 4 } };
+
+            uint64_t allocations_before = num_allocations;
+            for (Ray ray : rays) {
+                HitInfo hitInfo;
+                bvh.intersect(state, ray, hitInfo);
+            }
+            uint64_t allocations = num_allocations - allocations_before;
+            CAPTURE(width, allocations);
+            CHECK(allocations == 0);
+        }
+    }
+
+    SECTION("intersectRayWithBVH [Hierarchies that underreport their depth do not overflow the traversal stack]")
+    {
+        Features features_unordered = features_sah;
+        features_unordered.extra.enableBvhOrderedTraversal = false;
+        detail::DeepBVH bvh(bvh_naive, 4 * BVH::TraversalStackSize);
+        CHECK(trace(bvh, features_unordered) == t_naive);
+    }
+
+    SECTION("BVH [4-wide and 8-wide hierarchies match naive intersection]")
+    {
+        for (uint32_t width : { 4u, 8u }) {
+            for (bool compact : { false, true }) {
+                Features features_wide = features_sah;
+                features_wide.extra.bvhWidth = width;
+                features_wide.extra.enableBvhCompactPrimitives = compact;
+                CAPTURE(width, compact);
+                CHECK(trace(BVH(scene, features_wide), features_wide) == t_naive);
+            }
+        }
+    }
+
+    SECTION("BVH [Occlusion queries agree with naive intersection]")
+    {
+        // Vary the maximum distance, s.t. both blocked and unblocked shadow rays are tested
+        const auto t_max = [](size_t i) { return 0.5f + static_cast<float>(i % 4); };
+        for (uint32_t width : { 2u, 4u, 8u }) {
+            for (bool compact : { false, true }) {
+                Features features_occluded = features_sah;
+                features_occluded.extra.bvhWidth = width;
+                features_occluded.extra.enableBvhCompactPrimitives = compact;
+                BVH bvh(scene, features_occluded);
+                RenderState state = { .scene = scene, .features = features_occluded, .bvh = bvh, .sampler = { 4 } };
+                CAPTURE(width, compact);
+                for (size_t i = 0; i < rays.size(); i++) {
+                    CAPTURE(i);
+                    CHECK(bvh.occluded(state, rays[i], t_max(i)) == (t_naive[i] < t_max(i)));
+                    CHECK(isRayOccludedInBVH(state, bvh, rays[i], t_max(i)) == (t_naive[i] < t_max(i)));
+                }
+            }
+        }
+    }
+
+    SECTION("BVH [Precomputed and watertight triangle tests match naive intersection]")
+    {
+        // The tests round differently from the reference routine, so allow small errors, and a rare
+        // disagreement for rays grazing a triangle's edge
+        for (auto test : { TriangleTest::PrecomputedEdges, TriangleTest::Watertight }) {
+            Features features_test = features_sah;
+            features_test.extra.enableBvhCompactPrimitives = true;
+            features_test.extra.bvhTriangleTest = test;
+            auto t_test = trace(BVH(scene, features_test), features_test);
+            auto num_mismatches = static_cast<uint32_t>(rng::count_if(vws::iota(0u, num_rays), [&](uint32_t i) {
+                return std::abs(t_test[i] - t_naive[i]) > 1e-3f * t_naive[i];
+            }));
+            CAPTURE(static_cast<uint32_t>(test), num_mismatches);
+            CHECK(num_mismatches <= num_rays / 100);
+        }
+    }
+
+    SECTION("BVH [Watertight triangle test does not miss rays through shared edges]")
+    {
+        auto [grid_scene, grid_rays] = detail::edgeGridScene(64);
+        Features features_watertight = features_sah;
+        features_watertight.extra.enableBvhCompactPrimitives = true;
+        features_watertight.extra.bvhTriangleTest = TriangleTest::Watertight;
+        BVH bvh(grid_scene, features_watertight);
+        RenderState state = { .scene = grid_scene, .features = features_watertight, .bvh = bvh, .sampler = { 4 } };
+        auto num_misses = rng::count_if(grid_rays, [&](Ray ray) {
+            HitInfo hitInfo;
+            return !bvh.intersect(state, ray, hitInfo);
+        });
+        CHECK(num_misses == 0);
+    }
+
+    SECTION("BVH [Ray packets match naive intersection]")
+    {
+        for (uint32_t packet_size : { 4u, 16u, BVH::MaxPacketSize }) {
+            for (bool compact : { false, true }) {
+                Features features_packet = features_sah;
+                features_packet.extra.enableBvhCompactPrimitives = compact;
+                BVH bvh(scene, features_packet);
+                RenderState state = { .scene = scene, .features = features_packet, .bvh = bvh, .sampler = { 4 } };
+                CAPTURE(packet_size, compact);
+                for (uint32_t begin = 0; begin < num_rays; begin += packet_size) {
+                    std::vector<Ray> packet(rays.begin() + begin, rays.begin() + begin + packet_size);
+                    std::vector<HitInfo> hitInfos(packet_size);
+                    uint32_t hit_mask = intersectRayPacketWithBVH(state, bvh, packet, hitInfos);
+                    for (uint32_t i = 0; i < packet_size; ++i) {
+                        CAPTURE(begin + i);
+                        CHECK(packet[i].t == t_naive[begin + i]);
+                        CHECK(((hit_mask >> i) & 1u) == (t_naive[begin + i] != std::numeric_limits<float>::max()));
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("BVH [Saved hierarchies load unchanged, and only for the same geometry and build settings]")
+    {
+        const auto file = std::filesystem::temp_directory_path() / "cg_bvh_cache_test.bvhcache";
+        for (uint32_t width : { 2u, 8u }) {
+            for (bool compact : { false, true }) {
+                Features features_saved = features_sah;
+                features_saved.extra.bvhWidth = width;
+                features_saved.extra.enableBvhCompactPrimitives = compact;
+                CAPTURE(width, compact);
+                BVH bvh(scene, features_saved);
+                REQUIRE(bvh.save(file, scene, features_saved));
+
+                auto loaded = BVH::load(file, scene, features_saved);
+                REQUIRE(loaded.has_value());
+                CHECK(rng::equal(loaded->nodes(), bvh.nodes(), [](const auto& x, const auto& y) {
+                    return x.aabb.lower == y.aabb.lower && x.aabb.upper == y.aabb.upper && x.data == y.data;
+                }));
+                CHECK(rng::equal(loaded->primitives(), bvh.primitives()));
+                CHECK(loaded->compactPrimitives().v0 == bvh.compactPrimitives().v0);
+                CHECK(loaded->numLevels() == bvh.numLevels());
+                CHECK(loaded->numLeaves() == bvh.numLeaves());
+                CHECK(loaded->sahCost() == bvh.sahCost());
+                CHECK(trace(*loaded, features_saved) == t_naive);
+            }
+        }
+
+        // Other build settings, other geometry, or a truncated file are rejected
+        BVH bvh(scene, features_sah);
+        REQUIRE(bvh.save(file, scene, features_sah));
+        CHECK(!BVH::load(file, scene, features_linear).has_value());
+        Scene moved_scene = scene;
+        moved_scene.meshes[0].vertices[0].position.x += 1.f;
+        CHECK(!BVH::load(file, moved_scene, features_sah).has_value());
+        std::filesystem::resize_file(file, std::filesystem::file_size(file) / 2);
+        CHECK(!BVH::load(file, scene, features_sah).has_value());
+        std::filesystem::remove(file);
+    }
+
+    SECTION("BVH [Corrupt saved hierarchies are rejected instead of traversed]")
+    {
+        // Offsets into the saved file; the header's nr. of levels, and the nodes, which start after the 64-byte aligned header
+        constexpr std::streamoff num_levels_offset = 52, nodes_offset = 192, node_data_offset = offsetof(BVH::Node, data);
+        const auto file = std::filesystem::temp_directory_path() / "cg_bvh_corrupt_test.bvhcache";
+        const auto overwrite = [&](std::streamoff offset, uint32_t value) {
+            std::fstream stream { file, std::ios::in | std::ios::out | std::ios::binary };
+            stream.seekp(offset);
+            stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+        for (const Features& features : { features_sah, features_treelet }) {
+            BVH bvh(scene, features);
+            const auto leaf = static_cast<std::streamoff>(rng::find_if(bvh.nodes(), [](const auto& node) { return node.isLeaf(); }) - bvh.nodes().begin());
+            REQUIRE(!bvh.nodes()[BVH::RootIndex].isLeaf());
+
+            // An underreported nr. of levels is recomputed
+            REQUIRE(bvh.save(file, scene, features));
+            overwrite(num_levels_offset, 1);
+            auto loaded = BVH::load(file, scene, features);
+            REQUIRE(loaded.has_value());
+            CHECK(loaded->numLevels() == bvh.numLevels());
+            CHECK(trace(*loaded, features) == t_naive);
+
+            // A cycle, a child out of range, and a leaf beyond the primitives
+            const std::array<std::pair<std::streamoff, uint32_t>, 3> corruptions = { {
+                { nodes_offset + node_data_offset, BVH::RootIndex },
+                { nodes_offset + node_data_offset + sizeof(uint32_t), static_cast<uint32_t>(bvh.nodes().size()) },
+                { nodes_offset + leaf * sizeof(BVH::Node) + node_data_offset + sizeof(uint32_t), static_cast<uint32_t>(bvh.primitives().size()) + 1 },
+            } };
+            for (const auto& [offset, value] : corruptions) {
+                CAPTURE(offset, value);
+                REQUIRE(bvh.save(file, scene, features));
+                overwrite(offset, value);
+                CHECK(!BVH::load(file, scene, features).has_value());
+            }
+        }
+        std::filesystem::remove(file);
+    }
+
+    SECTION("BVH [Cache files are named by build settings, and survive concurrent saves]")
+    {
+        const auto directory = std::filesystem::temp_directory_path() / "cg_bvh_cache_dir_test";
+        std::filesystem::remove_all(directory);
+        const auto file = BVH::cachePath(directory, "scene", features_sah);
+        CHECK(file.parent_path() == directory);
+        CHECK(file == BVH::cachePath(directory, "scene", features_sah));
+        CHECK(file != BVH::cachePath(directory, "scene", features_linear));
+        CHECK(file != BVH::cachePath(directory, "other_scene", features_sah));
+
+        // Several threads save the same hierarchy at once, as two renders of one scene would; none of them
+        // may clobber another's temporary file, and the result must be complete
+        BVH bvh(scene, features_sah);
+        std::array<bool, 4> saved {};
+        {
+            std::vector<std::jthread> threads;
+            for (size_t i = 0; i < saved.size(); ++i)
+                threads.emplace_back([&, i]() { saved[i] = bvh.save(file, scene, features_sah); });
+        }
+        CHECK(rng::all_of(saved, [](bool s) { return s; }));
+        auto loaded = BVH::load(file, scene, features_sah);
+        REQUIRE(loaded.has_value());
+        CHECK(trace(*loaded, features_sah) == t_naive);
+        CHECK(std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator()) == 1);
+        std::filesystem::remove_all(directory);
+    }
+
+    SECTION("intersectRayWithBVH [Median, SAH, and linear hierarchies match naive intersection]")
+    {
+        CHECK(trace(BVH(scene, features_median), features_median) == t_naive);
+        CHECK(trace(BVH(scene, features_sah), features_sah) == t_naive);
+        CHECK(trace(BVH(scene, features_linear), features_linear) == t_naive);
+        CHECK(trace(BVH(scene, features_treelet), features_treelet) == t_naive);
+    }
+}
+
+// Not run by default; select with the "[benchmark]" tag to compare traversal order, primitive layouts, and bvh widths
+TEST_CASE("Acceleration structure benchmark", "[.][benchmark]")
+{
+    ref::Sampler sampler(4);
+    Scene scene = detail::randomTriangleScene(sampler, num_benchmark_triangles);
+    std::vector<Ray> rays(num_benchmark_rays);
+    rng::generate(rays, [&]() { return detail::randomRay(sampler); });
+
+    const auto benchmark = [&](std::string_view name, const Features& features) {
+        BVH bvh(scene, features);
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        auto time = detail::benchmark_region_us(num_benchmark_samples, [&]() {
+            for (Ray ray : rays) {
+                HitInfo hitInfo;
+                bvh.intersect(state, ray, hitInfo);
+            }
+        });
+        bvhTraversalStats() = {};
+        uint64_t allocations_before = num_allocations;
+        for (Ray ray : rays) {
+            HitInfo hitInfo;
+            bvh.intersect(state, ray, hitInfo);
+        }
+        uint64_t allocations = num_allocations - allocations_before;
+        WARN(name << ": " << bvh.primitiveMemoryFootprint() / 1024 << " KiB of primitives, "
+                  << time.count() << "us per " << num_benchmark_rays << " rays, "
+                  << bvhTraversalStats().numNodeVisits / num_benchmark_rays << " node visits and "
+                  << static_cast<double>(allocations) / num_benchmark_rays << " allocations per ray");
+    };
+
+    // Shadow rays are blocked by any hit, so compare a closest-hit query against an any-hit query
+    const auto benchmark_shadow = [&](std::string_view name, const Features& features) {
+        BVH bvh(scene, features);
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        auto time_closest = detail::benchmark_region_us(num_benchmark_samples, [&]() {
+            for (Ray ray : rays) {
+                HitInfo hitInfo;
+                bvh.intersect(state, ray, hitInfo);
+            }
+        });
+        auto time_any = detail::benchmark_region_us(num_benchmark_samples, [&]() {
+            for (const Ray& ray : rays)
+                bvh.occluded(state, ray, std::numeric_limits<float>::max());
+        });
+        WARN(name << ": " << time_closest.count() << "us closest-hit, "
+                  << time_any.count() << "us any-hit per " << num_benchmark_rays << " shadow rays");
+    };
+
+    Features features_full = { .enableAccelStructure = true, .extra = { .enableBvhSahBinning = true } };
+    Features features_compact = features_full;
+    features_compact.extra.enableBvhCompactPrimitives = true;
+    Features features_unordered = features_full;
+    features_unordered.extra.enableBvhOrderedTraversal = false;
+    benchmark("Full primitives, unordered", features_unordered);
+    benchmark("Full primitives", features_full);
+    benchmark("Compact primitives", features_compact);
+    for (uint32_t width : { 4u, 8u }) {
+        Features features_wide = features_compact;
+        features_wide.extra.bvhWidth = width;
+        benchmark(width == 4 ? "Compact primitives, 4-wide" : "Compact primitives, 8-wide", features_wide);
+    }
+    benchmark_shadow("Shadow rays, full primitives", features_full);
+    Features features_wide = features_compact;
+    features_wide.extra.bvhWidth = 8;
+    benchmark_shadow("Shadow rays, compact primitives, 8-wide", features_wide);
+    // Coherent camera rays over a 256x256 image, traced one by one or in packets of neighbouring rays
+    std::vector<Ray> camera_rays(num_benchmark_rays);
+    for (uint32_t i = 0; i < num_benchmark_rays; ++i) {
+        glm::vec2 pixel = (glm::vec2(i % 256, i / 256) + 0.5f) / 256.f * 2.f - 1.f;
+        camera_rays[i] = { .origin = { 0.f, 0.f, -8.f }, .direction = glm::normalize(glm::vec3(pixel * 0.5f, 1.f)), .t = std::numeric_limits<float>::max() };
+    }
+    for (uint32_t packet_size : { 1u, 4u, 16u }) {
+        BVH bvh(scene, features_full);
+        RenderState state = { .scene = scene, .features = features_full, .bvh = bvh, .sampler = { 4 } };
+        auto time = detail::benchmark_region_us(num_benchmark_samples, [&]() {
+            if (packet_size == 1) {
+                for (Ray ray : camera_rays) {
+                    HitInfo hitInfo;
+                    bvh.intersect(state, ray, hitInfo);
+                }
+                return;
+            }
+            for (uint32_t begin = 0; begin < num_benchmark_rays; begin += packet_size) {
+                std::array<Ray, 16> packet;
+                std::array<HitInfo, 16> hitInfos;
+                std::copy_n(camera_rays.begin() + begin, packet_size, packet.begin());
+                bvh.intersectPacket(state, std::span(packet.data(), packet_size), std::span(hitInfos.data(), packet_size));
+            }
+        });
+        WARN("Camera rays, packets of " << packet_size << ": " << time.count() << "us per " << num_benchmark_rays << " rays");
+    }
+
+    for (auto test : { TriangleTest::PrecomputedEdges, TriangleTest::Watertight }) {
+        Features features_test = features_wide;
+        features_test.extra.bvhTriangleTest = test;
+        benchmark(test == TriangleTest::PrecomputedEdges ? "Compact primitives, 8-wide, precomputed edges" : "Compact primitives, 8-wide, watertight", features_test);
+    }
+
+    // Loading a saved hierarchy, against building it
+    const auto file = std::filesystem::temp_directory_path() / "cg_bvh_benchmark.bvhcache";
+    for (const auto& [name, features] : { std::pair { "Full primitives", features_full }, std::pair { "Compact primitives, 8-wide", features_wide } }) {
+        BVH(scene, features).save(file, scene, features);
+        auto build_time = detail::benchmark_region_ms(num_benchmark_samples, [&]() { BVH bvh(scene, features); });
+        auto load_time = detail::benchmark_region_ms(num_benchmark_samples, [&]() { auto bvh = BVH::load(file, scene, features); });
+        WARN(name << ": " << build_time.count() << "ms per build, " << load_time.count() << "ms per load of "
+                  << std::filesystem::file_size(file) / 1024 << " KiB");
+    }
+    std::filesystem::remove(file);
+}
+} // namespace test
@@ -13,7 +13,7 @@ constexpr uint32_t num_samples = 16; // Number of random samples taken in certai
 TEST_CASE("Interpolation")
 {
     // Load test scene
-    Scene scene = loadScenePrebuilt(SceneType::CornellBox, DATA_DIR);
+    Scene scene = loadScenePrebuilt(SceneType::CornellBox, DATA_DIR, CACHE_DIR);
 
     // Instantiate reference objects
     BVH bvh(scene, { .enableAccelStructure = true });
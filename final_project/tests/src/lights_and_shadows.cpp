@@ -1,18 +1,28 @@
 #include "tests.h"
+#include "timer.h"
 #include "uniform_tests.h"
 #include "light.h" // Include the student's code
 #include "shading.h" // Include the student's code
 #include "bvh.h"
+#include "light_bvh.h"
+#include "packed_lights.h"
+#include "render.h"
+#include "screen.h"
 #include "solution.h"
 
 #include <fmt/core.h>
+#include <framework/trackball.h>
+#include <framework/window.h>
 #include <glm/gtx/string_cast.hpp>
+#include <memory>
+#include <numeric>
 
 namespace test {
 
 // Test settings
 constexpr bool run_ref_tests = false; // Run REQUIRES(...) tests over the reference solution
 constexpr uint32_t num_samples = 2 * 65536; // Number of random samples taken in certain tests
+constexpr uint32_t num_benchmark_reference_samples = 4096; // Nr. of shadow samples in the converged benchmark image
 
 TEST_CASE("Lights and shadows")
 {
@@ -609,4 +619,283 @@ TEST_CASE("Lights and shadows")
         }
     }
 }
+
+TEST_CASE("Light BVH")
+{
+    ref::Sampler sampler(4);
+
+    // Generate a mix of arbitrary lights
+    std::vector<Scene::SceneLight> lights;
+    for (uint32_t i = 0; i < 37; i++) {
+        glm::vec3 p = 4.f * sampler.next_3d() - 2.f, c = sampler.next_3d();
+        if (i % 3 == 0)
+            lights.push_back(PointLight { .position = p, .color = c });
+        else if (i % 3 == 1)
+            lights.push_back(SegmentLight { .endpoint0 = p, .endpoint1 = p + sampler.next_3d(), .color0 = c, .color1 = sampler.next_3d() });
+        else
+            lights.push_back(ParallelogramLight { .v0 = p, .edge01 = sampler.next_3d(), .edge02 = sampler.next_3d(), .color0 = c, .color1 = c, .color2 = c, .color3 = c });
+    }
+    ::LightBVH light_bvh(lights);
+
+    SECTION("LightBVH [Has a leaf for every light]")
+    {
+        CHECK(light_bvh.nodes().size() == 2 * lights.size() - 1);
+        CHECK(std::ranges::count_if(light_bvh.nodes(), [](const auto& node) { return node.isLeaf(); }) == static_cast<std::ptrdiff_t>(lights.size()));
+    }
+
+    SECTION("LightBVH [Light probabilities sum to one]")
+    {
+        float sum = 0.f;
+        for (uint32_t i = 0; i < lights.size(); i++)
+            sum += light_bvh.pdf(i);
+        CHECK(epsEqual(sum, 1.f));
+    }
+
+    SECTION("LightBVH [Lights are drawn with their reported probability]")
+    {
+        constexpr uint32_t num_draws = 65536;
+        std::vector<uint32_t> counts(lights.size(), 0);
+        for (uint32_t i = 0; i < num_draws; i++) {
+            auto light_sample = light_bvh.sample((static_cast<float>(i) + 0.5f) / static_cast<float>(num_draws));
+            REQUIRE(light_sample.has_value());
+            CHECK(epsEqual(light_sample->pdf, light_bvh.pdf(light_sample->lightIndex), 1e-6f));
+            counts[light_sample->lightIndex]++;
+        }
+        for (uint32_t i = 0; i < lights.size(); i++) {
+            CAPTURE(i);
+            CHECK(epsEqual(static_cast<float>(counts[i]) / static_cast<float>(num_draws), light_bvh.pdf(i), 1e-3f));
+        }
+    }
+
+    SECTION("LightBVH [Drawn lights estimate their sum with less variance than uniformly drawn lights]")
+    {
+        // Dim lights close above a shading point at the origin, and bright lights far away; lights do not fall off
+        // with distance, so their diffuse contribution is their color times the cosine towards the surface normal
+        std::vector<Scene::SceneLight> point_lights;
+        std::vector<float> contributions;
+        for (uint32_t i = 0; i < 32; i++) {
+            const bool is_near = i % 2 == 0;
+            const glm::vec2 offset = 2.f * sampler.next_2d() - 1.f;
+            const glm::vec3 position = is_near ? glm::vec3(offset.x, 0.5f, offset.y) : 20.f * glm::vec3(offset.x, 1.f, offset.y);
+            const float color = (is_near ? 0.05f : 1.f) * (0.5f + sampler.next_1d());
+            point_lights.push_back(PointLight { .position = position, .color = glm::vec3(color) });
+            contributions.push_back(color * glm::normalize(position).y);
+        }
+        ::LightBVH point_light_bvh(point_lights);
+
+        // Exact variance of the one-sample estimator contribution / pdf, under the light bvh's and uniform pdfs
+        const float sum = std::accumulate(contributions.begin(), contributions.end(), 0.f);
+        float bvh_second_moment = 0.f, uniform_second_moment = 0.f;
+        for (uint32_t i = 0; i < point_lights.size(); i++) {
+            bvh_second_moment += contributions[i] * contributions[i] / point_light_bvh.pdf(i);
+            uniform_second_moment += contributions[i] * contributions[i] * static_cast<float>(point_lights.size());
+        }
+        const float bvh_variance = bvh_second_moment - sum * sum, uniform_variance = uniform_second_moment - sum * sum;
+        CAPTURE(bvh_variance, uniform_variance);
+        CHECK(bvh_variance < 0.5f * uniform_variance);
+    }
+
+    SECTION("LightBVH [Nothing is drawn without emitting lights]")
+    {
+        std::vector<Scene::SceneLight> dark_lights = { PointLight { .position = glm::vec3(0), .color = glm::vec3(0) } };
+        CHECK_FALSE(::LightBVH(dark_lights).sample(0.5f).has_value());
+        CHECK_FALSE(::LightBVH().sample(0.5f).has_value());
+    }
+}
+
+TEST_CASE("Packed lights")
+{
+    ref::Sampler sampler(4);
+
+    // Generate a wall, with an occluding triangle in front of its center
+    Scene scene = { .type = SceneType::Custom };
+    scene.meshes.push_back(Mesh {
+        .vertices = { { .position = { -1.f, -1.f, 0.5f }, .normal = {}, .texCoord = {} },
+                      { .position = { 1.f, -1.f, 0.5f }, .normal = {}, .texCoord = {} },
+                      { .position = { 0.f, 1.f, 0.5f }, .normal = {}, .texCoord = {} } },
+        .triangles = { { 0, 1, 2 } },
+        .material = { .kd = glm::vec3(0.5f) } });
+
+    // Generate lights on either side of the wall, some of them behind the occluder
+    for (uint32_t i = 0; i < 41; i++) {
+        glm::vec3 p = 4.f * sampler.next_3d() - 2.f, c = sampler.next_3d();
+        if (i % 4 == 0)
+            scene.lights.push_back(SegmentLight { .endpoint0 = p, .endpoint1 = p + sampler.next_3d(), .color0 = c, .color1 = sampler.next_3d() });
+        else if (i % 4 == 2)
+            scene.lights.push_back(ParallelogramLight { .v0 = p, .edge01 = sampler.next_3d(), .edge02 = sampler.next_3d(), .color0 = c, .color1 = sampler.next_3d(), .color2 = sampler.next_3d(), .color3 = sampler.next_3d() });
+        else
+            scene.lights.push_back(PointLight { .position = p, .color = c });
+    }
+    ::PackedLights packed_lights(scene.lights);
+
+    Features features = {
+        .enableShading = true,
+        .enableShadows = true,
+        .enableAccelStructure = false,
+        .numShadowSamples = 3
+    };
+    BVH bvh = { scene, features };
+    RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+    Ray ray = { .origin = { 0.2f, 0.1f, 2.f }, .direction = { 0, 0, -1 }, .t = 2.f };
+    HitInfo hit = { .normal = { 0, 0, 1 }, .material = { .kd = glm::vec3(0.8f) } };
+
+    SECTION("PackedLights [Has every light]")
+    {
+        CHECK(packed_lights.size() == scene.lights.size());
+        CHECK(::PackedLights().size() == 0);
+    }
+
+    SECTION("PackedLights [Single lights match their unpacked contribution]")
+    {
+        // Area lights draw their samples in batches; take fewer samples than fit in one, and several batches' worth
+        for (uint32_t num_samples : { 3u, 2 * static_cast<uint32_t>(::PackedLights::BatchSize) + 5 }) {
+            features.numShadowSamples = num_samples;
+            for (uint32_t i = 0; i < scene.lights.size(); i++) {
+                // Area lights draw their samples in the same order from identically seeded samplers
+                state.sampler = Sampler(i);
+                glm::vec3 packed_colr = packed_lights.computeContribution(state, i, ray, hit);
+                state.sampler = Sampler(i);
+                glm::vec3 refr_colr;
+                if (std::holds_alternative<PointLight>(scene.lights[i]))
+                    refr_colr = ::computeContributionPointLight(state, std::get<PointLight>(scene.lights[i]), ray, hit);
+                else if (std::holds_alternative<SegmentLight>(scene.lights[i]))
+                    refr_colr = ::computeContributionSegmentLight(state, std::get<SegmentLight>(scene.lights[i]), ray, hit, num_samples);
+                else
+                    refr_colr = ::computeContributionParallelogramLight(state, std::get<ParallelogramLight>(scene.lights[i]), ray, hit, num_samples);
+                CAPTURE(num_samples, i, packed_colr, refr_colr);
+                CHECK(epsEqual(packed_colr, refr_colr));
+            }
+        }
+    }
+
+    SECTION("PackedLights [All point lights match their unpacked contribution]")
+    {
+        std::erase_if(scene.lights, [](const auto& light) { return !std::holds_alternative<PointLight>(light); });
+        glm::vec3 refr_colr(0);
+        for (const auto& light : scene.lights)
+            refr_colr += ::computeContributionPointLight(state, std::get<PointLight>(light), ray, hit);
+        glm::vec3 packed_colr = ::PackedLights(scene.lights).computeContribution(state, ray, hit);
+        CAPTURE(packed_colr, refr_colr);
+        CHECK(epsEqual(packed_colr, refr_colr));
+    }
+}
+
+TEST_CASE("Area light sampling")
+{
+    ref::Sampler sampler(4);
+    ref::FakeBVH bvh(sampler, 6);
+    Scene scene;
+    Features features = {};
+    RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+
+    SECTION("sampleSegmentLightSolidAngle [Weighted samples average to the uniform average]")
+    {
+        for (uint32_t i = 0; i < 8; i++) {
+            SegmentLight light = { .endpoint0 = 2.f * sampler.next_3d() - 1.f, .endpoint1 = 2.f * sampler.next_3d() - 1.f };
+            glm::vec3 position = 3.f * sampler.next_3d() - 1.5f;
+            float mean_weight = 0.f, mean_parameter = 0.f;
+            for (uint32_t j = 0; j < num_samples; j++) {
+                float parameter;
+                float weight = ::sampleSegmentLightSolidAngle((static_cast<float>(j) + 0.5f) / static_cast<float>(num_samples), light, position, parameter);
+                mean_weight += weight / static_cast<float>(num_samples);
+                mean_parameter += weight * parameter / static_cast<float>(num_samples);
+            }
+            CAPTURE(light.endpoint0, light.endpoint1, position, mean_weight, mean_parameter);
+            CHECK(epsEqual(mean_weight, 1.f));
+            CHECK(epsEqual(mean_parameter, 0.5f));
+        }
+    }
+
+    SECTION("sampleParallelogramLightSolidAngle [Weighted samples average to the uniform average]")
+    {
+        constexpr uint32_t num_strata = 256;
+        for (uint32_t i = 0; i < 8; i++) {
+            // Positions at grazing angles put most weight on few samples, so place these above the light
+            ParallelogramLight light = { .v0 = 2.f * sampler.next_3d() - 1.f, .edge01 = sampler.next_3d(), .edge02 = sampler.next_3d() };
+            glm::vec3 position = light.v0 + sampler.next_1d() * light.edge01 + sampler.next_1d() * light.edge02
+                + (0.5f + sampler.next_1d()) * glm::normalize(glm::cross(light.edge01, light.edge02));
+            float mean_weight = 0.f;
+            glm::vec2 mean_parameter(0.f);
+            for (uint32_t j = 0; j < num_strata * num_strata; j++) {
+                glm::vec2 sample = (glm::vec2(j % num_strata, j / num_strata) + 0.5f) / static_cast<float>(num_strata), parameter;
+                float weight = ::sampleParallelogramLightSolidAngle(sample, light, position, parameter);
+                mean_weight += weight / static_cast<float>(num_strata * num_strata);
+                mean_parameter += weight * parameter / static_cast<float>(num_strata * num_strata);
+            }
+            CAPTURE(light.v0, light.edge01, light.edge02, position, mean_weight, mean_parameter);
+            CHECK(epsEqual(mean_weight, 1.f));
+            CHECK(epsEqual(mean_parameter, glm::vec2(0.5f)));
+        }
+    }
+
+    SECTION("drawSegmentLightSample [Uniform sampling matches sampleSegmentLight]")
+    {
+        SegmentLight light = { .endpoint0 = glm::vec3(-1.f), .endpoint1 = glm::vec3(1.f), .color0 = glm::vec3(1, 0, 0), .color1 = glm::vec3(0, 0, 1) };
+        for (uint32_t i = 0; i < 16; i++) {
+            glm::vec3 position, color, refr_position, refr_colr;
+            state.sampler = Sampler(i);
+            float weight = ::drawSegmentLightSample(state, light, glm::vec3(2.f), i, 16, position, color);
+            state.sampler = Sampler(i);
+            ::sampleSegmentLight(state.sampler.next_1d(), light, refr_position, refr_colr);
+            CHECK(weight == 1.f);
+            CHECK(position == refr_position);
+            CHECK(color == refr_colr);
+        }
+    }
+
+    SECTION("drawParallelogramLightSample [Stratified samples stay inside their strata]")
+    {
+        // Six samples are placed on a grid of 2x3 strata; the light maps parameters directly onto positions
+        features.extra.areaLightSampling = AreaLightSampling::Stratified;
+        ParallelogramLight light = { .v0 = glm::vec3(0.f), .edge01 = { 1, 0, 0 }, .edge02 = { 0, 1, 0 }, .color0 = glm::vec3(1.f), .color1 = glm::vec3(1.f), .color2 = glm::vec3(1.f), .color3 = glm::vec3(1.f) };
+        for (uint32_t i = 0; i < 6; i++) {
+            glm::vec3 position, color;
+            float weight = ::drawParallelogramLightSample(state, light, glm::vec3(0, 0, 1), i, 6, position, color);
+            glm::vec2 stratum = glm::vec2(i % 2, i / 2) / glm::vec2(2, 3);
+            CAPTURE(i, position);
+            CHECK(weight == 1.f);
+            CHECK(position.x >= stratum.x);
+            CHECK(position.x <= stratum.x + 1.f / 2.f);
+            CHECK(position.y >= stratum.y);
+            CHECK(position.y <= stratum.y + 1.f / 3.f);
+        }
+    }
+}
+
+// Not run by default; select with the "[benchmark]" tag to compare the convergence of the area light sampling strategies
+TEST_CASE("Area light sampling benchmark", "[.][benchmark]")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Area light sampling", glm::ivec2(64, 48), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), glm::radians(50.f), 3.f);
+
+    Scene scene = loadScenePrebuilt(SceneType::CornellBoxParallelogramLight, DATA_DIR, CACHE_DIR);
+    Features features = { .enableShading = true, .enableShadows = true, .enableAccelStructure = true };
+    BVH bvh(scene, features);
+
+    // Camera rays draw the first samples of each pixel's seeded sampler, and are thus the same in every image
+    Features reference_features = features;
+    reference_features.numShadowSamples = num_benchmark_reference_samples;
+    reference_features.extra.areaLightSampling = AreaLightSampling::Stratified;
+    Screen reference(glm::ivec2(64, 48), false);
+    renderImage(scene, bvh, reference_features, *camera_p, reference);
+
+    for (AreaLightSampling strategy : { AreaLightSampling::Uniform, AreaLightSampling::Stratified, AreaLightSampling::SolidAngle }) {
+        for (uint32_t num_shadow_samples : { 1u, 4u, 16u, 64u, 256u }) {
+            Features sample_features = features;
+            sample_features.numShadowSamples = num_shadow_samples;
+            sample_features.extra.areaLightSampling = strategy;
+            Screen screen(reference.resolution(), false);
+            auto time = detail::benchmark_region_ms(1, [&]() { renderImage(scene, bvh, sample_features, *camera_p, screen); });
+
+            double squared_error = 0.0;
+            for (size_t i = 0; i < screen.pixels().size(); ++i) {
+                glm::vec3 difference = screen.pixels()[i] - reference.pixels()[i];
+                squared_error += glm::dot(difference, difference) / 3.0;
+            }
+            WARN("Area light sampling " << static_cast<uint32_t>(strategy) << ", " << num_shadow_samples << " shadow samples: rmse "
+                                        << std::sqrt(squared_error / static_cast<double>(screen.pixels().size())) << " in " << time.count() << "ms");
+        }
+    }
+}
 } // namespace test
\ No newline at end of file
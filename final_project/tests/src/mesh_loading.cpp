@@ -0,0 +1,273 @@
+#include "tests.h"
+#include "timer.h"
+#include <framework/mesh.h>
+#include <framework/mesh_cache.h>
+#include <framework/obj_parser.h>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace test {
+
+// Test settings
+constexpr uint32_t grid_size = 24; // Nr. of quads along either side of the generated test mesh
+constexpr uint32_t num_strip_quads = 50000; // Nr. of quads in the generated OBJ for the parallel parser, ~3 MiB
+constexpr uint32_t num_benchmark_samples = 4; // Nr. of loads averaged per mesh in the benchmark
+constexpr std::array benchmark_meshes = { "triangle.obj", "cube.obj", "cube-textured.obj", "CornellBox-Mirror-Rotated.obj",
+    "monkey.obj", "teapot.obj", "dragon.obj" }; // Bundled meshes loaded in the benchmark
+
+namespace detail {
+    // Write a grid of quads to an OBJ file, with texture coordinates, shared normals, and three material runs, of which
+    // the last reuses the first material; the materials are written to a separate MTL file, one of them textured
+    inline std::filesystem::path writeGridObj(const std::filesystem::path& directory)
+    {
+        std::filesystem::create_directories(directory);
+        std::filesystem::copy_file(std::filesystem::path(DATA_DIR) / "emoji.png", directory / "emoji.png",
+            std::filesystem::copy_options::overwrite_existing);
+        {
+            std::ofstream mtl { directory / "grid.mtl" };
+            mtl << "newmtl red\nKd 1 0 0\nKs 0.5 0.5 0.5\nNs 20\nmap_Kd emoji.png\n"
+                << "newmtl green\nKd 0 1 0\nKs 0 0 0\nNs 1\nd 0.5\n";
+        }
+
+        const auto file = directory / "grid.obj";
+        std::ofstream obj { file };
+        obj << "mtllib grid.mtl\n";
+        for (uint32_t y = 0; y <= grid_size; ++y) {
+            for (uint32_t x = 0; x <= grid_size; ++x) {
+                obj << "v " << x << " " << (x * y) % 5 << " " << y << "\n"
+                    << "vt " << float(x) / grid_size << " " << float(y) / grid_size << "\n";
+            }
+        }
+        obj << "vn 0 1 0\n";
+        for (uint32_t y = 0; y < grid_size; ++y) {
+            if (y % (grid_size / 3) == 0) {
+                obj << "usemtl " << (y / (grid_size / 3) == 1 ? "green" : "red") << "\n";
+            }
+            for (uint32_t x = 0; x < grid_size; ++x) {
+                const uint32_t a = y * (grid_size + 1) + x + 1, b = a + 1, c = a + grid_size + 1, d = c + 1;
+                obj << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " << d << "/" << d << "/1\n"
+                    << "f " << a << "/" << a << " " << d << "/" << d << " " << c << "/" << c << "\n";
+            }
+        }
+        return file;
+    }
+
+    // Write a long strip of quads to an OBJ file, referencing its vertices through relative indices, and switching
+    // between groups, objects and materials along the way; large enough to be split into several chunks when parsed
+    inline std::filesystem::path writeStripObj(const std::filesystem::path& directory)
+    {
+        const auto file = directory / "strip.obj";
+        std::ofstream obj { file, std::ios::binary };
+        obj << "# Quad strip\r\nmtllib grid.mtl\r\nvn 0 0 1\n";
+        for (uint32_t i = 0; i <= num_strip_quads; ++i) {
+            obj << "v " << i * 0.25f << " 0 " << (i % 7) * 1e-3f << "\n"
+                << "v\t" << i * 0.25f << " " << 1.0f + (i % 3) * 0.1f << " -0\r\n";
+            if (i == 0)
+                continue;
+            if (i % 997 == 0)
+                obj << (i % 2 ? "o part" : "g part") << i << "\n";
+            if (i % 499 == 0)
+                obj << "usemtl " << (i % 3 == 0 ? "red" : i % 3 == 1 ? "green" : "missing") << "\n";
+            if (i % 5 == 0)
+                obj << "f -4//1 -2//1 -1//1\nf -4//1 -1//1 -3//1\n";
+            else
+                obj << "f -4 -2 -1 -3\n";
+        }
+        return file;
+    }
+
+    inline bool meshesEqual(const std::vector<Mesh>& lhs, const std::vector<Mesh>& rhs)
+    {
+        return rng::equal(lhs, rhs, [](const Mesh& l, const Mesh& r) {
+            return l.vertices == r.vertices && l.triangles == r.triangles
+                && l.material.kd == r.material.kd && l.material.ks == r.material.ks
+                && l.material.shininess == r.material.shininess && l.material.transparency == r.material.transparency
+                && (l.material.kdTexture == nullptr) == (r.material.kdTexture == nullptr);
+        });
+    }
+
+    // Read a memory statistic of this process in KiB, e.g. "VmRSS" or "VmHWM"; only supported on Linux
+    inline std::optional<size_t> processMemoryKiB(std::string_view name)
+    {
+        std::ifstream status { "/proc/self/status" };
+        for (std::string line; std::getline(status, line);) {
+            if (line.starts_with(name) && line.size() > name.size() && line[name.size()] == ':')
+                return std::stoull(line.substr(name.size() + 1));
+        }
+        return {};
+    }
+
+    // Measure the peak memory in KiB allocated by the capture, as the growth of the peak resident set size of this
+    // process; memory freed earlier but still held by the allocator is reused first, so this is a lower bound
+    inline std::optional<size_t> benchmark_peak_memory_kib(std::function<void()> capture)
+    {
+        std::ofstream { "/proc/self/clear_refs" } << "5"; // Resets the peak resident set size to the current size
+        const auto before = processMemoryKiB("VmRSS");
+        capture();
+        const auto peak = processMemoryKiB("VmHWM");
+        if (!before || !peak)
+            return {};
+        return *peak - std::min(*before, *peak);
+    }
+} // namespace detail
+
+TEST_CASE("Mesh cache")
+{
+    const auto directory = std::filesystem::temp_directory_path() / "cg_mesh_cache_test";
+    std::filesystem::remove_all(directory);
+    const auto file = detail::writeGridObj(directory);
+    const auto cacheFile = meshCachePath(file);
+
+    SECTION("loadMeshCached [Cold and warm loads match loadMesh]")
+    {
+        for (bool normalize : { false, true }) {
+            CAPTURE(normalize);
+            const LoadMeshSettings settings = { .normalizeVertexPositions = normalize };
+            const auto expected = loadMesh(file, settings);
+            CHECK(expected.size() == 3);
+            CHECK(detail::meshesEqual(loadMeshCached(file, settings), expected));
+            CHECK(std::filesystem::exists(cacheFile));
+            CHECK(detail::meshesEqual(loadMeshCached(file, settings), expected));
+        }
+    }
+
+    SECTION("loadMeshCached [Changed sources invalidate the cache]")
+    {
+        loadMeshCached(file);
+
+        // Same contents, but a later timestamp; the cache is kept, and refreshed
+        const auto cacheTime = std::filesystem::last_write_time(cacheFile);
+        std::filesystem::last_write_time(file, std::filesystem::last_write_time(file) + std::chrono::seconds(10));
+        CHECK(detail::meshesEqual(loadMeshCached(file), loadMesh(file)));
+        CHECK(std::filesystem::last_write_time(cacheFile) != cacheTime);
+
+        // Edited materials
+        {
+            std::ofstream mtl { directory / "grid.mtl", std::ios::app };
+            mtl << "Kd 0 0 1\n";
+        }
+        const auto expected = loadMesh(file);
+        CHECK(expected[1].material.kd == glm::vec3(0, 0, 1));
+        CHECK(detail::meshesEqual(loadMeshCached(file), expected));
+    }
+
+    SECTION("loadMeshCached [Corrupt caches are rewritten]")
+    {
+        const auto expected = loadMesh(file);
+        loadMeshCached(file);
+        std::filesystem::resize_file(cacheFile, std::filesystem::file_size(cacheFile) / 2);
+        CHECK(detail::meshesEqual(loadMeshCached(file), expected));
+        CHECK(detail::meshesEqual(loadMeshCached(file), expected));
+    }
+
+    SECTION("loadMeshCached [Caches in a separate directory]")
+    {
+        const auto cacheDir = directory / "cache";
+        const auto expected = loadMesh(file);
+        CHECK(detail::meshesEqual(loadMeshCached(file, {}, cacheDir), expected));
+        CHECK(std::filesystem::exists(meshCachePath(file, cacheDir)));
+        CHECK(meshCachePath(file, cacheDir).parent_path() == cacheDir);
+        CHECK(detail::meshesEqual(loadMeshCached(file, {}, cacheDir), expected));
+    }
+
+    SECTION("loadMeshCached [Concurrent cold loads write one valid cache]")
+    {
+        const auto cacheDir = directory / "cache";
+        const auto expected = loadMesh(file);
+        std::array<bool, 4> equal {};
+        {
+            std::vector<std::jthread> threads;
+            for (size_t i = 0; i < equal.size(); ++i)
+                threads.emplace_back([&, i]() { equal[i] = detail::meshesEqual(loadMeshCached(file, {}, cacheDir), expected); });
+        }
+        CHECK(rng::all_of(equal, [](bool e) { return e; }));
+        CHECK(detail::meshesEqual(loadMeshCached(file, {}, cacheDir), expected));
+        CHECK(std::distance(std::filesystem::directory_iterator(cacheDir), std::filesystem::directory_iterator()) == 1);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Parallel OBJ parser")
+{
+    const auto directory = std::filesystem::temp_directory_path() / "cg_obj_parser_test";
+    std::filesystem::remove_all(directory);
+    const auto gridFile = detail::writeGridObj(directory);
+    const auto stripFile = detail::writeStripObj(directory);
+
+    // Besides the default split, force a single chunk, and many chunks, s.t. the merge of chunks is tested
+    // independent of the machine's nr. of hardware threads
+    for (const auto& file : { gridFile, stripFile }) {
+        tinyobj::attrib_t expectedAttrib;
+        std::vector<tinyobj::shape_t> expectedShapes;
+        std::vector<tinyobj::material_t> expectedMaterials;
+        std::string warn, error;
+        REQUIRE(tinyobj::LoadObj(&expectedAttrib, &expectedShapes, &expectedMaterials, &warn, &error, file.string().c_str(), directory.string().c_str()));
+
+        for (size_t numChunks : { 0u, 1u, 8u }) {
+            CAPTURE(file, numChunks);
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            REQUIRE(loadObjParallel(file, attrib, shapes, materials, numChunks));
+
+            CHECK(attrib.vertices == expectedAttrib.vertices);
+            CHECK(attrib.normals == expectedAttrib.normals);
+            CHECK(attrib.texcoords == expectedAttrib.texcoords);
+            CHECK(materials.size() == expectedMaterials.size());
+            REQUIRE(shapes.size() == expectedShapes.size());
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                CHECK(shapes[i].mesh.material_ids == expectedShapes[i].mesh.material_ids);
+                CHECK(rng::equal(shapes[i].mesh.indices, expectedShapes[i].mesh.indices, [](const tinyobj::index_t& lhs, const tinyobj::index_t& rhs) {
+                    return lhs.vertex_index == rhs.vertex_index && lhs.normal_index == rhs.normal_index && lhs.texcoord_index == rhs.texcoord_index;
+                }));
+            }
+        }
+    }
+
+    // Unsupported features are left to tinyobjloader
+    {
+        std::ofstream obj { directory / "polygon.obj" };
+        obj << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0.5 2 0\nv 0 1 0\nf 1 2 3 4 5\n";
+    }
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    CHECK(!loadObjParallel(directory / "polygon.obj", attrib, shapes, materials));
+    CHECK(loadMesh(directory / "polygon.obj")[0].triangles.size() == 3);
+
+    std::filesystem::remove_all(directory);
+}
+
+// Not run by default; select with the "[benchmark]" tag to measure the load time and peak memory of the OBJ loader
+TEST_CASE("Mesh loading benchmark", "[.][benchmark]")
+{
+    const std::filesystem::path data_dir = DATA_DIR;
+    for (const char* name : benchmark_meshes) {
+        const auto file = data_dir / name;
+        if (!std::filesystem::exists(file)) {
+            WARN(name << ": not found in " << data_dir);
+            continue;
+        }
+
+        size_t num_triangles = 0;
+        const auto peak_memory = detail::benchmark_peak_memory_kib([&]() {
+            for (const Mesh& mesh : loadMesh(file))
+                num_triangles += mesh.triangles.size();
+        });
+        const auto time = detail::benchmark_region_ms(num_benchmark_samples, [&]() { loadMesh(file); });
+        const auto cached_time = detail::benchmark_region_ms(num_benchmark_samples, [&]() { loadMeshCached(file, {}, CACHE_DIR); });
+        WARN(name << ": " << num_triangles << " triangles, " << time.count() << "ms per load, "
+                  << cached_time.count() << "ms per cached load, "
+                  << (peak_memory ? std::to_string(*peak_memory / 1024) + " MiB" : std::string("unknown")) << " peak memory");
+    }
+}
+
+} // namespace test
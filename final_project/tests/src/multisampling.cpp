@@ -1,10 +1,12 @@
 #include "tests.h"
 // #include <Windows.h>
 #include "render.h" // Include the student's code
+#include "sampler.h"
 #include "uniform_tests.h"
 #include <framework/trackball.h>
 #include <framework/window.h>
 #include <memory>
+#include <vector>
 
 namespace test {
 
@@ -162,4 +164,64 @@ TEST_CASE("Multisampling")
     camera_p.reset();
     window_p.reset();
 }
+
+TEST_CASE("Sample sequences")
+{
+    detail::Chi2FitTest chi2_tester(chi2_classes_x * chi2_classes_x, chi2_limit);
+    auto f_push_sample = [&chi2_tester](glm::vec2 v) {
+        chi2_tester.puti(static_cast<uint32_t>(v.x * static_cast<float>(chi2_classes_x)) * chi2_classes_x
+            + static_cast<uint32_t>(v.y * static_cast<float>(chi2_classes_x)));
+    };
+    constexpr auto f_test_bounded = [](glm::vec2 v) { return v.x >= 0.f && v.x < 1.f && v.y >= 0.f && v.y < 1.f; };
+
+    SECTION("Sampler [Random sequences are unchanged by the sequence constructor]")
+    {
+        ::Sampler a(17), b(17, SampleSequence::Random);
+        for (uint32_t i = 0; i < 16; i++)
+            CHECK(a.next_1d() == b.next_1d());
+    }
+
+    SECTION("Sampler [Sobol camera samples are each in one stratified bin]")
+    {
+        for (uint32_t seed : { 0u, 1u, 12345u }) {
+            ::Sampler sampler(seed, SampleSequence::Sobol);
+            chi2_tester.clear();
+            for (uint32_t i = 0; i < chi2_classes_x * chi2_classes_x; i++) {
+                glm::vec2 v = sampler.next_2d();
+                CHECK(f_test_bounded(v));
+                f_push_sample(v);
+            }
+            CHECK(chi2_tester.chi2() == 0);
+        }
+    }
+
+    SECTION("Sampler [Sobol path samples are each in one stratified bin, in every dimension]")
+    {
+        std::vector<::Sampler> samplers;
+        ::Sampler sampler(7, SampleSequence::Sobol);
+        for (uint32_t i = 0; i < chi2_classes_x * chi2_classes_x; i++) {
+            sampler.nextSample();
+            samplers.push_back(sampler);
+        }
+        for (uint32_t dimension = 0; dimension < 4; dimension++) {
+            chi2_tester.clear();
+            for (auto& s : samplers)
+                f_push_sample(s.next_2d());
+            CHECK(chi2_tester.chi2() == 0);
+        }
+    }
+
+    SECTION("Sampler [Sobol samples follow a uniform distribution across pixels]")
+    {
+        chi2_tester.clear();
+        for (uint32_t seed = 0; seed < num_samples; seed++) {
+            ::Sampler sampler(seed, SampleSequence::Sobol);
+            sampler.nextSample();
+            glm::vec2 v = sampler.next_2d();
+            CHECK(f_test_bounded(v));
+            f_push_sample(v);
+        }
+        CHECK(chi2_tester.test_chi2());
+    }
+}
 } // namespace test
\ No newline at end of file
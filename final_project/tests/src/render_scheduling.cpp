@@ -0,0 +1,466 @@
+#include "tests.h"
+#include "bvh.h" // Include the student's code
+#include "camera.h"
+#include "render.h"
+#include "screen.h"
+#include "timer.h"
+#include "wavefront.h"
+#include <framework/trackball.h>
+#include <framework/window.h>
+#include <array>
+#include <memory>
+#include <thread>
+
+namespace test {
+
+// Test settings
+constexpr glm::ivec2 resolution = { 100, 37 }; // Screen resolution, deliberately not a multiple of the tile size
+constexpr uint32_t tile_size = 16; // Width and height of a tile in pixels
+constexpr uint32_t num_threads = 4; // Nr. of threads pulling tiles from the scheduler
+
+namespace detail {
+    // Count how often each pixel of the screen is covered by the given tiles
+    inline std::vector<uint32_t> tileCoverage(std::span<const RenderTile> tiles)
+    {
+        std::vector<uint32_t> coverage(static_cast<size_t>(resolution.x * resolution.y), 0);
+        for (const auto& tile : tiles) {
+            for (int y = tile.begin.y; y < tile.end.y; ++y) {
+                for (int x = tile.begin.x; x < tile.end.x; ++x) {
+                    coverage[static_cast<size_t>(y * resolution.x + x)]++;
+                }
+            }
+        }
+        return coverage;
+    }
+
+    // A single lit, diffuse triangle facing the default camera, which looks down +z
+    inline Scene litTriangleScene()
+    {
+        Mesh mesh;
+        mesh.vertices = {
+            { .position = { -1, -1, 0 }, .normal = { 0, 0, -1 } },
+            { .position = { 1, -1, 0 }, .normal = { 0, 0, -1 } },
+            { .position = { 0, 1, 0 }, .normal = { 0, 0, -1 } }
+        };
+        mesh.triangles = { { 0, 1, 2 } };
+        mesh.material.kd = glm::vec3(0.8f);
+
+        Scene scene = { .type = SceneType::Custom };
+        scene.meshes.push_back(mesh);
+        scene.lights.push_back(PointLight { .position = { 0.3f, 0.5f, -1.5f }, .color = glm::vec3(1) });
+        return scene;
+    }
+} // namespace detail
+
+TEST_CASE("Render scheduling")
+{
+    SECTION("generateRenderTiles [Tiles cover every pixel exactly once, in every order]")
+    {
+        for (auto order : { TileOrder::Scanline, TileOrder::Morton, TileOrder::Spiral }) {
+            auto tiles = generateRenderTiles(resolution, tile_size, order);
+            CAPTURE(static_cast<uint32_t>(order));
+            CHECK(tiles.size() == 7 * 3);
+            CHECK(rng::all_of(detail::tileCoverage(tiles), [](uint32_t c) { return c == 1; }));
+        }
+    }
+
+    SECTION("generateRenderTiles [Morton order starts with a 2x2 block, spiral order at the center]")
+    {
+        auto morton = generateRenderTiles(resolution, tile_size, TileOrder::Morton);
+        CHECK(morton[0].begin == glm::ivec2(0, 0));
+        CHECK(morton[1].begin == glm::ivec2(16, 0));
+        CHECK(morton[2].begin == glm::ivec2(0, 16));
+        CHECK(morton[3].begin == glm::ivec2(16, 16));
+
+        auto spiral = generateRenderTiles(resolution, tile_size, TileOrder::Spiral);
+        glm::ivec2 center = resolution / 2;
+        CHECK(glm::all(glm::lessThanEqual(spiral[0].begin, center)));
+        CHECK(glm::all(glm::greaterThan(spiral[0].end, center)));
+    }
+
+    SECTION("TileScheduler [Each tile is handed out exactly once, including stolen tiles]")
+    {
+        auto tiles = generateRenderTiles(resolution, tile_size, TileOrder::Morton);
+        TileScheduler scheduler(tiles, num_threads);
+
+        // A single thread drains its own queue in order, and then steals all other threads' tiles
+        std::vector<RenderTile> handed_out;
+        while (auto tile = scheduler.next(0))
+            handed_out.push_back(*tile);
+        REQUIRE(handed_out.size() == tiles.size());
+        CHECK(rng::all_of(detail::tileCoverage(handed_out), [](uint32_t c) { return c == 1; }));
+        for (size_t i = 0; i < tiles.size() / num_threads; ++i) {
+            CHECK(handed_out[i].begin == tiles[i].begin);
+        }
+    }
+
+    SECTION("TileScheduler [Concurrent threads receive each tile exactly once]")
+    {
+        auto tiles = generateRenderTiles(resolution, 4, TileOrder::Spiral);
+        TileScheduler scheduler(tiles, num_threads);
+
+        std::array<std::vector<RenderTile>, num_threads> handed_out;
+        std::vector<std::jthread> threads;
+        for (uint32_t i = 0; i < num_threads; ++i) {
+            threads.emplace_back([&, i]() {
+                while (auto tile = scheduler.next(i))
+                    handed_out[i].push_back(*tile);
+            });
+        }
+        threads.clear(); // Joins all threads
+
+        auto all_handed_out = handed_out | vws::join | rng::to<std::vector>();
+        CHECK(all_handed_out.size() == tiles.size());
+        CHECK(rng::all_of(detail::tileCoverage(all_handed_out), [](uint32_t c) { return c == 1; }));
+    }
+}
+
+TEST_CASE("Tiled rendering")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Tiled rendering", glm::ivec2(64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 1.f, glm::vec3(0), 3.f, 0.f, 0.f);
+
+    Scene scene = detail::litTriangleScene();
+    Features features = { .enableShading = true, .enableShadows = true, .enableAccelStructure = true };
+    BVH bvh(scene, features);
+
+    SECTION("renderImage [Tiles produce the same image as the default scanline bands, in every order]")
+    {
+        Screen reference(resolution, false);
+        renderImage(scene, bvh, features, *camera_p, reference);
+
+        features.extra.enableRenderTiles = true;
+        features.extra.renderTileSize = tile_size;
+        for (auto order : { TileOrder::Scanline, TileOrder::Morton, TileOrder::Spiral }) {
+            features.extra.renderTileOrder = order;
+            Screen screen(resolution, false);
+            renderImage(scene, bvh, features, *camera_p, screen);
+
+            CAPTURE(static_cast<uint32_t>(order));
+            CHECK(screen.pixels() == reference.pixels());
+        }
+    }
+}
+
+TEST_CASE("Progressive rendering")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Progressive rendering", glm::ivec2(64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 1.f, glm::vec3(0), 3.f, 0.f, 0.f);
+
+    Scene scene = detail::litTriangleScene();
+    Features features = { .enableShading = true, .enableAccelStructure = true };
+    BVH bvh(scene, features);
+    Screen screen(glm::ivec2(32, 24), false);
+    ProgressiveRenderer renderer;
+
+    SECTION("ProgressiveRenderer [The first frame matches a single-sample render]")
+    {
+        Screen reference(screen.resolution(), false);
+        renderImage(scene, bvh, features, *camera_p, reference);
+        renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+        CHECK(renderer.numSamples() == 1);
+        CHECK(screen.pixels() == reference.pixels());
+    }
+
+    SECTION("ProgressiveRenderer [Samples accumulate while nothing changes]")
+    {
+        for (uint32_t i = 1; i <= 8; ++i) {
+            renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+            CHECK(renderer.numSamples() == i);
+        }
+    }
+
+    SECTION("ProgressiveRenderer [Accumulation restarts when the features, lights, or camera change]")
+    {
+        renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+        renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+        REQUIRE(renderer.numSamples() == 2);
+
+        features.enableShadows = true;
+        renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+        CHECK(renderer.numSamples() == 1);
+
+        std::get<PointLight>(scene.lights[0]).color = glm::vec3(0.5f);
+        renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+        CHECK(renderer.numSamples() == 1);
+
+        camera_p->setCamera(glm::vec3(0.1f, 0, 0), glm::vec3(0), 3.f);
+        renderer.renderFrame(scene, bvh, features, *camera_p, screen);
+        CHECK(renderer.numSamples() == 1);
+
+        renderer.reset();
+        CHECK(renderer.numSamples() == 0);
+    }
+}
+
+TEST_CASE("Allocation-free ray generation")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Allocation-free ray generation", glm::ivec2(64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 1.f, glm::vec3(0), 3.f, 0.f, 0.f);
+
+    Scene scene;
+    ref::Sampler sampler(4);
+    ref::FakeBVH bvh(sampler, 0);
+    glm::ivec2 pixel = { 7, 11 }, res = { 16, 16 };
+
+    SECTION("numPixelRays [Counts the rays of each sampling strategy]")
+    {
+        CHECK(numPixelRays({ .numPixelSamples = 1 }) == 1);
+        CHECK(numPixelRays({ .numPixelSamples = 10 }) == 10);
+        CHECK(numPixelRays({ .enableJitteredSampling = true, .numPixelSamples = 10 }) == 9);
+        CHECK(numPixelRays({ .enableJitteredSampling = true, .numPixelSamples = 16 }) == 16);
+    }
+
+    SECTION("generatePixelRays [The buffered overload writes the same ray into the caller's buffer]")
+    {
+        Features features = { .numPixelSamples = 1 };
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        auto expected = generatePixelRays(state, *camera_p, pixel, res);
+
+        std::array<Ray, 4> buffer;
+        auto rays = generatePixelRays(state, CameraFrame(*camera_p), pixel, res, buffer);
+        REQUIRE(rays.size() == 1);
+        CHECK(rays.data() == buffer.data());
+        CHECK(rays[0].origin == expected[0].origin);
+        CHECK(rays[0].direction == expected[0].direction);
+    }
+}
+
+TEST_CASE("Camera frame")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Camera frame", glm::ivec2(96, 64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 0.8f, glm::vec3(0), 3.f, 0.f, 0.f);
+    camera_p->setCamera(glm::vec3(0.5f, -0.25f, 1.0f), glm::vec3(0.3f, -1.1f, 0.0f), 2.5f);
+    const CameraFrame frame(*camera_p);
+
+    const std::array<glm::vec2, 5> positions = { { { 0, 0 }, { -1, -1 }, { 1, 1 }, { 0.25f, -0.75f }, { -0.6f, 0.9f } } };
+    const auto f_approx = [](glm::vec3 a, glm::vec3 b) { return glm::all(glm::epsilonEqual(a, b, 1e-5f)); };
+
+    SECTION("generateRay [Rays match those of the trackball]")
+    {
+        CHECK(f_approx(frame.position(), camera_p->position()));
+        for (const auto& position : positions) {
+            Ray expected = camera_p->generateRay(position), ray = frame.generateRay(position);
+            CHECK(f_approx(ray.origin, expected.origin));
+            CHECK(f_approx(ray.direction, expected.direction));
+            CHECK(ray.t == expected.t);
+        }
+    }
+
+    SECTION("CameraFrame [Frames built from camera parameters need no window, and match the trackball's]")
+    {
+        const CameraFrame standalone(glm::vec3(0.5f, -0.25f, 1.0f), glm::vec3(0.3f, -1.1f, 0.0f), 2.5f, 0.8f, 96.f / 64.f);
+        CHECK(f_approx(standalone.position(), camera_p->position()));
+        for (const auto& position : positions) {
+            Ray expected = camera_p->generateRay(position), ray = standalone.generateRay(position);
+            CHECK(f_approx(ray.origin, expected.origin));
+            CHECK(f_approx(ray.direction, expected.direction));
+        }
+    }
+
+    SECTION("generateRays [Batched rays match single rays]")
+    {
+        std::array<Ray, positions.size()> rays;
+        frame.generateRays(positions, rays);
+        for (size_t i = 0; i < positions.size(); i++) {
+            Ray expected = frame.generateRay(positions[i]);
+            CHECK(f_approx(rays[i].origin, expected.origin));
+            CHECK(f_approx(rays[i].direction, expected.direction));
+        }
+    }
+}
+
+TEST_CASE("Adaptive sampling")
+{
+    // Instantiate reference objects
+    ref::Sampler sampler(4);
+
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Adaptive sampling", glm::ivec2(64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 1.f, glm::vec3(0), 3.f, 0.f, 0.f);
+
+    // A single white light; without shading, each hit then returns its material's kd
+    Scene scene = { .type = Custom };
+    scene.lights.push_back(PointLight { .position = { 0, 0, -3 }, .color = glm::vec3(1) });
+    Features features = {
+        .enableShading = false,
+        .numPixelSamples = 1,
+        .extra = { .enableAdaptiveSampling = true, .adaptiveSamplingThreshold = 0.02f, .adaptiveSamplingMaxSamples = 64 }
+    };
+    glm::ivec2 pixel = { 7, 11 }, res = { 16, 16 };
+
+    SECTION("renderPixelAdaptive [Noiseless pixels stop early]")
+    {
+        ref::FakeBVH bvh(sampler, 0);
+        bvh.set_hit_index(static_cast<uint32_t>(bvh.hits().size())); // Every ray misses
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        auto sample = renderPixelAdaptive(state, CameraFrame(*camera_p), pixel, res);
+        CHECK(sample.numSamples < features.extra.adaptiveSamplingMaxSamples);
+        CHECK(sample.error == 0.f);
+        CHECK(sample.radiance == glm::vec3(0));
+    }
+
+    SECTION("renderPixelAdaptive [Noisy pixels sample up to the cap, and average their samples]")
+    {
+        // Alternate between black and white hits, s.t. the error estimate stays large
+        ref::FakeBVH bvh(sampler, features.extra.adaptiveSamplingMaxSamples);
+        for (uint32_t i = 0; i < features.extra.adaptiveSamplingMaxSamples; ++i) {
+            bvh.hits()[i].hit.material = { .kd = glm::vec3(static_cast<float>(i % 2)) };
+        }
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        auto sample = renderPixelAdaptive(state, CameraFrame(*camera_p), pixel, res);
+        CHECK(sample.numSamples == features.extra.adaptiveSamplingMaxSamples);
+        CHECK(sample.error > features.extra.adaptiveSamplingThreshold);
+        CHECK_THAT(sample.radiance.x, Catch::Matchers::WithinAbs(0.5f, 1e-5f));
+    }
+
+    SECTION("renderPixelAdaptive [Pixels on an edge converge to their coverage]")
+    {
+        // A white triangle whose left edge runs through the center of the screen's center pixel, s.t. it
+        // covers exactly half of that pixel; camera rays through the pixel's center alone would not see this
+        Mesh mesh;
+        mesh.vertices = { { .position = { 0, -10, 0 } }, { .position = { 10, -10, 0 } }, { .position = { 0, 10, 0 } } };
+        mesh.triangles = { { 0, 1, 2 } };
+        mesh.material.kd = glm::vec3(1);
+        scene.meshes.push_back(mesh);
+        BVH bvh(scene, features);
+
+        for (auto sequence : { SampleSequence::Random, SampleSequence::Sobol }) {
+            features.extra.sampleSequence = sequence;
+            features.extra.adaptiveSamplingMaxSamples = 256;
+            RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4, sequence } };
+            auto sample = renderPixelAdaptive(state, CameraFrame(*camera_p), { 7, 7 }, { 15, 15 });
+
+            CAPTURE(static_cast<uint32_t>(sequence), sample.numSamples);
+            CHECK(sample.numSamples > 4);
+            CHECK_THAT(sample.radiance.x, Catch::Matchers::WithinAbs(0.5f, 0.1f));
+        }
+    }
+}
+
+TEST_CASE("Wavefront rendering")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Wavefront rendering", glm::ivec2(64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 1.f, glm::vec3(0), 3.f, 0.f, 0.f);
+
+    // Add a second light; with shadows, the visibility of both is resolved by the shadow connect stage
+    Scene scene = detail::litTriangleScene();
+    scene.lights.push_back(PointLight { .position = { -0.5f, 0.f, -1.5f }, .color = glm::vec3(0.5f) });
+
+    SECTION("renderImageWavefront [Matches renderImage()]")
+    {
+        for (bool shadows : { false, true }) {
+            Features features = { .enableShading = true, .enableShadows = shadows, .enableAccelStructure = true };
+            BVH bvh(scene, features);
+            Screen reference(glm::ivec2(40, 30), false), screen(glm::ivec2(40, 30), false);
+            renderImage(scene, bvh, features, *camera_p, reference);
+            renderImageWavefront(scene, bvh, features, CameraFrame(*camera_p), screen);
+
+            CAPTURE(shadows);
+            CHECK(rng::equal(screen.pixels(), reference.pixels(), [](const glm::vec3& a, const glm::vec3& b) {
+                return glm::all(glm::epsilonEqual(a, b, 1e-5f));
+            }));
+        }
+    }
+
+    SECTION("renderImageWavefront [Matches renderImage() for reflective and transparent materials, and area lights]")
+    {
+        // Put a wall behind the triangle, which transparency reveals, and add both kinds of area lights; where the
+        // wall is reflective, it mirrors the triangle, s.t. secondary rays also hit geometry
+        Mesh wall;
+        wall.vertices = {
+            { .position = { -4, -4, 1 }, .normal = { 0, 0, -1 } },
+            { .position = { 4, -4, 1 }, .normal = { 0, 0, -1 } },
+            { .position = { 4, 4, 1 }, .normal = { 0, 0, -1 } },
+            { .position = { -4, 4, 1 }, .normal = { 0, 0, -1 } }
+        };
+        wall.triangles = { { 0, 1, 2 }, { 0, 2, 3 } };
+        wall.material.kd = glm::vec3(0.2f, 0.5f, 0.3f);
+        scene.meshes.push_back(wall);
+        scene.lights.push_back(SegmentLight { .endpoint0 = { -1, 1, -2 }, .endpoint1 = { 1, 1, -2 }, .color0 = glm::vec3(0.5f), .color1 = glm::vec3(0.2f) });
+        scene.lights.push_back(ParallelogramLight {
+            .v0 = { -0.5f, -1, -2 }, .edge01 = { 1, 0, 0 }, .edge02 = { 0, 0, 1 },
+            .color0 = glm::vec3(0.3f), .color1 = glm::vec3(0.1f), .color2 = glm::vec3(0.2f), .color3 = glm::vec3(0.4f) });
+
+        const std::array<std::pair<glm::vec3, float>, 3> materials = { { { glm::vec3(0), 1.f }, { glm::vec3(0.5f), 1.f }, { glm::vec3(0.3f), 0.4f } } };
+        for (const auto& [ks, transparency] : materials) {
+            for (bool shadows : { false, true }) {
+                scene.meshes[0].material.ks = ks;
+                scene.meshes[0].material.transparency = transparency;
+                scene.meshes[1].material.ks = ks;
+                Features features = {
+                    .enableShading = true,
+                    .enableReflections = true,
+                    .enableShadows = shadows,
+                    .enableAccelStructure = true,
+                    .enableTransparency = true,
+                    .shadingModel = ShadingModel::Phong,
+                    .numShadowSamples = 4
+                };
+                BVH bvh(scene, features);
+                Screen reference(glm::ivec2(40, 30), false), screen(glm::ivec2(40, 30), false);
+                renderImage(scene, bvh, features, *camera_p, reference);
+                renderImageWavefront(scene, bvh, features, CameraFrame(*camera_p), screen);
+
+                CAPTURE(ks.x, transparency, shadows);
+                CHECK(rng::equal(screen.pixels(), reference.pixels(), [](const glm::vec3& a, const glm::vec3& b) {
+                    return glm::all(glm::epsilonEqual(a, b, 1e-5f));
+                }));
+            }
+        }
+    }
+}
+
+// Not run by default; select with the "[benchmark]" tag to measure the time and heap allocations of adaptive
+// sampling at 64 samples per pixel, with a ray buffer per pixel or one reused across all pixels
+TEST_CASE("Adaptive sampling benchmark", "[.][benchmark]")
+{
+    // The trackball needs an OpenGL context
+    auto window_p = std::make_unique<Window>("Adaptive sampling benchmark", glm::ivec2(64), OpenGLVersion::GL45, false);
+    auto camera_p = std::make_unique<Trackball>(window_p.get(), 1.f, glm::vec3(0), 3.f, 0.f, 0.f);
+    const CameraFrame camera(*camera_p);
+
+    Scene scene = detail::litTriangleScene();
+    Features features = {
+        .enableShading = true,
+        .enableAccelStructure = true,
+        .enableJitteredSampling = true,
+        .numPixelSamples = 64,
+        .extra = { .enableAdaptiveSampling = true, .adaptiveSamplingThreshold = 0.02f, .adaptiveSamplingMaxSamples = 64 }
+    };
+    BVH bvh(scene, features);
+    constexpr glm::ivec2 benchmark_resolution = { 64, 64 };
+    constexpr uint32_t num_pixels = benchmark_resolution.x * benchmark_resolution.y;
+
+    const auto benchmark = [&](std::string_view name, bool reuse_buffer) {
+        RenderState state = { .scene = scene, .features = features, .bvh = bvh, .sampler = { 4 } };
+        std::vector<Ray> rayBuffer(numPixelRays(features));
+        uint64_t num_samples = 0;
+        const auto render = [&]() {
+            for (int y = 0; y < benchmark_resolution.y; ++y) {
+                for (int x = 0; x < benchmark_resolution.x; ++x) {
+                    auto sample = reuse_buffer ? renderPixelAdaptive(state, camera, { x, y }, benchmark_resolution, rayBuffer)
+                                               : renderPixelAdaptive(state, camera, { x, y }, benchmark_resolution);
+                    num_samples += sample.numSamples;
+                }
+            }
+        };
+        auto time = detail::benchmark_region_us(4, render);
+        num_samples = 0;
+        uint64_t allocations_before = num_allocations;
+        render();
+        uint64_t allocations = num_allocations - allocations_before;
+        WARN(name << ": " << time.count() << "us per " << num_pixels << " pixels, "
+                  << static_cast<double>(num_samples) / num_pixels << " samples and "
+                  << static_cast<double>(allocations) / num_pixels << " allocations per pixel");
+    };
+
+    benchmark("Ray buffer per pixel", false);
+    benchmark("Reused ray buffer", true);
+}
+} // namespace test
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+// Read-only memory mapping of an entire file; the file's contents are paged in by the OS on first access, so
+// opening a large file costs next to nothing, and reading it costs little more than a memcpy. The mapping is
+// released when the object is destroyed.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    // Map the file at the given path; on failure, e.g. if the file does not exist, the result is not open
+    explicit MappedFile(const std::filesystem::path& path);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    [[nodiscard]] bool isOpen() const { return m_data != nullptr; }
+    [[nodiscard]] std::span<const std::byte> data() const { return { m_data, m_size }; }
+
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_fileMapping = nullptr;
+#endif
+
+    void close();
+};
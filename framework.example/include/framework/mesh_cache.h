@@ -0,0 +1,27 @@
+#pragma once
+#include "mesh.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Binary cache of the output of `loadMesh()`, which skips parsing the OBJ file on later loads. The cache stores the
+// deduplicated vertices, triangles and materials of each sub mesh, after the load settings are applied. It is memory
+// mapped on load, so a warm load costs little more than copying the vertex and triangle arrays.
+//
+// A cache is valid for the settings it was written with. It is also checked against the OBJ file and its MTL files.
+// If their sizes and modification times match, no source is read at all. Otherwise the sources are hashed. A cache
+// whose hash still matches, e.g. after a fresh checkout, is kept and its timestamps are updated. Textures are stored
+// by path and loaded as usual.
+
+// Version of the cache format; bump this whenever the layout, or the output of `loadMesh()`, changes
+constexpr uint32_t MeshCacheVersion = 1;
+
+// Given an OBJ file, return the path of its cache; next to the OBJ file, or in `cacheDir` if it is not empty
+std::filesystem::path meshCachePath(const std::filesystem::path& file, const std::filesystem::path& cacheDir = {});
+
+// Same as `loadMesh()`, but reads the meshes from a valid cache if there is one, and otherwise (re)writes it.
+// Failing to write the cache, e.g. in a read-only data directory, is not an error.
+std::vector<Mesh> loadMeshCached(const std::filesystem::path& file, const LoadMeshSettings& settings = {}, const std::filesystem::path& cacheDir = {});
+
+// Same as `loadMesh()`, but also returns the path of each mesh's diffuse texture, or an empty path for meshes without one
+std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings, std::vector<std::filesystem::path>& texturePaths);
@@ -0,0 +1,25 @@
+#pragma once
+// Suppress warnings in third-party code.
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <tinyobjloader/tiny_obj_loader.h>
+DISABLE_WARNINGS_POP()
+#include <filesystem>
+#include <vector>
+
+// Multithreaded OBJ parser for large meshes, which produces the same output as `tinyobj::LoadObj()` with triangulation.
+// The file is memory mapped and split at line boundaries into one chunk per thread. Each chunk is parsed into its own
+// vertex and face arrays, with a float parser that matches tinyobjloader's bit for bit. The chunks are then merged in
+// file order, s.t. relative indices, materials, and groups resolve exactly as in a sequential parse.
+//
+// Only the common subset of OBJ is handled: positions, normals, texture coordinates, triangles and quads, materials,
+// groups, objects, smoothing groups and comments. Given anything else, e.g. lines, polygons with more than four
+// vertices, or malformed faces, this returns false, and the caller should fall back to `tinyobj::LoadObj()`.
+//
+// Of the attributes, only the positions, normals and texture coordinates are filled; of the shapes, only the
+// triangle indices and material ids; `loadMesh()` uses nothing else.
+//
+// By default, small files are parsed as a single chunk; `numChunks` instead forces the nr. of chunks, e.g. to test
+// the merge of many chunks on a small file, independent of the nr. of hardware threads.
+bool loadObjParallel(const std::filesystem::path& file, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+    std::vector<tinyobj::material_t>& materials, size_t numChunks = 0);
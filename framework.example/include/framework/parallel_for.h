@@ -0,0 +1,27 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Call `f(i)` for every i in [0, count), spread over up to `maxThreads` threads (by default one per hardware thread);
+// the calling thread takes part, and the indices are handed out dynamically, so uneven work items balance out.
+template <typename F>
+void parallelFor(size_t count, F&& f, size_t maxThreads = std::thread::hardware_concurrency())
+{
+    const size_t numThreads = std::clamp<size_t>(maxThreads, 1, std::max<size_t>(count, 1));
+    std::atomic_size_t next = 0;
+    const auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            f(i);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (size_t i = 1; i < numThreads; i++)
+        threads.emplace_back(work);
+    work();
+    for (auto& thread : threads)
+        thread.join();
+}
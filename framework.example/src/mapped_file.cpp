@@ -0,0 +1,109 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <utility>
+
+// Empty files cannot be mapped, but are still valid files; these point here instead
+static const std::byte emptyFile {};
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        m_data = &emptyFile;
+        return;
+    }
+    HANDLE fileMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // The mapping keeps the file open
+    if (fileMapping == nullptr) {
+        return;
+    }
+    void* data = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(fileMapping);
+        return;
+    }
+    m_fileMapping = fileMapping;
+    m_data = static_cast<const std::byte*>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file == -1) {
+        return;
+    }
+    struct stat status;
+    if (::fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+        ::close(file);
+        return;
+    }
+    if (status.st_size == 0) {
+        ::close(file);
+        m_data = &emptyFile;
+        return;
+    }
+    void* data = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file); // The mapping keeps the file open
+    if (data == MAP_FAILED) {
+        return;
+    }
+    m_data = static_cast<const std::byte*>(data);
+    m_size = static_cast<size_t>(status.st_size);
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+        m_fileMapping = std::exchange(other.m_fileMapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+    if (m_data != nullptr && m_data != &emptyFile) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_fileMapping);
+        m_fileMapping = nullptr;
+#else
+        ::munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
@@ -1,4 +1,7 @@
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "obj_parser.h"
+#include "parallel_for.h"
 // Suppress warnings in third-party code.
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
@@ -8,6 +11,7 @@ DISABLE_WARNINGS_PUSH()
 #include <tinyobjloader/tiny_obj_loader.h>
 DISABLE_WARNINGS_POP()
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <exception>
 #include <iostream>
@@ -15,8 +19,11 @@ DISABLE_WARNINGS_POP()
 #include <span>
 #include <stack>
 #include <string>
-#include <tuple>
-#include <map>
+#include <cstdint>
+#include <vector>
+
+// Meshes with fewer triangles are converted on a single thread
+static constexpr size_t MinParallelTriangles = 1 << 16;
 
 static void centerAndScaleToUnitMesh(std::span<Mesh> meshes);
 
@@ -25,31 +32,72 @@ static glm::vec3 construct_vec3(const float* pFloats)
     return glm::vec3(pFloats[0], pFloats[1], pFloats[2]);
 }
 
-// https://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
-template <class T>
-static void hash_combine(std::size_t& seed, const T& v)
-{
-    std::hash<T> hasher;
-    seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-}
+// Open-addressing hash map from the (vertex, normal, texcoord) indices of an OBJ face corner to the index of its
+// vertex in the generated mesh, which are numbered in order of insertion. The slots form one flat array of vertex
+// indices, sized up front from the triangle count of a sub mesh; the keys themselves are stored once per vertex.
+class CornerIndexMap {
+public:
+    // Empty the map, and size it for a sub mesh with the given nr. of triangles
+    void reset(size_t numTriangles)
+    {
+        m_keys.clear();
+        resize(std::max<size_t>(16, std::bit_ceil(2 * numTriangles)));
+    }
 
-struct VertexHash {
-    size_t operator()(const Vertex& v) const
+    // Return the index of the key; a new key gets the nr. of keys stored before it
+    uint32_t findOrInsert(const tinyobj::index_t& key)
     {
-        size_t seed = 0;
-        hash_combine(seed, v.position.x);
-        hash_combine(seed, v.position.y);
-        hash_combine(seed, v.position.z);
-        hash_combine(seed, v.normal.x);
-        hash_combine(seed, v.normal.y);
-        hash_combine(seed, v.normal.z);
-        hash_combine(seed, v.texCoord.s);
-        hash_combine(seed, v.texCoord.t);
-        return seed;
+        if (2 * (m_keys.size() + 1) > m_slots.size())
+            resize(2 * m_slots.size()); // Keep the load factor at or below 1/2
+        for (size_t i = hash(key) & m_mask;; i = (i + 1) & m_mask) {
+            if (m_slots[i] == Empty) {
+                m_slots[i] = (uint32_t)m_keys.size();
+                m_keys.push_back(key);
+                return m_slots[i];
+            }
+            const auto& slotKey = m_keys[m_slots[i]];
+            if (slotKey.vertex_index == key.vertex_index && slotKey.normal_index == key.normal_index && slotKey.texcoord_index == key.texcoord_index)
+                return m_slots[i];
+        }
+    }
+
+private:
+    static constexpr uint32_t Empty = 0xFFFFFFFF;
+
+    static size_t hash(const tinyobj::index_t& key)
+    {
+        // Mix the indices with odd constants, and fold the high bits into the low bits used by the mask
+        uint64_t h = static_cast<uint32_t>(key.vertex_index) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint32_t>(key.normal_index) * 0xC2B2AE3D27D4EB4Full;
+        h ^= static_cast<uint32_t>(key.texcoord_index) * 0x165667B19E3779F9ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    // Resize to a power-of-two nr. of slots, and reinsert the stored keys
+    void resize(size_t capacity)
+    {
+        m_slots.assign(capacity, Empty);
+        m_mask = capacity - 1;
+        for (uint32_t index = 0; index < m_keys.size(); index++) {
+            size_t i = hash(m_keys[index]) & m_mask;
+            while (m_slots[i] != Empty)
+                i = (i + 1) & m_mask;
+            m_slots[i] = index;
+        }
     }
+
+    std::vector<uint32_t> m_slots; // Index of the key in each slot, or `Empty`
+    std::vector<tinyobj::index_t> m_keys; // Key of each index
+    size_t m_mask = 0;
 };
 
 std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings)
+{
+    std::vector<std::filesystem::path> texturePaths;
+    return loadMesh(file, settings, texturePaths);
+}
+
+std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSettings& settings, std::vector<std::filesystem::path>& texturePaths)
 {
     if (!std::filesystem::exists(file)) {
         std::cerr << "File " << file << " does not exist." << std::endl;
@@ -62,21 +110,28 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSett
     std::vector<tinyobj::shape_t> inShapes;
     std::vector<tinyobj::material_t> inMaterials;
 
+    // Large files are parsed in parallel; files with OBJ features that the parallel parser does not handle fall back to tinyobjloader.
     std::string warn, error;
-    bool ret = tinyobj::LoadObj(&inAttrib, &inShapes, &inMaterials, &warn, &error, file.string().c_str(), baseDir.string().c_str());
+    bool ret = loadObjParallel(file, inAttrib, inShapes, inMaterials)
+        || tinyobj::LoadObj(&inAttrib, &inShapes, &inMaterials, &warn, &error, file.string().c_str(), baseDir.string().c_str());
     if (!ret) {
         std::cerr << "Failed to load mesh " << file << std::endl;
         throw std::exception();
     }
 
-    std::vector<Mesh> out;
+    // tinyobjloader does not automatically split the mesh into smaller sub meshes according to material so we have to do it ourselves.
+    struct SubMesh {
+        const tinyobj::shape_t* shape;
+        size_t startTriangle, endTriangle;
+    };
+    std::vector<SubMesh> subMeshes;
+    size_t numTriangles = 0;
     for (const auto& shape : inShapes) {
         assert(shape.mesh.indices.size() % 3 == 0);
 
         size_t startTriangle = 0;
         auto prevMaterialID = shape.mesh.material_ids[0];
         for (size_t endTriangle = 0; endTriangle < shape.mesh.indices.size() / 3; ++endTriangle) {
-            // tinyobjloader does not automatically split the mesh into smaller sub meshes according to material so we have to do it ourselves.
             if (endTriangle == shape.mesh.indices.size() / 3 - 1)
                 ++endTriangle; // End of the tinyobj.shape; write remaining mesh.
             else if (shape.mesh.material_ids[endTriangle] == prevMaterialID)
@@ -84,64 +139,76 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, const LoadMeshSett
             else
                 prevMaterialID = shape.mesh.material_ids[endTriangle];
 
-            Mesh mesh;
-            using CacheKey = std::tuple<uint32_t, uint32_t, uint32_t>;
-            std::map<CacheKey, uint32_t> vertexCache; // Map the index of a vertex as loaded by tinyobjloader to its index in the generated mesh
-            for (size_t i = startTriangle * 3; i != endTriangle * 3; i += 3) {
-                const glm::vec3 v0 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 0].vertex_index]);
-                const glm::vec3 v1 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 1].vertex_index]);
-                const glm::vec3 v2 = construct_vec3(&inAttrib.vertices[3 * shape.mesh.indices[i + 2].vertex_index]);
-                const auto geometricNormal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
-
-                // Load the triangle indices and lazily create the vertices.
-                glm::uvec3 triangle;
-                for (unsigned j = 0; j < 3; j++) {
-                    const auto& tinyObjIndex = shape.mesh.indices[i + j];
-                    Vertex vertex {
-                        .position = construct_vec3(&inAttrib.vertices[3 * tinyObjIndex.vertex_index]),
-                        .normal = glm::vec3(0),
-                        .texCoord = glm::vec2(0)
-                    };
-                    if (tinyObjIndex.normal_index != -1 && !inAttrib.normals.empty())
-                        vertex.normal = glm::vec3(inAttrib.normals[3 * tinyObjIndex.normal_index + 0], inAttrib.normals[3 * tinyObjIndex.normal_index + 1], inAttrib.normals[3 * tinyObjIndex.normal_index + 2]);
-                    else
-                        vertex.normal = geometricNormal;
-                    if (tinyObjIndex.texcoord_index != -1 && !inAttrib.texcoords.empty())
-                        vertex.texCoord = glm::vec2(inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 0], inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 1]);
-
-                    const CacheKey cacheKey { tinyObjIndex.vertex_index, tinyObjIndex.normal_index, tinyObjIndex.texcoord_index };
-                    if (auto iter = vertexCache.find(cacheKey); settings.cacheVertices && iter != std::end(vertexCache)) {
-                        // Already visited this vertex? Reuse it!
-                        triangle[j] = iter->second;
-                    } else {
-                        // New vertex? Create it and store it in the vertex cache.
-                        vertexCache[cacheKey] = triangle[j] = (unsigned)mesh.vertices.size();
-                        mesh.vertices.push_back(vertex);
-                    }
-                }
-                mesh.triangles.push_back(triangle);
-            }
+            subMeshes.push_back({ &shape, startTriangle, endTriangle });
+            startTriangle = endTriangle;
+        }
+        numTriangles += shape.mesh.indices.size() / 3;
+    }
 
-            const auto materialID = shape.mesh.material_ids[startTriangle];
-            if (materialID == -1) {
-                mesh.material.kd = glm::vec3(1.0f);
-                mesh.material.ks = glm::vec3(0.0f);
-                mesh.material.shininess = 1.0f;
-            } else {
-                const auto& objMaterial = inMaterials[materialID];
-                mesh.material.kd = construct_vec3(objMaterial.diffuse);
-                if (!objMaterial.diffuse_texname.empty()) {
-                    mesh.material.kdTexture = std::make_shared<Image>(baseDir / objMaterial.diffuse_texname);
-                }
-                mesh.material.ks = construct_vec3(objMaterial.specular);
-                mesh.material.shininess = objMaterial.shininess;
-                mesh.material.transparency = objMaterial.dissolve;
-            }
+    // Build the geometry of the sub meshes in parallel, if there is enough of it to pay for the threads.
+    std::vector<Mesh> out(subMeshes.size());
+    parallelFor(subMeshes.size(), [&](size_t subMeshIndex) {
+        const auto& [shape, startTriangle, endTriangle] = subMeshes[subMeshIndex];
+        Mesh& mesh = out[subMeshIndex];
+        CornerIndexMap vertexCache; // Map the indices of a vertex as loaded by tinyobjloader to its index in the generated mesh
+        mesh.triangles.reserve(endTriangle - startTriangle);
+        if (settings.cacheVertices)
+            vertexCache.reset(endTriangle - startTriangle);
+        for (size_t i = startTriangle * 3; i != endTriangle * 3; i += 3) {
+            const glm::vec3 v0 = construct_vec3(&inAttrib.vertices[3 * shape->mesh.indices[i + 0].vertex_index]);
+            const glm::vec3 v1 = construct_vec3(&inAttrib.vertices[3 * shape->mesh.indices[i + 1].vertex_index]);
+            const glm::vec3 v2 = construct_vec3(&inAttrib.vertices[3 * shape->mesh.indices[i + 2].vertex_index]);
+            const auto geometricNormal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
 
-            out.push_back(std::move(mesh));
+            // Load the triangle indices and lazily create the vertices.
+            glm::uvec3 triangle;
+            for (unsigned j = 0; j < 3; j++) {
+                const auto& tinyObjIndex = shape->mesh.indices[i + j];
+                Vertex vertex {
+                    .position = construct_vec3(&inAttrib.vertices[3 * tinyObjIndex.vertex_index]),
+                    .normal = glm::vec3(0),
+                    .texCoord = glm::vec2(0)
+                };
+                if (tinyObjIndex.normal_index != -1 && !inAttrib.normals.empty())
+                    vertex.normal = glm::vec3(inAttrib.normals[3 * tinyObjIndex.normal_index + 0], inAttrib.normals[3 * tinyObjIndex.normal_index + 1], inAttrib.normals[3 * tinyObjIndex.normal_index + 2]);
+                else
+                    vertex.normal = geometricNormal;
+                if (tinyObjIndex.texcoord_index != -1 && !inAttrib.texcoords.empty())
+                    vertex.texCoord = glm::vec2(inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 0], inAttrib.texcoords[2 * tinyObjIndex.texcoord_index + 1]);
 
-            startTriangle = endTriangle;
+                // Reuse the vertex if it was visited before, and otherwise create it.
+                const auto newIndex = (unsigned)mesh.vertices.size();
+                triangle[j] = settings.cacheVertices ? vertexCache.findOrInsert(tinyObjIndex) : newIndex;
+                if (triangle[j] == newIndex)
+                    mesh.vertices.push_back(vertex);
+            }
+            mesh.triangles.push_back(triangle);
+        }
+    }, numTriangles < MinParallelTriangles ? 1 : std::thread::hardware_concurrency());
+
+    // Materials are assigned on this thread, s.t. a texture that fails to load throws to the caller.
+    texturePaths.clear();
+    for (size_t subMeshIndex = 0; subMeshIndex < subMeshes.size(); ++subMeshIndex) {
+        const auto& [shape, startTriangle, endTriangle] = subMeshes[subMeshIndex];
+        Mesh& mesh = out[subMeshIndex];
+        std::filesystem::path texturePath;
+        const auto materialID = shape->mesh.material_ids[startTriangle];
+        if (materialID == -1) {
+            mesh.material.kd = glm::vec3(1.0f);
+            mesh.material.ks = glm::vec3(0.0f);
+            mesh.material.shininess = 1.0f;
+        } else {
+            const auto& objMaterial = inMaterials[materialID];
+            mesh.material.kd = construct_vec3(objMaterial.diffuse);
+            if (!objMaterial.diffuse_texname.empty()) {
+                texturePath = baseDir / objMaterial.diffuse_texname;
+                mesh.material.kdTexture = std::make_shared<Image>(texturePath);
+            }
+            mesh.material.ks = construct_vec3(objMaterial.specular);
+            mesh.material.shininess = objMaterial.shininess;
+            mesh.material.transparency = objMaterial.dissolve;
         }
+        texturePaths.push_back(std::move(texturePath));
     }
 
     if (settings.normalizeVertexPositions)
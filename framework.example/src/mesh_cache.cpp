@@ -0,0 +1,423 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+// Layout of a cache file; all sections start at a multiple of 8 bytes:
+//   CacheHeader
+//   CacheSource, path                                  (numSources times; the OBJ file first, then its MTL files)
+//   CacheMesh, texture path, vertices, triangles       (numMeshes times)
+// Paths are stored relative to the OBJ file's directory, s.t. the cache can be moved along with the data.
+static constexpr std::array<char, 8> CacheMagic { 'C', 'G', 'M', 'E', 'S', 'H', '\0', '\0' };
+static constexpr uint32_t CacheByteOrder = 0x01020304;
+
+struct CacheHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t byteOrder; // Caches are stored in native byte order; this detects foreign ones
+    uint32_t settings; // Bit mask of the `LoadMeshSettings` the meshes were loaded with
+    uint32_t numSources;
+    uint64_t sourceHash; // Hash of the contents of all sources
+    uint64_t numMeshes;
+};
+
+struct CacheSource {
+    int64_t lastWriteTime;
+    uint64_t size;
+    uint64_t pathLength;
+};
+
+struct CacheMesh {
+    uint64_t numVertices;
+    uint64_t numTriangles;
+    glm::vec3 kd;
+    glm::vec3 ks;
+    float shininess;
+    float transparency;
+    uint64_t texturePathLength; // Zero for meshes without a texture
+};
+
+static_assert(std::is_trivially_copyable_v<Vertex> && sizeof(Vertex) == 8 * sizeof(float));
+static_assert(std::is_trivially_copyable_v<glm::uvec3> && sizeof(glm::uvec3) == 3 * sizeof(uint32_t));
+
+// A source file of the cache, and its current state on disk
+struct Source {
+    std::filesystem::path path; // Relative to the OBJ file's directory
+    int64_t lastWriteTime;
+    uint64_t size;
+};
+
+// All source files of a cache, and the hash of their contents
+struct Sources {
+    std::vector<Source> files;
+    uint64_t hash;
+};
+
+static uint32_t encodeSettings(const LoadMeshSettings& settings)
+{
+    return (settings.normalizeVertexPositions ? 1u : 0u) | (settings.cacheVertices ? 2u : 0u);
+}
+
+static size_t alignedSize(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+// Return the size and modification time of a source file, or nothing if it does not exist
+static std::optional<Source> statSource(const std::filesystem::path& baseDir, const std::filesystem::path& path)
+{
+    std::error_code error;
+    const auto lastWriteTime = std::filesystem::last_write_time(baseDir / path, error);
+    if (error) {
+        return {};
+    }
+    const auto size = std::filesystem::file_size(baseDir / path, error);
+    if (error) {
+        return {};
+    }
+    return Source { path, static_cast<int64_t>(lastWriteTime.time_since_epoch().count()), static_cast<uint64_t>(size) };
+}
+
+// 64-bit FNV-1a hash, applied to 8-byte words instead of single bytes for speed;
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+static uint64_t hashBytes(std::span<const std::byte> bytes, uint64_t hash = 0xcbf29ce484222325)
+{
+    constexpr uint64_t prime = 0x100000001b3;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < bytes.size(); i++) {
+        hash = (hash ^ static_cast<uint64_t>(bytes[i])) * prime;
+    }
+    return hash;
+}
+
+// Given an OBJ file, return the MTL files it references, relative to its directory
+static std::vector<std::filesystem::path> findMaterialLibraries(std::string_view obj)
+{
+    std::vector<std::filesystem::path> out;
+    constexpr std::string_view whitespace = " \t\r";
+    for (size_t lineBegin = 0; lineBegin < obj.size();) {
+        const size_t lineEnd = std::min(obj.find('\n', lineBegin), obj.size());
+        std::string_view line = obj.substr(lineBegin, lineEnd - lineBegin);
+        lineBegin = lineEnd + 1;
+
+        line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+        if (!line.starts_with("mtllib") || line.size() == 6 || whitespace.find(line[6]) == std::string_view::npos) {
+            continue;
+        }
+        // tinyobjloader accepts multiple whitespace-separated file names
+        line.remove_prefix(6);
+        while (!line.empty()) {
+            line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+            const size_t nameEnd = std::min(line.find_first_of(whitespace), line.size());
+            if (nameEnd > 0) {
+                out.emplace_back(line.substr(0, nameEnd));
+            }
+            line.remove_prefix(nameEnd);
+        }
+    }
+    return out;
+}
+
+// Given an OBJ file, return its state and that of its MTL files, and the hash of their contents;
+// returns nothing if the OBJ file cannot be read. Missing MTL files are skipped, as tinyobjloader does.
+static std::optional<Sources> hashSources(const std::filesystem::path& file)
+{
+    const auto baseDir = file.parent_path();
+    const auto source = statSource(baseDir, file.filename());
+    const MappedFile obj { file };
+    if (!source || !obj.isOpen()) {
+        return {};
+    }
+    std::vector<Source> sources { *source };
+    uint64_t hash = hashBytes(obj.data());
+
+    const auto data = obj.data();
+    for (const auto& path : findMaterialLibraries({ reinterpret_cast<const char*>(data.data()), data.size() })) {
+        const auto mtlSource = statSource(baseDir, path);
+        const MappedFile mtl { baseDir / path };
+        if (mtlSource && mtl.isOpen()) {
+            sources.push_back(*mtlSource);
+            hash = hashBytes(mtl.data(), hash);
+        }
+    }
+    return Sources { std::move(sources), hash };
+}
+
+// Sequential reader over a mapped cache file, which checks that it does not read past the end of the file
+class CacheReader {
+public:
+    explicit CacheReader(std::span<const std::byte> data)
+        : m_data(data)
+    {
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+        return readArray(&value, 1);
+    }
+
+    template <typename T>
+    bool readArray(T* values, size_t count)
+    {
+        if (count > (m_data.size() - m_offset) / sizeof(T)) {
+            return false;
+        }
+        std::memcpy(values, m_data.data() + m_offset, count * sizeof(T));
+        m_offset = std::min(alignedSize(m_offset + count * sizeof(T)), m_data.size());
+        return true;
+    }
+
+    bool readPath(uint64_t length, std::filesystem::path& path)
+    {
+        if (length > m_data.size() - m_offset) {
+            return false;
+        }
+        std::string string(length, '\0');
+        if (!readArray(string.data(), string.size())) {
+            return false;
+        }
+        path = std::filesystem::path(std::u8string(string.begin(), string.end()));
+        return true;
+    }
+
+private:
+    std::span<const std::byte> m_data;
+    size_t m_offset = 0;
+};
+
+// Sequential writer of a cache file, which pads each section to a multiple of 8 bytes
+class CacheWriter {
+public:
+    explicit CacheWriter(std::ofstream& stream)
+        : m_stream(stream)
+    {
+    }
+
+    template <typename T>
+    void write(const T& value)
+    {
+        writeArray(&value, 1);
+    }
+
+    template <typename T>
+    void writeArray(const T* values, size_t count)
+    {
+        static constexpr std::array<char, 8> padding {};
+        const size_t size = count * sizeof(T);
+        m_stream.write(reinterpret_cast<const char*>(values), static_cast<std::streamsize>(size));
+        m_stream.write(padding.data(), static_cast<std::streamsize>(alignedSize(size) - size));
+    }
+
+    void writePath(const std::string& path)
+    {
+        writeArray(path.data(), path.size());
+    }
+
+private:
+    std::ofstream& m_stream;
+};
+
+static std::string toCachePath(const std::filesystem::path& path)
+{
+    const auto string = path.generic_u8string();
+    return std::string(string.begin(), string.end());
+}
+
+// Read the meshes, and the paths of their textures, from a cache file. The meshes are returned if the cache is valid
+// for the given OBJ file and settings. If the cache's timestamps do not match its sources, the sources are hashed,
+// and returned through `sources`.
+static std::optional<std::vector<Mesh>> readMeshCache(const std::filesystem::path& cacheFile, const std::filesystem::path& file, const LoadMeshSettings& settings,
+    std::vector<std::filesystem::path>& texturePaths, std::optional<Sources>& sources)
+{
+    const MappedFile cache { cacheFile };
+    if (!cache.isOpen()) {
+        return {};
+    }
+    CacheReader reader { cache.data() };
+
+    CacheHeader header;
+    if (!reader.read(header) || header.magic != CacheMagic || header.version != MeshCacheVersion
+        || header.byteOrder != CacheByteOrder || header.settings != encodeSettings(settings) || header.numSources == 0) {
+        return {};
+    }
+
+    // Compare the timestamps of the sources, and if any differs, their contents
+    const auto baseDir = file.parent_path();
+    bool isFresh = true;
+    for (uint32_t i = 0; i < header.numSources; i++) {
+        CacheSource cacheSource;
+        std::filesystem::path path;
+        if (!reader.read(cacheSource) || !reader.readPath(cacheSource.pathLength, path)) {
+            return {};
+        }
+        if (i == 0 && path != file.filename()) {
+            return {};
+        }
+        const auto source = statSource(baseDir, path);
+        isFresh &= source && source->lastWriteTime == cacheSource.lastWriteTime && source->size == cacheSource.size;
+    }
+    if (!isFresh) {
+        sources = hashSources(file);
+        if (!sources || sources->hash != header.sourceHash) {
+            return {};
+        }
+    }
+
+    std::vector<Mesh> out;
+    texturePaths.clear();
+    for (uint64_t i = 0; i < header.numMeshes; i++) {
+        CacheMesh cacheMesh;
+        std::filesystem::path texturePath;
+        if (!reader.read(cacheMesh) || !reader.readPath(cacheMesh.texturePathLength, texturePath)) {
+            return {};
+        }
+
+        // Check the sizes against the file before allocating anything
+        if (cacheMesh.numVertices > cache.data().size() / sizeof(Vertex) || cacheMesh.numTriangles > cache.data().size() / sizeof(glm::uvec3)) {
+            return {};
+        }
+        Mesh mesh;
+        mesh.vertices.resize(cacheMesh.numVertices);
+        mesh.triangles.resize(cacheMesh.numTriangles);
+        if (!reader.readArray(mesh.vertices.data(), mesh.vertices.size()) || !reader.readArray(mesh.triangles.data(), mesh.triangles.size())) {
+            return {};
+        }
+        if (std::any_of(std::begin(mesh.triangles), std::end(mesh.triangles), [&](const glm::uvec3& triangle) {
+                return triangle.x >= mesh.vertices.size() || triangle.y >= mesh.vertices.size() || triangle.z >= mesh.vertices.size();
+            })) {
+            return {};
+        }
+
+        mesh.material.kd = cacheMesh.kd;
+        mesh.material.ks = cacheMesh.ks;
+        mesh.material.shininess = cacheMesh.shininess;
+        mesh.material.transparency = cacheMesh.transparency;
+        if (!texturePath.empty()) {
+            texturePath = baseDir / texturePath;
+            mesh.material.kdTexture = std::make_shared<Image>(texturePath);
+        }
+        out.push_back(std::move(mesh));
+        texturePaths.push_back(std::move(texturePath));
+    }
+    return out;
+}
+
+// Write the meshes loaded from the given OBJ file with the given settings, and the sources they were loaded from, to a
+// cache file; returns false on failure. The cache is written to a uniquely named temporary file first, s.t. concurrent
+// loads never see a partially written cache, and concurrent writes never write into the same file.
+static bool writeMeshCache(const std::filesystem::path& cacheFile, const std::filesystem::path& file, const LoadMeshSettings& settings,
+    const Sources& sources, std::span<const Mesh> meshes, std::span<const std::filesystem::path> texturePaths)
+{
+    const auto baseDir = file.parent_path();
+
+    std::error_code error;
+    if (cacheFile.has_parent_path()) {
+        std::filesystem::create_directories(cacheFile.parent_path(), error);
+    }
+    auto temporaryFile = cacheFile;
+    temporaryFile += ".tmp" + std::to_string(std::random_device()() ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream stream { temporaryFile, std::ios::binary | std::ios::trunc };
+        if (!stream) {
+            return false;
+        }
+        CacheWriter writer { stream };
+
+        writer.write(CacheHeader {
+            .magic = CacheMagic,
+            .version = MeshCacheVersion,
+            .byteOrder = CacheByteOrder,
+            .settings = encodeSettings(settings),
+            .numSources = static_cast<uint32_t>(sources.files.size()),
+            .sourceHash = sources.hash,
+            .numMeshes = meshes.size() });
+        for (const auto& source : sources.files) {
+            const auto path = toCachePath(source.path);
+            writer.write(CacheSource { .lastWriteTime = source.lastWriteTime, .size = source.size, .pathLength = path.size() });
+            writer.writePath(path);
+        }
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const Mesh& mesh = meshes[i];
+            const auto texturePath = texturePaths[i].empty() ? std::string() : toCachePath(texturePaths[i].lexically_relative(baseDir));
+            writer.write(CacheMesh {
+                .numVertices = mesh.vertices.size(),
+                .numTriangles = mesh.triangles.size(),
+                .kd = mesh.material.kd,
+                .ks = mesh.material.ks,
+                .shininess = mesh.material.shininess,
+                .transparency = mesh.material.transparency,
+                .texturePathLength = texturePath.size() });
+            writer.writePath(texturePath);
+            writer.writeArray(mesh.vertices.data(), mesh.vertices.size());
+            writer.writeArray(mesh.triangles.data(), mesh.triangles.size());
+        }
+        if (!stream.flush()) {
+            stream.close();
+            std::filesystem::remove(temporaryFile, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryFile, cacheFile, error);
+    if (error) {
+        std::filesystem::remove(temporaryFile, error);
+        return false;
+    }
+    return true;
+}
+
+std::filesystem::path meshCachePath(const std::filesystem::path& file, const std::filesystem::path& cacheDir)
+{
+    auto fileName = file.filename();
+    fileName += ".meshcache";
+    if (cacheDir.empty()) {
+        return file.parent_path() / fileName;
+    }
+    // Files with the same name in different directories should not share a cache
+    std::error_code error;
+    const auto absoluteFile = std::filesystem::weakly_canonical(file, error);
+    const auto pathString = toCachePath(error ? file : absoluteFile);
+    const uint64_t pathHash = hashBytes(std::as_bytes(std::span { pathString.data(), pathString.size() }));
+    std::array<char, 17> pathHashString;
+    std::snprintf(pathHashString.data(), pathHashString.size(), "%016llx", static_cast<unsigned long long>(pathHash));
+    return cacheDir / (file.stem().string() + "-" + pathHashString.data() + ".meshcache");
+}
+
+std::vector<Mesh> loadMeshCached(const std::filesystem::path& file, const LoadMeshSettings& settings, const std::filesystem::path& cacheDir)
+{
+    const auto cacheFile = meshCachePath(file, cacheDir);
+    std::vector<std::filesystem::path> texturePaths;
+    std::optional<Sources> sources;
+    if (auto meshes = readMeshCache(cacheFile, file, settings, texturePaths, sources)) {
+        // Same contents, but different timestamps; rewrite the cache, s.t. the next load need not hash the sources
+        if (sources) {
+            writeMeshCache(cacheFile, file, settings, *sources, *meshes, texturePaths);
+        }
+        return std::move(*meshes);
+    }
+
+    // Hash the sources before loading them, s.t. changes made while loading invalidate the cache
+    sources = hashSources(file);
+    std::vector<Mesh> meshes = loadMesh(file, settings, texturePaths);
+    if (!sources || !writeMeshCache(cacheFile, file, settings, *sources, meshes, texturePaths)) {
+        std::cerr << "Failed to write mesh cache " << cacheFile << std::endl;
+    }
+    return meshes;
+}
@@ -0,0 +1,520 @@
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Files are split into chunks of at least this size, s.t. small files are parsed by a single thread
+static constexpr size_t MinChunkSize = 1 << 20;
+
+namespace {
+// A statement other than a vertex or a face, which is replayed in file order when the chunks are merged
+struct Statement {
+    enum class Type {
+        UseMaterial, // usemtl
+        MaterialLibrary, // mtllib
+        Group // g or o; both start a new shape
+    };
+
+    Type type;
+    size_t face; // Nr. of faces in the chunk before the statement; after triangulation, the nr. of triangles
+    std::string argument;
+};
+
+// Parse result of a range of lines
+struct Chunk {
+    std::vector<float> positions, normals, texCoords;
+    std::vector<tinyobj::index_t> corners; // Corners of all faces; relative indices are relative to the chunk
+    std::vector<uint8_t> faceSizes; // Nr. of corners of each face; 3 or 4
+    std::vector<uint8_t> relativeCorners; // Per corner, which of its indices are relative; empty if none are
+    std::vector<Statement> statements;
+    std::vector<tinyobj::index_t> triangles; // Triangulated faces, after merging
+
+    // Quads are triangulated using their vertices, which must be defined before the quad; these bound the vertex
+    // indices of all quads, relative to the nr. of vertices in the chunk before the quad
+    int64_t maxQuadAbsoluteIndex = std::numeric_limits<int64_t>::min();
+    int64_t minQuadRelativeIndex = std::numeric_limits<int64_t>::max();
+
+    bool isSupported = true;
+};
+
+constexpr uint8_t RelativeVertex = 1, RelativeNormal = 2, RelativeTexCoord = 4;
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+bool isDigit(char c)
+{
+    return static_cast<unsigned>(c - '0') < 10u;
+}
+
+// Character at the cursor, or '\0' at the end of the line, as tinyobjloader sees it
+char peek(const char* p, const char* end)
+{
+    return p != end ? *p : '\0';
+}
+
+// Port of tinyobjloader's `tryParseDouble()`, which is not correctly rounded; it is replicated operation for operation,
+// s.t. both parsers produce the same floats. Returns false and leaves `result` unchanged if nothing could be parsed.
+bool tryParseDouble(const char* s, const char* end, double& result)
+{
+    if (s >= end)
+        return false;
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    char exponentSign = '+';
+    const char* curr = s;
+    int read = 0;
+    bool leadingDecimalDot = false;
+
+    if (*curr == '+' || *curr == '-') {
+        sign = *curr;
+        curr++;
+        if (curr != end && *curr == '.')
+            leadingDecimalDot = true;
+    } else if (isDigit(*curr)) {
+    } else if (*curr == '.') {
+        leadingDecimalDot = true;
+    } else {
+        return false;
+    }
+
+    // Integer part
+    if (!leadingDecimalDot) {
+        while (curr != end && isDigit(*curr)) {
+            mantissa *= 10;
+            mantissa += static_cast<int>(*curr - '0');
+            curr++;
+            read++;
+        }
+        if (read == 0)
+            return false;
+    }
+
+    if (curr != end) {
+        // Decimal part
+        bool hasExponent = false;
+        if (*curr == '.') {
+            curr++;
+            read = 1;
+            while (curr != end && isDigit(*curr)) {
+                static constexpr double powers[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+                constexpr int numPowers = sizeof(powers) / sizeof(powers[0]);
+                mantissa += static_cast<int>(*curr - '0') * (read < numPowers ? powers[read] : std::pow(10.0, -read));
+                read++;
+                curr++;
+            }
+            hasExponent = curr != end && (*curr == 'e' || *curr == 'E');
+        } else {
+            hasExponent = *curr == 'e' || *curr == 'E';
+        }
+
+        // Exponent part
+        if (hasExponent) {
+            curr++;
+            if (curr != end && (*curr == '+' || *curr == '-')) {
+                exponentSign = *curr;
+                curr++;
+            } else if (!isDigit(peek(curr, end))) {
+                return false;
+            }
+            read = 0;
+            while (curr != end && isDigit(*curr)) {
+                if (exponent > std::numeric_limits<int>::max() / 10)
+                    return false;
+                exponent *= 10;
+                exponent += static_cast<int>(*curr - '0');
+                curr++;
+                read++;
+            }
+            exponent *= (exponentSign == '+' ? 1 : -1);
+            if (read == 0)
+                return false;
+        }
+    }
+
+    result = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+    return true;
+}
+
+// Equivalent of tinyobjloader's `parseReal()`; parse the next whitespace-separated float, or return the default
+float parseReal(const char*& p, const char* end, double defaultValue = 0.0)
+{
+    while (p != end && isSpace(*p))
+        p++;
+    const char* tokenEnd = p;
+    while (tokenEnd != end && !isSpace(*tokenEnd))
+        tokenEnd++;
+    double value = defaultValue;
+    tryParseDouble(p, tokenEnd, value);
+    p = tokenEnd;
+    return static_cast<float>(value);
+}
+
+// Parse a face index as `atoi()` would, and skip the rest of the token up to the next '/' or whitespace; only plain
+// integers are accepted, so that everything `atoi()` might read differently is left to tinyobjloader
+bool parseIndex(const char*& p, const char* end, int& index)
+{
+    const bool negative = peek(p, end) == '-';
+    if (negative || peek(p, end) == '+')
+        p++;
+    int value = 0, numDigits = 0;
+    for (; p != end && isDigit(*p); p++, numDigits++)
+        value = value * 10 + (*p - '0');
+    if (numDigits == 0 || numDigits > 9)
+        return false;
+    index = negative ? -value : value;
+    while (p != end && *p != '/' && !isSpace(*p))
+        p++;
+    return true;
+}
+
+// Equivalent of tinyobjloader's `fixIndex()`, which makes indices zero based; relative (negative) indices are resolved
+// against the nr. of elements in the chunk, and flagged s.t. they can be offset by the chunk's position later
+bool fixIndex(int index, size_t numElements, int& out, uint8_t& relative, uint8_t relativeBit)
+{
+    if (index > 0) {
+        out = index - 1;
+    } else if (index < 0) {
+        out = static_cast<int>(numElements) + index;
+        relative |= relativeBit;
+    } else {
+        return false; // Zero is not a valid index
+    }
+    return true;
+}
+
+// Equivalent of tinyobjloader's `parseTriple()`; parse a face corner (v, v/vt, v//vn, or v/vt/vn)
+bool parseCorner(const char*& p, const char* end, const Chunk& chunk, tinyobj::index_t& corner, uint8_t& relative)
+{
+    corner = { -1, -1, -1 };
+    relative = 0;
+    int index;
+    if (!parseIndex(p, end, index) || !fixIndex(index, chunk.positions.size() / 3, corner.vertex_index, relative, RelativeVertex))
+        return false;
+    if (peek(p, end) != '/')
+        return true;
+    p++;
+
+    if (peek(p, end) == '/') {
+        p++;
+        return parseIndex(p, end, index) && fixIndex(index, chunk.normals.size() / 3, corner.normal_index, relative, RelativeNormal);
+    }
+
+    if (!parseIndex(p, end, index) || !fixIndex(index, chunk.texCoords.size() / 2, corner.texcoord_index, relative, RelativeTexCoord))
+        return false;
+    if (peek(p, end) != '/')
+        return true;
+    p++;
+    return parseIndex(p, end, index) && fixIndex(index, chunk.normals.size() / 3, corner.normal_index, relative, RelativeNormal);
+}
+
+bool parseFace(const char* p, const char* end, Chunk& chunk)
+{
+    while (p != end && isSpace(*p))
+        p++;
+
+    std::array<tinyobj::index_t, 4> corners;
+    std::array<uint8_t, 4> relative;
+    size_t numCorners = 0;
+    while (p != end) {
+        if (numCorners == corners.size())
+            return false; // Polygons are triangulated by ear clipping, which is left to tinyobjloader
+        if (!parseCorner(p, end, chunk, corners[numCorners], relative[numCorners]))
+            return false;
+        numCorners++;
+        while (p != end && isSpace(*p))
+            p++;
+    }
+    if (numCorners < 3)
+        return false; // Degenerate faces leave an empty shape behind in tinyobjloader
+
+    const bool isRelative = std::any_of(std::begin(relative), std::begin(relative) + numCorners, [](uint8_t r) { return r != 0; });
+    if (isRelative || !chunk.relativeCorners.empty()) {
+        chunk.relativeCorners.resize(chunk.corners.size(), 0); // Created on the first face with relative indices
+        chunk.relativeCorners.insert(std::end(chunk.relativeCorners), std::begin(relative), std::begin(relative) + numCorners);
+    }
+    if (numCorners == 4) {
+        const int64_t numPositions = static_cast<int64_t>(chunk.positions.size() / 3);
+        for (size_t i = 0; i < numCorners; i++) {
+            if (relative[i] & RelativeVertex)
+                chunk.minQuadRelativeIndex = std::min<int64_t>(chunk.minQuadRelativeIndex, corners[i].vertex_index);
+            else
+                chunk.maxQuadAbsoluteIndex = std::max<int64_t>(chunk.maxQuadAbsoluteIndex, corners[i].vertex_index - numPositions);
+        }
+    }
+    chunk.corners.insert(std::end(chunk.corners), std::begin(corners), std::begin(corners) + numCorners);
+    chunk.faceSizes.push_back(static_cast<uint8_t>(numCorners));
+    return true;
+}
+
+// Parse a single line, without line break, in the same way as tinyobjloader's `LoadObj()`
+bool parseLine(const char* p, const char* end, Chunk& chunk)
+{
+    while (p != end && isSpace(*p))
+        p++;
+    const std::string_view token { p, static_cast<size_t>(end - p) };
+    const auto at = [&](size_t i) { return i < token.size() ? token[i] : '\0'; };
+
+    if (token.empty() || token[0] == '#')
+        return true;
+    if (token[0] == 'v' && isSpace(at(1))) {
+        p += 2;
+        for (int i = 0; i < 3; i++)
+            chunk.positions.push_back(parseReal(p, end));
+        return true;
+    }
+    if (token[0] == 'v' && at(1) == 'n' && isSpace(at(2))) {
+        p += 3;
+        for (int i = 0; i < 3; i++)
+            chunk.normals.push_back(parseReal(p, end));
+        return true;
+    }
+    if (token[0] == 'v' && at(1) == 't' && isSpace(at(2))) {
+        p += 3;
+        for (int i = 0; i < 2; i++)
+            chunk.texCoords.push_back(parseReal(p, end));
+        return true;
+    }
+    if ((token[0] == 'v' && at(1) == 'w' && isSpace(at(2))) || ((token[0] == 'l' || token[0] == 'p') && isSpace(at(1))))
+        return false; // Skin weights, lines and points
+    if (token[0] == 'f' && isSpace(at(1)))
+        return parseFace(p + 2, end, chunk);
+
+    if (token.starts_with("usemtl")) {
+        // The material name is the next whitespace-separated token
+        p += 6;
+        while (p != end && isSpace(*p))
+            p++;
+        const char* nameEnd = p;
+        while (nameEnd != end && !isSpace(*nameEnd))
+            nameEnd++;
+        chunk.statements.push_back({ Statement::Type::UseMaterial, chunk.faceSizes.size(), std::string(p, nameEnd) });
+    } else if (token.starts_with("mtllib") && isSpace(at(6))) {
+        chunk.statements.push_back({ Statement::Type::MaterialLibrary, chunk.faceSizes.size(), std::string(token.substr(7)) });
+    } else if ((token[0] == 'g' || token[0] == 'o') && isSpace(at(1))) {
+        chunk.statements.push_back({ Statement::Type::Group, chunk.faceSizes.size(), {} });
+    }
+    // Anything else, like smoothing groups and tags, does not affect the output
+    return true;
+}
+
+// Parse the lines in [begin, end); the range starts at the beginning of a line, and ends at the end of a line
+void parseChunk(const char* begin, const char* end, Chunk& chunk)
+{
+    if (std::memchr(begin, '\0', static_cast<size_t>(end - begin)) != nullptr) {
+        chunk.isSupported = false; // tinyobjloader cuts lines short at null characters
+        return;
+    }
+    // Lines end at "\n", "\r\n", or "\r"; splitting at either character only adds empty lines, which are skipped
+    for (const char* lineBegin = begin; lineBegin < end && chunk.isSupported;) {
+        const char* lineEnd = lineBegin;
+        while (lineEnd != end && *lineEnd != '\n' && *lineEnd != '\r')
+            lineEnd++;
+        chunk.isSupported = parseLine(lineBegin, lineEnd, chunk);
+        lineBegin = lineEnd + 1;
+    }
+}
+
+// Given the nr. of elements in all chunks before this one, make the chunk's relative indices absolute, and
+// triangulate its faces exactly as tinyobjloader does, using the merged positions
+void triangulateChunk(Chunk& chunk, int numPrecedingPositions, int numPrecedingNormals, int numPrecedingTexCoords, std::span<const float> positions)
+{
+    if (chunk.maxQuadAbsoluteIndex >= numPrecedingPositions || chunk.minQuadRelativeIndex < -numPrecedingPositions) {
+        chunk.isSupported = false; // tinyobjloader skips quads with undefined vertices
+        return;
+    }
+    for (size_t i = 0; i < chunk.relativeCorners.size(); i++) {
+        tinyobj::index_t& corner = chunk.corners[i];
+        corner.vertex_index += (chunk.relativeCorners[i] & RelativeVertex) ? numPrecedingPositions : 0;
+        corner.normal_index += (chunk.relativeCorners[i] & RelativeNormal) ? numPrecedingNormals : 0;
+        corner.texcoord_index += (chunk.relativeCorners[i] & RelativeTexCoord) ? numPrecedingTexCoords : 0;
+    }
+
+    // Statements refer to the faces before them; renumber these to triangles
+    auto statement = std::begin(chunk.statements);
+    chunk.triangles.reserve(3 * chunk.faceSizes.size());
+    const tinyobj::index_t* corners = chunk.corners.data();
+    for (size_t face = 0; face < chunk.faceSizes.size(); face++) {
+        for (; statement != std::end(chunk.statements) && statement->face == face; statement++)
+            statement->face = chunk.triangles.size() / 3;
+
+        if (chunk.faceSizes[face] == 3) {
+            chunk.triangles.insert(std::end(chunk.triangles), corners, corners + 3);
+            corners += 3;
+            continue;
+        }
+
+        // Split quads along their shorter diagonal, with the same floating point operations as tinyobjloader
+        const float* v0 = &positions[3 * static_cast<size_t>(corners[0].vertex_index)];
+        const float* v1 = &positions[3 * static_cast<size_t>(corners[1].vertex_index)];
+        const float* v2 = &positions[3 * static_cast<size_t>(corners[2].vertex_index)];
+        const float* v3 = &positions[3 * static_cast<size_t>(corners[3].vertex_index)];
+        const float e02x = v2[0] - v0[0], e02y = v2[1] - v0[1], e02z = v2[2] - v0[2];
+        const float e13x = v3[0] - v1[0], e13y = v3[1] - v1[1], e13z = v3[2] - v1[2];
+        const float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+        const float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+        if (sqr02 < sqr13)
+            chunk.triangles.insert(std::end(chunk.triangles), { corners[0], corners[1], corners[2], corners[0], corners[2], corners[3] });
+        else
+            chunk.triangles.insert(std::end(chunk.triangles), { corners[0], corners[1], corners[3], corners[1], corners[2], corners[3] });
+        corners += 4;
+    }
+    for (; statement != std::end(chunk.statements); statement++)
+        statement->face = chunk.triangles.size() / 3;
+
+    chunk.corners = {};
+    chunk.relativeCorners = {};
+    chunk.faceSizes = {};
+}
+
+// Port of tinyobjloader's `SplitString()`, used to split the file names of `mtllib`
+std::vector<std::string> splitString(const std::string& s, char delimiter, char escape)
+{
+    std::vector<std::string> out;
+    std::string token;
+    bool escaping = false;
+    for (const char c : s) {
+        if (escaping) {
+            escaping = false;
+        } else if (c == escape) {
+            escaping = true;
+            continue;
+        } else if (c == delimiter) {
+            if (!token.empty())
+                out.push_back(token);
+            token.clear();
+            continue;
+        }
+        token += c;
+    }
+    out.push_back(token);
+    return out;
+}
+} // namespace
+
+bool loadObjParallel(const std::filesystem::path& file, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes,
+    std::vector<tinyobj::material_t>& materials, size_t numChunks)
+{
+    attrib = {};
+    shapes.clear();
+    materials.clear();
+
+    const MappedFile mappedFile { file };
+    if (!mappedFile.isOpen())
+        return false;
+    const char* data = reinterpret_cast<const char*>(mappedFile.data().data());
+    const size_t size = mappedFile.data().size();
+
+    // Split the file into chunks at line boundaries, and parse these in parallel
+    if (numChunks == 0)
+        numChunks = std::clamp<size_t>(size / MinChunkSize, 1, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<size_t> chunkBegins { 0 };
+    for (size_t i = 1; i < numChunks; i++) {
+        const size_t target = std::max(chunkBegins.back(), i * (size / numChunks));
+        const void* lineEnd = std::memchr(data + target, '\n', size - target);
+        chunkBegins.push_back(lineEnd ? static_cast<size_t>(static_cast<const char*>(lineEnd) - data) + 1 : size);
+    }
+    chunkBegins.push_back(size);
+
+    std::vector<Chunk> chunks(numChunks);
+    parallelFor(numChunks, [&](size_t i) { parseChunk(data + chunkBegins[i], data + chunkBegins[i + 1], chunks[i]); });
+    if (!std::all_of(std::begin(chunks), std::end(chunks), [](const Chunk& chunk) { return chunk.isSupported; }))
+        return false;
+
+    // Concatenate the vertex data, and resolve and triangulate the faces of each chunk
+    std::vector<size_t> positionOffsets, normalOffsets, texCoordOffsets;
+    size_t numPositions = 0, numNormals = 0, numTexCoords = 0;
+    for (const Chunk& chunk : chunks) {
+        positionOffsets.push_back(numPositions);
+        normalOffsets.push_back(numNormals);
+        texCoordOffsets.push_back(numTexCoords);
+        numPositions += chunk.positions.size();
+        numNormals += chunk.normals.size();
+        numTexCoords += chunk.texCoords.size();
+    }
+    if (numPositions / 3 > static_cast<size_t>(std::numeric_limits<int>::max()))
+        return false;
+    attrib.vertices.resize(numPositions);
+    attrib.normals.resize(numNormals);
+    attrib.texcoords.resize(numTexCoords);
+    parallelFor(numChunks, [&](size_t i) {
+        std::copy(std::begin(chunks[i].positions), std::end(chunks[i].positions), std::begin(attrib.vertices) + static_cast<ptrdiff_t>(positionOffsets[i]));
+        std::copy(std::begin(chunks[i].normals), std::end(chunks[i].normals), std::begin(attrib.normals) + static_cast<ptrdiff_t>(normalOffsets[i]));
+        std::copy(std::begin(chunks[i].texCoords), std::end(chunks[i].texCoords), std::begin(attrib.texcoords) + static_cast<ptrdiff_t>(texCoordOffsets[i]));
+        chunks[i].positions = {};
+        chunks[i].normals = {};
+        chunks[i].texCoords = {};
+    });
+    parallelFor(numChunks, [&](size_t i) {
+        triangulateChunk(chunks[i], static_cast<int>(positionOffsets[i] / 3), static_cast<int>(normalOffsets[i] / 3),
+            static_cast<int>(texCoordOffsets[i] / 2), attrib.vertices);
+    });
+    if (!std::all_of(std::begin(chunks), std::end(chunks), [](const Chunk& chunk) { return chunk.isSupported; })) {
+        attrib = {};
+        return false;
+    }
+
+    // Replay the statements in file order, to assign materials and split the triangles into shapes
+    std::string materialBaseDir = file.parent_path().string();
+#ifdef _WIN32
+    constexpr char separator = '\\';
+#else
+    constexpr char separator = '/';
+#endif
+    if (!materialBaseDir.empty() && materialBaseDir.back() != separator)
+        materialBaseDir += separator;
+    tinyobj::MaterialFileReader materialReader { materialBaseDir };
+    std::map<std::string, int> materialMap;
+    int material = -1;
+
+    tinyobj::shape_t shape;
+    for (const Chunk& chunk : chunks) {
+        size_t triangle = 0;
+        const auto appendTriangles = [&](size_t end) {
+            shape.mesh.indices.insert(std::end(shape.mesh.indices), std::begin(chunk.triangles) + static_cast<ptrdiff_t>(3 * triangle),
+                std::begin(chunk.triangles) + static_cast<ptrdiff_t>(3 * end));
+            shape.mesh.material_ids.insert(std::end(shape.mesh.material_ids), end - triangle, material);
+            triangle = end;
+        };
+
+        for (const Statement& statement : chunk.statements) {
+            appendTriangles(statement.face);
+            switch (statement.type) {
+            case Statement::Type::UseMaterial: {
+                const auto iter = materialMap.find(statement.argument);
+                material = iter != std::end(materialMap) ? iter->second : -1;
+            } break;
+            case Statement::Type::MaterialLibrary: {
+                // Load the first of the listed files that can be read
+                for (const auto& fileName : splitString(statement.argument, ' ', '\\')) {
+                    std::string warning, error;
+                    if (materialReader(fileName, &materials, &materialMap, &warning, &error))
+                        break;
+                }
+            } break;
+            case Statement::Type::Group: {
+                if (!shape.mesh.indices.empty())
+                    shapes.push_back(std::move(shape));
+                shape = tinyobj::shape_t();
+            } break;
+            }
+        }
+        appendTriangles(chunk.triangles.size() / 3);
+    }
+    if (!shape.mesh.indices.empty())
+        shapes.push_back(std::move(shape));
+    return true;
+}